@@ -0,0 +1,205 @@
+#include "aes_accel.h"
+
+#include <pthread.h>
+#include <string.h>
+
+#if defined(__aarch64__)
+#include <sys/auxv.h>
+#ifndef HWCAP_AES
+#define HWCAP_AES (1 << 3)
+#endif
+#elif defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#ifndef bit_AES
+#define bit_AES (1 << 25)
+#endif
+#endif
+
+// 声明来自 aes_accel_arm.c / aes_accel_x86.c 的实现，blocks 为 16 字节块数
+#if defined(__aarch64__)
+extern void aes_accel_armv8_cbc_encrypt(const uint8_t *rk, uint8_t *iv, const uint8_t *in, uint8_t *out,
+                                        size_t blocks);
+extern void aes_accel_armv8_cbc_decrypt(const uint8_t *rk, uint8_t *iv, const uint8_t *in, uint8_t *out,
+                                        size_t blocks);
+extern void aes_accel_armv8_ecb_encrypt(const uint8_t *rk, const uint8_t *in, uint8_t *out, size_t blocks);
+extern void aes_accel_armv8_ecb_decrypt(const uint8_t *rk, const uint8_t *in, uint8_t *out, size_t blocks);
+#elif defined(__x86_64__) || defined(__i386__)
+extern void aes_accel_aesni_cbc_encrypt(const uint8_t *rk, uint8_t *iv, const uint8_t *in, uint8_t *out,
+                                        size_t blocks);
+extern void aes_accel_aesni_cbc_decrypt(const uint8_t *rk, uint8_t *iv, const uint8_t *in, uint8_t *out,
+                                        size_t blocks);
+extern void aes_accel_aesni_ecb_encrypt(const uint8_t *rk, const uint8_t *in, uint8_t *out, size_t blocks);
+extern void aes_accel_aesni_ecb_decrypt(const uint8_t *rk, const uint8_t *in, uint8_t *out, size_t blocks);
+#endif
+
+static AES_ACCEL_TYPE g_accel_type = AES_ACCEL_TYPE_NONE;
+static pthread_once_t g_accel_once = PTHREAD_ONCE_INIT;
+
+static const uint8_t aes_sbox[256] = {
+    0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5, 0x30, 0x01, 0x67, 0x2b, 0xfe, 0xd7, 0xab, 0x76, 0xca, 0x82, 0xc9,
+    0x7d, 0xfa, 0x59, 0x47, 0xf0, 0xad, 0xd4, 0xa2, 0xaf, 0x9c, 0xa4, 0x72, 0xc0, 0xb7, 0xfd, 0x93, 0x26, 0x36, 0x3f,
+    0xf7, 0xcc, 0x34, 0xa5, 0xe5, 0xf1, 0x71, 0xd8, 0x31, 0x15, 0x04, 0xc7, 0x23, 0xc3, 0x18, 0x96, 0x05, 0x9a, 0x07,
+    0x12, 0x80, 0xe2, 0xeb, 0x27, 0xb2, 0x75, 0x09, 0x83, 0x2c, 0x1a, 0x1b, 0x6e, 0x5a, 0xa0, 0x52, 0x3b, 0xd6, 0xb3,
+    0x29, 0xe3, 0x2f, 0x84, 0x53, 0xd1, 0x00, 0xed, 0x20, 0xfc, 0xb1, 0x5b, 0x6a, 0xcb, 0xbe, 0x39, 0x4a, 0x4c, 0x58,
+    0xcf, 0xd0, 0xef, 0xaa, 0xfb, 0x43, 0x4d, 0x33, 0x85, 0x45, 0xf9, 0x02, 0x7f, 0x50, 0x3c, 0x9f, 0xa8, 0x51, 0xa3,
+    0x40, 0x8f, 0x92, 0x9d, 0x38, 0xf5, 0xbc, 0xb6, 0xda, 0x21, 0x10, 0xff, 0xf3, 0xd2, 0xcd, 0x0c, 0x13, 0xec, 0x5f,
+    0x97, 0x44, 0x17, 0xc4, 0xa7, 0x7e, 0x3d, 0x64, 0x5d, 0x19, 0x73, 0x60, 0x81, 0x4f, 0xdc, 0x22, 0x2a, 0x90, 0x88,
+    0x46, 0xee, 0xb8, 0x14, 0xde, 0x5e, 0x0b, 0xdb, 0xe0, 0x32, 0x3a, 0x0a, 0x49, 0x06, 0x24, 0x5c, 0xc2, 0xd3, 0xac,
+    0x62, 0x91, 0x95, 0xe4, 0x79, 0xe7, 0xc8, 0x37, 0x6d, 0x8d, 0xd5, 0x4e, 0xa9, 0x6c, 0x56, 0xf4, 0xea, 0x65, 0x7a,
+    0xae, 0x08, 0xba, 0x78, 0x25, 0x2e, 0x1c, 0xa6, 0xb4, 0xc6, 0xe8, 0xdd, 0x74, 0x1f, 0x4b, 0xbd, 0x8b, 0x8a, 0x70,
+    0x3e, 0xb5, 0x66, 0x48, 0x03, 0xf6, 0x0e, 0x61, 0x35, 0x57, 0xb9, 0x86, 0xc1, 0x1d, 0x9e, 0xe1, 0xf8, 0x98, 0x11,
+    0x69, 0xd9, 0x8e, 0x94, 0x9b, 0x1e, 0x87, 0xe9, 0xce, 0x55, 0x28, 0xdf, 0x8c, 0xa1, 0x89, 0x0d, 0xbf, 0xe6, 0x42,
+    0x68, 0x41, 0x99, 0x2d, 0x0f, 0xb0, 0x54, 0xbb, 0x16};
+
+static void aes_accel_detect(void) {
+#if defined(__aarch64__)
+  if (getauxval(AT_HWCAP) & HWCAP_AES) g_accel_type = AES_ACCEL_TYPE_ARMV8;
+#elif defined(__x86_64__) || defined(__i386__)
+  unsigned int eax, ebx, ecx, edx;
+  if (__get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_AES)) g_accel_type = AES_ACCEL_TYPE_AESNI;
+#endif
+}
+
+AES_ACCEL_TYPE aes_accel_type(void) {
+  pthread_once(&g_accel_once, aes_accel_detect);
+  return g_accel_type;
+}
+
+const char *aes_accel_name(void) {
+  switch (aes_accel_type()) {
+    case AES_ACCEL_TYPE_ARMV8:
+      return "armv8-ce";
+    case AES_ACCEL_TYPE_AESNI:
+      return "aes-ni";
+    default:
+      return "none";
+  }
+}
+
+static uint8_t aes_xtime(uint8_t x) { return (uint8_t)((x << 1) ^ ((x >> 7) * 0x1b)); }
+
+static uint8_t aes_gmul(uint8_t x, uint8_t y) {
+  uint8_t r = 0;
+  for (; y; y >>= 1, x = aes_xtime(x)) {
+    if (y & 1) r ^= x;
+  }
+  return r;
+}
+
+// FIPS-197 5.2 的密钥扩展，只在换密钥时跑一次，不用硬件指令
+static void aes_accel_expand(uint8_t *rk, const unsigned char *key) {
+  static const uint8_t rcon[AES_ACCEL_ROUNDS] = {0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1b, 0x36};
+  memcpy(rk, key, AES_ACCEL_BLOCK);
+  for (int i = 4; i < (AES_ACCEL_ROUNDS + 1) * 4; i++) {
+    uint8_t t[4];
+    memcpy(t, rk + (i - 1) * 4, 4);
+    if (i % 4 == 0) {
+      uint8_t u = t[0];
+      t[0] = aes_sbox[t[1]] ^ rcon[i / 4 - 1];
+      t[1] = aes_sbox[t[2]];
+      t[2] = aes_sbox[t[3]];
+      t[3] = aes_sbox[u];
+    }
+    for (int j = 0; j < 4; j++) rk[i * 4 + j] = rk[(i - 4) * 4 + j] ^ t[j];
+  }
+}
+
+static void aes_accel_inv_mix(uint8_t *dst, const uint8_t *src) {
+  for (int c = 0; c < 4; c++) {
+    const uint8_t *a = src + c * 4;
+    uint8_t *b = dst + c * 4;
+    b[0] = aes_gmul(a[0], 14) ^ aes_gmul(a[1], 11) ^ aes_gmul(a[2], 13) ^ aes_gmul(a[3], 9);
+    b[1] = aes_gmul(a[0], 9) ^ aes_gmul(a[1], 14) ^ aes_gmul(a[2], 11) ^ aes_gmul(a[3], 13);
+    b[2] = aes_gmul(a[0], 13) ^ aes_gmul(a[1], 9) ^ aes_gmul(a[2], 14) ^ aes_gmul(a[3], 11);
+    b[3] = aes_gmul(a[0], 11) ^ aes_gmul(a[1], 13) ^ aes_gmul(a[2], 9) ^ aes_gmul(a[3], 14);
+  }
+}
+
+int aes_accel_setkey_enc(aes_accel_key_t *ek, const unsigned char *key) {
+  if (aes_accel_type() == AES_ACCEL_TYPE_NONE) return -1;
+  aes_accel_expand(ek->rk, key);
+  return 0;
+}
+
+int aes_accel_setkey_dec(aes_accel_key_t *dk, const unsigned char *key) {
+  uint8_t ek[sizeof(dk->rk)];
+  if (aes_accel_type() == AES_ACCEL_TYPE_NONE) return -1;
+  aes_accel_expand(ek, key);
+  memcpy(dk->rk, ek + AES_ACCEL_ROUNDS * AES_ACCEL_BLOCK, AES_ACCEL_BLOCK);
+  for (int i = 1; i < AES_ACCEL_ROUNDS; i++) {
+    aes_accel_inv_mix(dk->rk + i * AES_ACCEL_BLOCK, ek + (AES_ACCEL_ROUNDS - i) * AES_ACCEL_BLOCK);
+  }
+  memcpy(dk->rk + AES_ACCEL_ROUNDS * AES_ACCEL_BLOCK, ek, AES_ACCEL_BLOCK);
+  memset(ek, 0, sizeof(ek));
+  return 0;
+}
+
+int aes_accel_cbc_encrypt(const aes_accel_key_t *ek, unsigned char iv[AES_ACCEL_BLOCK], const unsigned char *in,
+                          unsigned char *out, size_t len) {
+  if (len % AES_ACCEL_BLOCK) return -1;
+  switch (aes_accel_type()) {
+#if defined(__aarch64__)
+    case AES_ACCEL_TYPE_ARMV8:
+      aes_accel_armv8_cbc_encrypt(ek->rk, iv, in, out, len / AES_ACCEL_BLOCK);
+      return 0;
+#elif defined(__x86_64__) || defined(__i386__)
+    case AES_ACCEL_TYPE_AESNI:
+      aes_accel_aesni_cbc_encrypt(ek->rk, iv, in, out, len / AES_ACCEL_BLOCK);
+      return 0;
+#endif
+    default:
+      return -1;
+  }
+}
+
+int aes_accel_cbc_decrypt(const aes_accel_key_t *dk, unsigned char iv[AES_ACCEL_BLOCK], const unsigned char *in,
+                          unsigned char *out, size_t len) {
+  if (len % AES_ACCEL_BLOCK) return -1;
+  switch (aes_accel_type()) {
+#if defined(__aarch64__)
+    case AES_ACCEL_TYPE_ARMV8:
+      aes_accel_armv8_cbc_decrypt(dk->rk, iv, in, out, len / AES_ACCEL_BLOCK);
+      return 0;
+#elif defined(__x86_64__) || defined(__i386__)
+    case AES_ACCEL_TYPE_AESNI:
+      aes_accel_aesni_cbc_decrypt(dk->rk, iv, in, out, len / AES_ACCEL_BLOCK);
+      return 0;
+#endif
+    default:
+      return -1;
+  }
+}
+
+int aes_accel_ecb_encrypt(const aes_accel_key_t *ek, const unsigned char *in, unsigned char *out, size_t len) {
+  if (len % AES_ACCEL_BLOCK) return -1;
+  switch (aes_accel_type()) {
+#if defined(__aarch64__)
+    case AES_ACCEL_TYPE_ARMV8:
+      aes_accel_armv8_ecb_encrypt(ek->rk, in, out, len / AES_ACCEL_BLOCK);
+      return 0;
+#elif defined(__x86_64__) || defined(__i386__)
+    case AES_ACCEL_TYPE_AESNI:
+      aes_accel_aesni_ecb_encrypt(ek->rk, in, out, len / AES_ACCEL_BLOCK);
+      return 0;
+#endif
+    default:
+      return -1;
+  }
+}
+
+int aes_accel_ecb_decrypt(const aes_accel_key_t *dk, const unsigned char *in, unsigned char *out, size_t len) {
+  if (len % AES_ACCEL_BLOCK) return -1;
+  switch (aes_accel_type()) {
+#if defined(__aarch64__)
+    case AES_ACCEL_TYPE_ARMV8:
+      aes_accel_armv8_ecb_decrypt(dk->rk, in, out, len / AES_ACCEL_BLOCK);
+      return 0;
+#elif defined(__x86_64__) || defined(__i386__)
+    case AES_ACCEL_TYPE_AESNI:
+      aes_accel_aesni_ecb_decrypt(dk->rk, in, out, len / AES_ACCEL_BLOCK);
+      return 0;
+#endif
+    default:
+      return -1;
+  }
+}
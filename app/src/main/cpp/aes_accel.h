@@ -0,0 +1,50 @@
+#ifndef __AES_ACCEL_H__
+#define __AES_ACCEL_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// AES-128 硬件加速后端：第一次使用时检测 CPU 特性，ARMv8 Crypto Extensions
+// 或 AES-NI 可用就走对应实现。都不可用时下面的函数返回 -1，由调用方退回 mbedtls
+
+#define AES_ACCEL_ROUNDS (10)
+#define AES_ACCEL_BLOCK (16)
+
+typedef enum AES_ACCEL_TYPE {
+  AES_ACCEL_TYPE_NONE,
+  AES_ACCEL_TYPE_ARMV8,
+  AES_ACCEL_TYPE_AESNI,
+} AES_ACCEL_TYPE;
+
+// 轮密钥，解密用的按等价逆密码排列（首尾互换，中间做 InvMixColumns）
+typedef struct aes_accel_key_t {
+  uint8_t rk[(AES_ACCEL_ROUNDS + 1) * AES_ACCEL_BLOCK] __attribute__((aligned(16)));
+} aes_accel_key_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+AES_ACCEL_TYPE aes_accel_type(void);
+const char *aes_accel_name(void);
+
+// 展开 16 字节密钥，没有硬件加速时返回 -1
+int aes_accel_setkey_enc(aes_accel_key_t *ek, const unsigned char *key);
+int aes_accel_setkey_dec(aes_accel_key_t *dk, const unsigned char *key);
+
+// len 必须是 16 的倍数，in 和 out 可以相同，但不能部分重叠。
+// iv 更新为最后一个密文块，可以接着加解密下一段
+int aes_accel_cbc_encrypt(const aes_accel_key_t *ek, unsigned char iv[AES_ACCEL_BLOCK], const unsigned char *in,
+                          unsigned char *out, size_t len);
+int aes_accel_cbc_decrypt(const aes_accel_key_t *dk, unsigned char iv[AES_ACCEL_BLOCK], const unsigned char *in,
+                          unsigned char *out, size_t len);
+
+// 逐块独立加解密（ECB），给 CTR/GCM 这类自己做链接的模式用
+int aes_accel_ecb_encrypt(const aes_accel_key_t *ek, const unsigned char *in, unsigned char *out, size_t len);
+int aes_accel_ecb_decrypt(const aes_accel_key_t *dk, const unsigned char *in, unsigned char *out, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,118 @@
+// ARMv8 Crypto Extensions 实现，这个文件单独用 -march=armv8-a+crypto 编译，
+// 只有 aes_accel.c 检测到 HWCAP_AES 后才会调进来
+#if defined(__aarch64__)
+
+#include <arm_neon.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "aes_accel.h"
+
+#define ARMV8_LOAD_KEYS(k, rk)                                                               \
+  for (int i = 0; i <= AES_ACCEL_ROUNDS; i++) {                                              \
+    k[i] = vld1q_u8((rk) + i * AES_ACCEL_BLOCK);                                             \
+  }
+
+// aese 先异或轮密钥再做 SubBytes/ShiftRows，所以最后一轮密钥单独异或
+static inline uint8x16_t armv8_enc(uint8x16_t s, const uint8x16_t *k) {
+  for (int r = 0; r < AES_ACCEL_ROUNDS - 1; r++) s = vaesmcq_u8(vaeseq_u8(s, k[r]));
+  return veorq_u8(vaeseq_u8(s, k[AES_ACCEL_ROUNDS - 1]), k[AES_ACCEL_ROUNDS]);
+}
+
+static inline uint8x16_t armv8_dec(uint8x16_t s, const uint8x16_t *k) {
+  for (int r = 0; r < AES_ACCEL_ROUNDS - 1; r++) s = vaesimcq_u8(vaesdq_u8(s, k[r]));
+  return veorq_u8(vaesdq_u8(s, k[AES_ACCEL_ROUNDS - 1]), k[AES_ACCEL_ROUNDS]);
+}
+
+// 四块交错，aese/aesmc 成对发射，盖住指令延迟
+#define ARMV8_X4(op, mix, s0, s1, s2, s3, k)                                                 \
+  do {                                                                                       \
+    for (int r = 0; r < AES_ACCEL_ROUNDS - 1; r++) {                                         \
+      s0 = mix(op(s0, k[r]));                                                                \
+      s1 = mix(op(s1, k[r]));                                                                \
+      s2 = mix(op(s2, k[r]));                                                                \
+      s3 = mix(op(s3, k[r]));                                                                \
+    }                                                                                        \
+    s0 = veorq_u8(op(s0, k[AES_ACCEL_ROUNDS - 1]), k[AES_ACCEL_ROUNDS]);                     \
+    s1 = veorq_u8(op(s1, k[AES_ACCEL_ROUNDS - 1]), k[AES_ACCEL_ROUNDS]);                     \
+    s2 = veorq_u8(op(s2, k[AES_ACCEL_ROUNDS - 1]), k[AES_ACCEL_ROUNDS]);                     \
+    s3 = veorq_u8(op(s3, k[AES_ACCEL_ROUNDS - 1]), k[AES_ACCEL_ROUNDS]);                     \
+  } while (0)
+
+// CBC 加密每块都依赖上一块的密文，只能串行
+void aes_accel_armv8_cbc_encrypt(const uint8_t *rk, uint8_t *iv, const uint8_t *in, uint8_t *out, size_t blocks) {
+  uint8x16_t k[AES_ACCEL_ROUNDS + 1];
+  ARMV8_LOAD_KEYS(k, rk);
+  uint8x16_t s = vld1q_u8(iv);
+  for (; blocks > 0; blocks--, in += AES_ACCEL_BLOCK, out += AES_ACCEL_BLOCK) {
+    s = armv8_enc(veorq_u8(s, vld1q_u8(in)), k);
+    vst1q_u8(out, s);
+  }
+  vst1q_u8(iv, s);
+}
+
+// 解密各块互不依赖，先读进密文再写，所以 in == out 也可以
+void aes_accel_armv8_cbc_decrypt(const uint8_t *rk, uint8_t *iv, const uint8_t *in, uint8_t *out, size_t blocks) {
+  uint8x16_t k[AES_ACCEL_ROUNDS + 1];
+  ARMV8_LOAD_KEYS(k, rk);
+  uint8x16_t prev = vld1q_u8(iv);
+  for (; blocks >= 4; blocks -= 4, in += 4 * AES_ACCEL_BLOCK, out += 4 * AES_ACCEL_BLOCK) {
+    uint8x16_t c0 = vld1q_u8(in);
+    uint8x16_t c1 = vld1q_u8(in + AES_ACCEL_BLOCK);
+    uint8x16_t c2 = vld1q_u8(in + 2 * AES_ACCEL_BLOCK);
+    uint8x16_t c3 = vld1q_u8(in + 3 * AES_ACCEL_BLOCK);
+    uint8x16_t s0 = c0, s1 = c1, s2 = c2, s3 = c3;
+    ARMV8_X4(vaesdq_u8, vaesimcq_u8, s0, s1, s2, s3, k);
+    vst1q_u8(out, veorq_u8(s0, prev));
+    vst1q_u8(out + AES_ACCEL_BLOCK, veorq_u8(s1, c0));
+    vst1q_u8(out + 2 * AES_ACCEL_BLOCK, veorq_u8(s2, c1));
+    vst1q_u8(out + 3 * AES_ACCEL_BLOCK, veorq_u8(s3, c2));
+    prev = c3;
+  }
+  for (; blocks > 0; blocks--, in += AES_ACCEL_BLOCK, out += AES_ACCEL_BLOCK) {
+    uint8x16_t c = vld1q_u8(in);
+    vst1q_u8(out, veorq_u8(armv8_dec(c, k), prev));
+    prev = c;
+  }
+  vst1q_u8(iv, prev);
+}
+
+void aes_accel_armv8_ecb_encrypt(const uint8_t *rk, const uint8_t *in, uint8_t *out, size_t blocks) {
+  uint8x16_t k[AES_ACCEL_ROUNDS + 1];
+  ARMV8_LOAD_KEYS(k, rk);
+  for (; blocks >= 4; blocks -= 4, in += 4 * AES_ACCEL_BLOCK, out += 4 * AES_ACCEL_BLOCK) {
+    uint8x16_t s0 = vld1q_u8(in);
+    uint8x16_t s1 = vld1q_u8(in + AES_ACCEL_BLOCK);
+    uint8x16_t s2 = vld1q_u8(in + 2 * AES_ACCEL_BLOCK);
+    uint8x16_t s3 = vld1q_u8(in + 3 * AES_ACCEL_BLOCK);
+    ARMV8_X4(vaeseq_u8, vaesmcq_u8, s0, s1, s2, s3, k);
+    vst1q_u8(out, s0);
+    vst1q_u8(out + AES_ACCEL_BLOCK, s1);
+    vst1q_u8(out + 2 * AES_ACCEL_BLOCK, s2);
+    vst1q_u8(out + 3 * AES_ACCEL_BLOCK, s3);
+  }
+  for (; blocks > 0; blocks--, in += AES_ACCEL_BLOCK, out += AES_ACCEL_BLOCK) {
+    vst1q_u8(out, armv8_enc(vld1q_u8(in), k));
+  }
+}
+
+void aes_accel_armv8_ecb_decrypt(const uint8_t *rk, const uint8_t *in, uint8_t *out, size_t blocks) {
+  uint8x16_t k[AES_ACCEL_ROUNDS + 1];
+  ARMV8_LOAD_KEYS(k, rk);
+  for (; blocks >= 4; blocks -= 4, in += 4 * AES_ACCEL_BLOCK, out += 4 * AES_ACCEL_BLOCK) {
+    uint8x16_t s0 = vld1q_u8(in);
+    uint8x16_t s1 = vld1q_u8(in + AES_ACCEL_BLOCK);
+    uint8x16_t s2 = vld1q_u8(in + 2 * AES_ACCEL_BLOCK);
+    uint8x16_t s3 = vld1q_u8(in + 3 * AES_ACCEL_BLOCK);
+    ARMV8_X4(vaesdq_u8, vaesimcq_u8, s0, s1, s2, s3, k);
+    vst1q_u8(out, s0);
+    vst1q_u8(out + AES_ACCEL_BLOCK, s1);
+    vst1q_u8(out + 2 * AES_ACCEL_BLOCK, s2);
+    vst1q_u8(out + 3 * AES_ACCEL_BLOCK, s3);
+  }
+  for (; blocks > 0; blocks--, in += AES_ACCEL_BLOCK, out += AES_ACCEL_BLOCK) {
+    vst1q_u8(out, armv8_dec(vld1q_u8(in), k));
+  }
+}
+
+#endif
@@ -0,0 +1,124 @@
+// AES-NI 实现，这个文件单独用 -maes -msse2 编译，只有 aes_accel.c 检测到
+// AES-NI 后才会调进来
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <emmintrin.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <wmmintrin.h>
+
+#include "aes_accel.h"
+
+#define AESNI_LOAD_KEYS(k, rk)                                                               \
+  for (int i = 0; i <= AES_ACCEL_ROUNDS; i++) {                                              \
+    k[i] = _mm_load_si128((const __m128i *)((rk) + i * AES_ACCEL_BLOCK));                    \
+  }
+
+static inline __m128i aesni_enc(__m128i s, const __m128i *k) {
+  s = _mm_xor_si128(s, k[0]);
+  for (int r = 1; r < AES_ACCEL_ROUNDS; r++) s = _mm_aesenc_si128(s, k[r]);
+  return _mm_aesenclast_si128(s, k[AES_ACCEL_ROUNDS]);
+}
+
+static inline __m128i aesni_dec(__m128i s, const __m128i *k) {
+  s = _mm_xor_si128(s, k[0]);
+  for (int r = 1; r < AES_ACCEL_ROUNDS; r++) s = _mm_aesdec_si128(s, k[r]);
+  return _mm_aesdeclast_si128(s, k[AES_ACCEL_ROUNDS]);
+}
+
+// 四块交错，盖住 aesenc/aesdec 的指令延迟
+#define AESNI_X4(op, s0, s1, s2, s3, k)                                                      \
+  do {                                                                                       \
+    s0 = _mm_xor_si128(s0, k[0]);                                                            \
+    s1 = _mm_xor_si128(s1, k[0]);                                                            \
+    s2 = _mm_xor_si128(s2, k[0]);                                                            \
+    s3 = _mm_xor_si128(s3, k[0]);                                                            \
+    for (int r = 1; r < AES_ACCEL_ROUNDS; r++) {                                             \
+      s0 = _mm_##op##_si128(s0, k[r]);                                                       \
+      s1 = _mm_##op##_si128(s1, k[r]);                                                       \
+      s2 = _mm_##op##_si128(s2, k[r]);                                                       \
+      s3 = _mm_##op##_si128(s3, k[r]);                                                       \
+    }                                                                                        \
+    s0 = _mm_##op##last_si128(s0, k[AES_ACCEL_ROUNDS]);                                      \
+    s1 = _mm_##op##last_si128(s1, k[AES_ACCEL_ROUNDS]);                                      \
+    s2 = _mm_##op##last_si128(s2, k[AES_ACCEL_ROUNDS]);                                      \
+    s3 = _mm_##op##last_si128(s3, k[AES_ACCEL_ROUNDS]);                                      \
+  } while (0)
+
+// CBC 加密每块都依赖上一块的密文，只能串行
+void aes_accel_aesni_cbc_encrypt(const uint8_t *rk, uint8_t *iv, const uint8_t *in, uint8_t *out, size_t blocks) {
+  __m128i k[AES_ACCEL_ROUNDS + 1];
+  AESNI_LOAD_KEYS(k, rk);
+  __m128i s = _mm_loadu_si128((const __m128i *)iv);
+  for (; blocks > 0; blocks--, in += AES_ACCEL_BLOCK, out += AES_ACCEL_BLOCK) {
+    s = aesni_enc(_mm_xor_si128(s, _mm_loadu_si128((const __m128i *)in)), k);
+    _mm_storeu_si128((__m128i *)out, s);
+  }
+  _mm_storeu_si128((__m128i *)iv, s);
+}
+
+// 解密各块互不依赖，先读进密文再写，所以 in == out 也可以
+void aes_accel_aesni_cbc_decrypt(const uint8_t *rk, uint8_t *iv, const uint8_t *in, uint8_t *out, size_t blocks) {
+  __m128i k[AES_ACCEL_ROUNDS + 1];
+  AESNI_LOAD_KEYS(k, rk);
+  __m128i prev = _mm_loadu_si128((const __m128i *)iv);
+  for (; blocks >= 4; blocks -= 4, in += 4 * AES_ACCEL_BLOCK, out += 4 * AES_ACCEL_BLOCK) {
+    __m128i c0 = _mm_loadu_si128((const __m128i *)in);
+    __m128i c1 = _mm_loadu_si128((const __m128i *)(in + AES_ACCEL_BLOCK));
+    __m128i c2 = _mm_loadu_si128((const __m128i *)(in + 2 * AES_ACCEL_BLOCK));
+    __m128i c3 = _mm_loadu_si128((const __m128i *)(in + 3 * AES_ACCEL_BLOCK));
+    __m128i s0 = c0, s1 = c1, s2 = c2, s3 = c3;
+    AESNI_X4(aesdec, s0, s1, s2, s3, k);
+    _mm_storeu_si128((__m128i *)out, _mm_xor_si128(s0, prev));
+    _mm_storeu_si128((__m128i *)(out + AES_ACCEL_BLOCK), _mm_xor_si128(s1, c0));
+    _mm_storeu_si128((__m128i *)(out + 2 * AES_ACCEL_BLOCK), _mm_xor_si128(s2, c1));
+    _mm_storeu_si128((__m128i *)(out + 3 * AES_ACCEL_BLOCK), _mm_xor_si128(s3, c2));
+    prev = c3;
+  }
+  for (; blocks > 0; blocks--, in += AES_ACCEL_BLOCK, out += AES_ACCEL_BLOCK) {
+    __m128i c = _mm_loadu_si128((const __m128i *)in);
+    _mm_storeu_si128((__m128i *)out, _mm_xor_si128(aesni_dec(c, k), prev));
+    prev = c;
+  }
+  _mm_storeu_si128((__m128i *)iv, prev);
+}
+
+void aes_accel_aesni_ecb_encrypt(const uint8_t *rk, const uint8_t *in, uint8_t *out, size_t blocks) {
+  __m128i k[AES_ACCEL_ROUNDS + 1];
+  AESNI_LOAD_KEYS(k, rk);
+  for (; blocks >= 4; blocks -= 4, in += 4 * AES_ACCEL_BLOCK, out += 4 * AES_ACCEL_BLOCK) {
+    __m128i s0 = _mm_loadu_si128((const __m128i *)in);
+    __m128i s1 = _mm_loadu_si128((const __m128i *)(in + AES_ACCEL_BLOCK));
+    __m128i s2 = _mm_loadu_si128((const __m128i *)(in + 2 * AES_ACCEL_BLOCK));
+    __m128i s3 = _mm_loadu_si128((const __m128i *)(in + 3 * AES_ACCEL_BLOCK));
+    AESNI_X4(aesenc, s0, s1, s2, s3, k);
+    _mm_storeu_si128((__m128i *)out, s0);
+    _mm_storeu_si128((__m128i *)(out + AES_ACCEL_BLOCK), s1);
+    _mm_storeu_si128((__m128i *)(out + 2 * AES_ACCEL_BLOCK), s2);
+    _mm_storeu_si128((__m128i *)(out + 3 * AES_ACCEL_BLOCK), s3);
+  }
+  for (; blocks > 0; blocks--, in += AES_ACCEL_BLOCK, out += AES_ACCEL_BLOCK) {
+    _mm_storeu_si128((__m128i *)out, aesni_enc(_mm_loadu_si128((const __m128i *)in), k));
+  }
+}
+
+void aes_accel_aesni_ecb_decrypt(const uint8_t *rk, const uint8_t *in, uint8_t *out, size_t blocks) {
+  __m128i k[AES_ACCEL_ROUNDS + 1];
+  AESNI_LOAD_KEYS(k, rk);
+  for (; blocks >= 4; blocks -= 4, in += 4 * AES_ACCEL_BLOCK, out += 4 * AES_ACCEL_BLOCK) {
+    __m128i s0 = _mm_loadu_si128((const __m128i *)in);
+    __m128i s1 = _mm_loadu_si128((const __m128i *)(in + AES_ACCEL_BLOCK));
+    __m128i s2 = _mm_loadu_si128((const __m128i *)(in + 2 * AES_ACCEL_BLOCK));
+    __m128i s3 = _mm_loadu_si128((const __m128i *)(in + 3 * AES_ACCEL_BLOCK));
+    AESNI_X4(aesdec, s0, s1, s2, s3, k);
+    _mm_storeu_si128((__m128i *)out, s0);
+    _mm_storeu_si128((__m128i *)(out + AES_ACCEL_BLOCK), s1);
+    _mm_storeu_si128((__m128i *)(out + 2 * AES_ACCEL_BLOCK), s2);
+    _mm_storeu_si128((__m128i *)(out + 3 * AES_ACCEL_BLOCK), s3);
+  }
+  for (; blocks > 0; blocks--, in += AES_ACCEL_BLOCK, out += AES_ACCEL_BLOCK) {
+    _mm_storeu_si128((__m128i *)out, aesni_dec(_mm_loadu_si128((const __m128i *)in), k));
+  }
+}
+
+#endif
@@ -0,0 +1,114 @@
+#include "aes_pool.h"
+
+#include <pthread.h>
+#include <stddef.h>
+#include <unistd.h>
+
+// 一次 aes_pool_run 的任务，放在调用者的栈上，领完之前挂在队列里
+typedef struct aes_pool_task_t {
+  aes_pool_fn fn;
+  void *arg;
+  int n;
+  int next;       // 下一个没人领的 idx
+  int remaining;  // 还没跑完的个数
+  struct aes_pool_task_t *link;
+} aes_pool_task_t;
+
+static pthread_once_t g_pool_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t g_pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_pool_work = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t g_pool_done = PTHREAD_COND_INITIALIZER;
+static aes_pool_task_t *g_pool_head = NULL;
+static aes_pool_task_t *g_pool_tail = NULL;
+static int g_pool_workers = 0;
+
+// 从队头的任务领一个 idx，领完最后一个就出队。要持有 g_pool_mutex
+static aes_pool_task_t *aes_pool_claim(int *idx) {
+  aes_pool_task_t *task = g_pool_head;
+  if (task == NULL) return NULL;
+  *idx = task->next++;
+  if (task->next == task->n) {
+    g_pool_head = task->link;
+    if (g_pool_head == NULL) g_pool_tail = NULL;
+  }
+  return task;
+}
+
+// 跑完一个 idx，记账。进出都持有 g_pool_mutex
+static void aes_pool_exec(aes_pool_task_t *task, int idx) {
+  pthread_mutex_unlock(&g_pool_mutex);
+  task->fn(task->arg, idx);
+  pthread_mutex_lock(&g_pool_mutex);
+  if (--task->remaining == 0) pthread_cond_broadcast(&g_pool_done);
+}
+
+static void *aes_pool_worker(void *unused) {
+  (void)unused;
+  pthread_mutex_lock(&g_pool_mutex);
+  for (;;) {
+    aes_pool_task_t *task;
+    int idx;
+    while ((task = aes_pool_claim(&idx)) == NULL) pthread_cond_wait(&g_pool_work, &g_pool_mutex);
+    aes_pool_exec(task, idx);
+  }
+  return NULL;
+}
+
+static void aes_pool_start(void) {
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  int want = cpus > 1 ? (int)cpus - 1 : 0;
+  if (want > AES_POOL_MAX_WORKERS) want = AES_POOL_MAX_WORKERS;
+
+  for (int i = 0; i < want; i++) {
+    pthread_t tid;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    int ret = pthread_create(&tid, &attr, aes_pool_worker, NULL);
+    pthread_attr_destroy(&attr);
+    if (ret != 0) break;
+    g_pool_workers++;
+  }
+}
+
+int aes_pool_threads(void) {
+  pthread_once(&g_pool_once, aes_pool_start);
+  return g_pool_workers + 1;
+}
+
+void aes_pool_run(aes_pool_fn fn, void *arg, int n) {
+  aes_pool_task_t task = {fn, arg, n, 0, n, NULL};
+
+  if (n <= 0) return;
+  if (n == 1 || aes_pool_threads() == 1) {
+    for (int i = 0; i < n; i++) fn(arg, i);
+    return;
+  }
+
+  pthread_mutex_lock(&g_pool_mutex);
+  if (g_pool_tail) {
+    g_pool_tail->link = &task;
+  } else {
+    g_pool_head = &task;
+  }
+  g_pool_tail = &task;
+  pthread_cond_broadcast(&g_pool_work);
+
+  // 自己也领，只领自己这个任务的
+  while (task.next < task.n) {
+    int idx = task.next++;
+    if (task.next == task.n) {
+      // 已经领完，从队列里摘掉（不一定在队头）
+      aes_pool_task_t **pp = &g_pool_head, *prev = NULL;
+      while (*pp != &task) {
+        prev = *pp;
+        pp = &(*pp)->link;
+      }
+      *pp = task.link;
+      if (g_pool_tail == &task) g_pool_tail = prev;
+    }
+    aes_pool_exec(&task, idx);
+  }
+  while (task.remaining > 0) pthread_cond_wait(&g_pool_done, &g_pool_mutex);
+  pthread_mutex_unlock(&g_pool_mutex);
+}
@@ -0,0 +1,27 @@
+#ifndef __AES_POOL_H__
+#define __AES_POOL_H__
+
+// 给大块加解密用的小线程池：第一次使用时按 CPU 核数起 0~AES_POOL_MAX_WORKERS 个
+// 常驻线程，之后一直复用。单核或者起线程失败时所有任务都在调用线程上跑
+
+#define AES_POOL_MAX_WORKERS (3)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef void (*aes_pool_fn)(void *arg, int idx);
+
+// 能同时干活的线程数，含调用线程，至少是 1
+int aes_pool_threads(void);
+
+// 对 idx = 0..n-1 各调一次 fn(arg, idx)，全部跑完才返回。
+// 调用线程自己也领任务，工作线程被别的调用占着时也不会干等。
+// 可以被多个线程同时调用，fn 里不能再调 aes_pool_run
+void aes_pool_run(aes_pool_fn fn, void *arg, int n);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -30,10 +30,16 @@ const IUINT32 IKCP_CMD_PUSH = 81;  // cmd: push data
 const IUINT32 IKCP_CMD_ACK = 82;   // cmd: ack
 const IUINT32 IKCP_CMD_WASK = 83;  // cmd: window probe (ask)
 const IUINT32 IKCP_CMD_WINS = 84;  // cmd: window size (tell)
+const IUINT32 IKCP_CMD_PUSHX = 85; // cmd: push data, frg / stream continue in the upper half of len
+const IUINT32 IKCP_CMD_SKIP = 86;  // cmd: fragment of a dropped message, skip it
+const IUINT32 IKCP_CMD_MTUP = 87;  // cmd: path mtu probe, sn is its size, padded by len
+const IUINT32 IKCP_CMD_MTUA = 88;  // cmd: path mtu probe of size sn arrived
+const IUINT32 IKCP_CMD_RACK = 89;  // cmd: ack runs of sn in the payload, ts of sn
 const IUINT32 IKCP_ASK_SEND = 1;   // need to send IKCP_CMD_WASK
 const IUINT32 IKCP_ASK_TELL = 2;   // need to send IKCP_CMD_WINS
 const IUINT32 IKCP_WND_SND = 32;
 const IUINT32 IKCP_WND_RCV = 128;  // must >= max fragment size
+const IUINT32 IKCP_FRG_MAX = 0xfffff;   // fragments of a message in large-message mode
 const IUINT32 IKCP_MTU_DEF = 1400;
 const IUINT32 IKCP_ACK_FAST = 3;
 const IUINT32 IKCP_INTERVAL = 100;
@@ -44,6 +50,10 @@ const IUINT32 IKCP_THRESH_MIN = 2;
 const IUINT32 IKCP_PROBE_INIT = 7000;     // 7 secs to probe window size
 const IUINT32 IKCP_PROBE_LIMIT = 120000;  // up to 120 secs to probe window
 const IUINT32 IKCP_FASTACK_LIMIT = 5;     // max times to trigger fastack
+const IUINT32 IKCP_MTUD_STEP = 16;        // the search settles once lo and hi are this close
+const IUINT32 IKCP_MTUD_TRIES = 3;        // unanswered probes that rule a size out
+const IUINT32 IKCP_MTUD_RAISE = 600000;   // 10 mins until a larger mtu is searched for again
+const IUINT32 IKCP_RACK_RUN = 6;          // bytes of a run: first sn 32 bits, count 16 bits
 
 //---------------------------------------------------------------------
 // encode / decode
@@ -152,11 +162,129 @@ void ikcp_allocator(void *(*new_malloc)(size_t), void (*new_free)(void *)) {
   ikcp_free_hook = new_free;
 }
 
+//---------------------------------------------------------------------
+// segment pool
+//---------------------------------------------------------------------
+const IUINT32 IKCP_POOL_SMALL_SIZE = 256;  // payload limit of the small class
+const IUINT32 IKCP_POOL_SLAB_BLOCKS = 32;
+const IUINT32 IKCP_POOL_MAX_SLABS = 8;
+
+static void ikcp_pool_class_init(struct IKCPPOOLCLASS *cls, IUINT32 capacity) {
+  cls->capacity = capacity;
+  cls->blksize = (IUINT32)((sizeof(IKCPSEG) + capacity + sizeof(void *) - 1) & ~(sizeof(void *) - 1));
+  cls->nslab = 0;
+  cls->inuse = 0;
+  cls->free_list = NULL;
+  cls->slabs = NULL;
+}
+
+static void ikcp_pool_class_free(struct IKCPPOOLCLASS *cls) {
+  void *slab = cls->slabs;
+  while (slab) {
+    void *next = *(void **)slab;
+    ikcp_free(slab);
+    slab = next;
+  }
+  ikcp_pool_class_init(cls, 0);
+}
+
+// point the full slot at pool->mss. slabs can not be resized in place:
+// when the current slot has some, the other slot takes over and the old
+// one drains, its slabs go once the last segment carved from it is back.
+// while the other slot is still draining nothing changes, and bigger
+// segments fall back to the heap until it is free.
+static void ikcp_pool_resize(struct IKCPPOOL *pool) {
+  struct IKCPPOOLCLASS *cls = &pool->cls[pool->full];
+  IUINT32 other = (pool->full == IKCP_POOL_FULL) ? IKCP_POOL_FULL + 1 : IKCP_POOL_FULL;
+  if (cls->capacity == pool->mss) return;
+  if (cls->nslab == 0) {
+    ikcp_pool_class_init(cls, pool->mss);
+    return;
+  }
+  if (pool->cls[other].nslab != 0) return;
+  ikcp_pool_class_init(&pool->cls[other], pool->mss);
+  pool->full = other;
+  if (cls->inuse == 0) ikcp_pool_class_free(cls);
+}
+
+// carve a new slab into free blocks, the first word of a slab links it
+// into cls->slabs so it can be released with the kcp.
+static int ikcp_pool_grow(struct IKCPPOOL *pool, struct IKCPPOOLCLASS *cls) {
+  char *slab, *block;
+  IUINT32 i;
+  if (cls->nslab >= pool->max_slabs) return -1;
+  slab = (char *)ikcp_malloc(sizeof(void *) + (size_t)cls->blksize * pool->slab_blocks);
+  if (slab == NULL) return -2;
+  *(void **)slab = cls->slabs;
+  cls->slabs = slab;
+  cls->nslab++;
+  block = slab + sizeof(void *);
+  for (i = 0; i < pool->slab_blocks; i++, block += cls->blksize) {
+    *(void **)block = cls->free_list;
+    cls->free_list = block;
+  }
+  return 0;
+}
+
+static IKCPSEG *ikcp_pool_alloc(struct IKCPPOOL *pool, int size) {
+  IUINT32 index;
+  struct IKCPPOOLCLASS *cls;
+  void *block;
+  if ((IUINT32)size <= pool->cls[IKCP_POOL_SMALL].capacity) {
+    index = IKCP_POOL_SMALL;
+  } else if ((IUINT32)size <= pool->cls[pool->full].capacity) {
+    index = pool->full;
+  } else {
+    return NULL;
+  }
+  cls = &pool->cls[index];
+  if (cls->free_list == NULL && ikcp_pool_grow(pool, cls) != 0) return NULL;
+  block = cls->free_list;
+  cls->free_list = *(void **)block;
+  cls->inuse++;
+  ((IKCPSEG *)block)->pool = index;
+  return (IKCPSEG *)block;
+}
+
+static void ikcp_pool_release(struct IKCPPOOL *pool) {
+  int i;
+  for (i = 0; i < IKCP_POOL_CLASS; i++) ikcp_pool_class_free(&pool->cls[i]);
+  ikcp_free(pool);
+}
+
 // allocate a new kcp segment
-static IKCPSEG *ikcp_segment_new(ikcpcb *kcp, int size) { return (IKCPSEG *)ikcp_malloc(sizeof(IKCPSEG) + size); }
+static IKCPSEG *ikcp_segment_new(ikcpcb *kcp, int size) {
+  IKCPSEG *seg;
+  if (kcp->pool) {
+    seg = ikcp_pool_alloc(kcp->pool, size);
+    if (seg) {
+      kcp->pool->hits++;
+      return seg;
+    }
+    kcp->pool->misses++;
+  }
+  seg = (IKCPSEG *)ikcp_malloc(sizeof(IKCPSEG) + size);
+  if (seg) seg->pool = IKCP_POOL_NONE;
+  return seg;
+}
 
 // delete a segment
-static void ikcp_segment_delete(ikcpcb *kcp, IKCPSEG *seg) { ikcp_free(seg); }
+static void ikcp_segment_delete(ikcpcb *kcp, IKCPSEG *seg) {
+  if (seg->pool < IKCP_POOL_CLASS && kcp->pool) {
+    struct IKCPPOOL *pool = kcp->pool;
+    struct IKCPPOOLCLASS *cls = &pool->cls[seg->pool];
+    *(void **)seg = cls->free_list;
+    cls->free_list = seg;
+    cls->inuse--;
+    // last segment of a draining full slot
+    if (cls->inuse == 0 && seg->pool != IKCP_POOL_SMALL && seg->pool != pool->full) {
+      ikcp_pool_class_free(cls);
+      ikcp_pool_resize(pool);
+    }
+    return;
+  }
+  ikcp_free(seg);
+}
 
 // write log
 void ikcp_log(ikcpcb *kcp, int mask, const char *fmt, ...) {
@@ -186,6 +314,192 @@ static int ikcp_output(ikcpcb *kcp, const void *data, int size) {
   return kcp->output((const char *)data, size, kcp, kcp->user);
 }
 
+// submit collected datagrams through output_batch
+static void ikcp_output_batch(ikcpcb *kcp) {
+  if (kcp->batch_count == 0) return;
+  if (ikcp_canlog(kcp, IKCP_LOG_OUTPUT)) {
+    ikcp_log(kcp, IKCP_LOG_OUTPUT, "[RO] batch of %lu datagrams", (unsigned long)kcp->batch_count);
+  }
+  kcp->output_batch(kcp->batch_iov, (int)kcp->batch_count, kcp, kcp->user);
+  kcp->batch_count = 0;
+}
+
+//---------------------------------------------------------------------
+// pacer
+//---------------------------------------------------------------------
+static struct IKCPPACER *ikcp_pace_new(IUINT32 mtu, IUINT32 rate, IUINT32 slots) {
+  size_t lens = sizeof(IUINT32) * slots;
+  struct IKCPPACER *pc = (struct IKCPPACER *)ikcp_malloc(sizeof(struct IKCPPACER) + lens +
+                                                         (size_t)(mtu + IKCP_OVERHEAD) * slots);
+  if (pc == NULL) return NULL;
+  pc->rate = rate;
+  pc->rate_used = 0;
+  pc->slots = slots;
+  pc->head = 0;
+  pc->count = 0;
+  pc->queued = 0;
+  pc->ts = 0;
+  pc->tokens = 0;
+  pc->backlog = 0;
+  pc->len = (IUINT32 *)(pc + 1);
+  pc->buffer = (char *)pc->len + lens;
+  return pc;
+}
+
+// configured rate, else the congestion control pacing rate, else 5/4
+// of the window per srtt
+static IUINT32 ikcp_pace_rate(const ikcpcb *kcp) {
+  IUINT32 rate, cwnd;
+  IUINT64 window_rate;
+  if (kcp->pacer->rate > 0) return kcp->pacer->rate;
+  rate = kcp->cc->pacing_rate(kcp);
+  if (rate > 0 || kcp->rx_srtt <= 0) return rate;
+  cwnd = _imin_(kcp->snd_wnd, kcp->rmt_wnd);
+  cwnd = _imin_(kcp->cc->cwnd(kcp), cwnd);
+  window_rate = (IUINT64)cwnd * kcp->mtu * 1250 / (IUINT32)kcp->rx_srtt;
+  return (window_rate < 0x7fffffff) ? (IUINT32)window_rate : 0x7fffffff;
+}
+
+// data segments carry the time they leave, not the time ikcp_flush
+// queued them, so rtt samples do not grow with the pacing queue. every
+// command is stepped over by its len: RACK runs and MTUP padding are
+// payload too, and their ts is not a send time
+static void ikcp_pace_stamp(char *data, int size, IUINT32 current) {
+  int off = 0;
+  while (off + (int)IKCP_OVERHEAD <= size) {
+    IUINT8 cmd = (IUINT8)data[off + 4];
+    IUINT32 len;
+    ikcp_decode32u(data + off + 20, &len);
+    if (cmd == IKCP_CMD_PUSHX || cmd == IKCP_CMD_SKIP) len &= 0xffff;
+    if (cmd == IKCP_CMD_PUSH || cmd == IKCP_CMD_PUSHX || cmd == IKCP_CMD_SKIP) {
+      ikcp_encode32u(data + off + 8, current);
+    }
+    if (len > (IUINT32)(size - off - (int)IKCP_OVERHEAD)) break;
+    off += (int)IKCP_OVERHEAD + (int)len;
+  }
+}
+
+// hand the 'n' oldest queued datagrams to the output callback
+static void ikcp_pace_emit(ikcpcb *kcp, IUINT32 n) {
+  struct IKCPPACER *pc = kcp->pacer;
+  size_t stride = kcp->mtu + IKCP_OVERHEAD;
+  for (; n > 0; n--) {
+    char *data = pc->buffer + stride * pc->head;
+    int size = (int)pc->len[pc->head];
+    pc->tokens -= size;
+    pc->queued -= (IUINT32)size;
+    pc->head = (pc->head + 1) % pc->slots;
+    pc->count--;
+    ikcp_pace_stamp(data, size, kcp->current);
+    if (kcp->output_batch == NULL) {
+      ikcp_output(kcp, data, size);
+      continue;
+    }
+    kcp->batch_iov[kcp->batch_count].iov_base = data;
+    kcp->batch_iov[kcp->batch_count].iov_len = size;
+    kcp->batch_count++;
+    if (kcp->batch_count >= kcp->batch_max) {
+      ikcp_output_batch(kcp);
+    }
+  }
+  if (kcp->output_batch) {
+    ikcp_output_batch(kcp);
+  }
+}
+
+// refill the bucket and release the queued datagrams it covers, the
+// last one may take it below zero. a backlog drains at exactly 'rate'
+// however far apart the calls are, but time spent idle only buys a
+// burst of two datagrams
+static void ikcp_pace_release(ikcpcb *kcp) {
+  struct IKCPPACER *pc = kcp->pacer;
+  IUINT32 rate = ikcp_pace_rate(kcp);
+  IINT32 elapsed = _itimediff(kcp->current, pc->ts);
+  IINT32 depth = (IINT32)kcp->mtu * 2, budget;
+  IUINT32 n = 0;
+
+  pc->rate_used = rate;
+  if (rate == 0) {
+    pc->ts = kcp->current;
+    pc->backlog = 0;
+    ikcp_pace_emit(kcp, pc->count);
+    return;
+  }
+  if (elapsed < 0) {
+    pc->ts = kcp->current;
+  } else {
+    IINT64 tokens = pc->tokens + (IINT64)((IUINT64)rate * (IUINT32)elapsed / 1000);
+    // keep the clock where it is until a whole byte accrues
+    if (tokens != pc->tokens) pc->ts = kcp->current;
+    if (!pc->backlog && tokens > depth) tokens = depth;
+    pc->tokens = (tokens > 0x3fffffff) ? 0x3fffffff : (IINT32)tokens;
+  }
+
+  for (budget = pc->tokens; n < pc->count && budget > 0; n++) {
+    budget -= (IINT32)pc->len[(pc->head + n) % pc->slots];
+  }
+  if (n > 0) ikcp_pace_emit(kcp, n);
+  pc->backlog = (pc->count > 0);
+  if (!pc->backlog && pc->tokens > depth) pc->tokens = depth;
+}
+
+// millisec until ikcp_pace_release has a datagram to let go
+static IINT32 ikcp_pace_wait(const ikcpcb *kcp, IUINT32 current) {
+  const struct IKCPPACER *pc = kcp->pacer;
+  IINT32 elapsed = _itimediff(current, pc->ts);
+  IINT64 tokens;
+  if (pc->rate_used == 0 || elapsed < 0) return 0;
+  tokens = pc->tokens + (IINT64)pc->rate_used * elapsed / 1000;
+  if (tokens > 0) return 0;
+  return (IINT32)((-tokens * 1000) / pc->rate_used) + 1;
+}
+
+// millisec a datagram queued now waits for the token bucket
+static IUINT32 ikcp_pace_delay(const ikcpcb *kcp) {
+  const struct IKCPPACER *pc = kcp->pacer;
+  IINT64 ahead = (IINT64)pc->queued - pc->tokens;
+  if (pc->rate_used == 0 || ahead <= 0) return 0;
+  return (IUINT32)(ahead * 1000 / pc->rate_used);
+}
+
+// first buffer ikcp_flush assembles a datagram into
+static char *ikcp_flush_buffer(ikcpcb *kcp) {
+  if (kcp->pacer) {
+    struct IKCPPACER *pc = kcp->pacer;
+    return pc->buffer + (size_t)(kcp->mtu + IKCP_OVERHEAD) * ((pc->head + pc->count) % pc->slots);
+  }
+  if (kcp->output_batch == NULL) return kcp->buffer;
+  return kcp->batch_buffer + (size_t)kcp->batch_count * (kcp->mtu + IKCP_OVERHEAD);
+}
+
+// emit the datagram assembled in 'buffer' and return the buffer the next
+// one should be assembled in: the same one for plain output, the next
+// batch slot in batched mode, the next queue slot when pacing.
+static char *ikcp_flush_output(ikcpcb *kcp, char *buffer, int size) {
+  if (size <= 0) return buffer;
+  kcp->tx_bytes_total += size;
+  if (kcp->pacer) {
+    struct IKCPPACER *pc = kcp->pacer;
+    pc->len[(pc->head + pc->count) % pc->slots] = (IUINT32)size;
+    pc->count++;
+    pc->queued += (IUINT32)size;
+    // the queue is full: its oldest datagram goes now
+    if (pc->count >= pc->slots) ikcp_pace_emit(kcp, 1);
+    return ikcp_flush_buffer(kcp);
+  }
+  if (kcp->output_batch == NULL) {
+    ikcp_output(kcp, buffer, size);
+    return buffer;
+  }
+  kcp->batch_iov[kcp->batch_count].iov_base = buffer;
+  kcp->batch_iov[kcp->batch_count].iov_len = size;
+  kcp->batch_count++;
+  if (kcp->batch_count >= kcp->batch_max) {
+    ikcp_output_batch(kcp);
+  }
+  return ikcp_flush_buffer(kcp);
+}
+
 // output queue
 void ikcp_qprint(const char *name, const struct IQUEUEHEAD *head) {
 #if 0
@@ -200,6 +514,156 @@ void ikcp_qprint(const char *name, const struct IQUEUEHEAD *head) {
 #endif
 }
 
+//---------------------------------------------------------------------
+// sequence index
+//---------------------------------------------------------------------
+static void ikcp_ring_free(ikcpcb *kcp) {
+  if (kcp->snd_ring) ikcp_free(kcp->snd_ring);
+  if (kcp->rcv_ring) ikcp_free(kcp->rcv_ring);
+  if (kcp->fack_ring) ikcp_free(kcp->fack_ring);
+  kcp->snd_ring = NULL;
+  kcp->rcv_ring = NULL;
+  kcp->fack_ring = NULL;
+  kcp->ring_size = 0;
+  kcp->fack_marks = 0;
+}
+
+// apply the fastack marks left by ikcp_parse_fastack. a mark at sn M
+// means every segment below M has been skipped once more, so walking the
+// window downwards with a running sum gives each segment its share.
+static void ikcp_fack_apply(ikcpcb *kcp) {
+  IUINT32 mask = kcp->ring_size - 1;
+  IUINT32 sum = 0;
+  IUINT32 sn;
+  if (kcp->fack_marks == 0) return;
+  for (sn = kcp->snd_nxt; sn != kcp->snd_una;) {
+    IUINT32 pos = (--sn) & mask;
+    IKCPSEG *seg = kcp->snd_ring[pos];
+    if (seg) seg->fastack += sum;
+    sum += kcp->fack_ring[pos];
+    kcp->fack_ring[pos] = 0;
+  }
+  kcp->fack_marks = 0;
+}
+
+// smallest power of 2 that holds both windows and whatever is buffered
+static IUINT32 ikcp_ring_need(const ikcpcb *kcp) {
+  IUINT32 need = _imax_(_imax_(kcp->snd_wnd, kcp->rcv_wnd), kcp->snd_nxt - kcp->snd_una);
+  IUINT32 size = 1;
+  const struct IQUEUEHEAD *p;
+  for (p = kcp->rcv_buf.next; p != &kcp->rcv_buf; p = p->next) {
+    const IKCPSEG *seg = iqueue_entry(p, const IKCPSEG, node);
+    need = _imax_(need, seg->sn - kcp->rcv_nxt + 1);
+  }
+  while (size < need) size <<= 1;
+  return size;
+}
+
+static int ikcp_ring_build(ikcpcb *kcp, IUINT32 size) {
+  IKCPSEG **snd_ring = (IKCPSEG **)ikcp_malloc(sizeof(IKCPSEG *) * size);
+  IKCPSEG **rcv_ring = (IKCPSEG **)ikcp_malloc(sizeof(IKCPSEG *) * size);
+  IUINT32 *fack_ring = (IUINT32 *)ikcp_malloc(sizeof(IUINT32) * size);
+  struct IQUEUEHEAD *p;
+
+  if (snd_ring == NULL || rcv_ring == NULL || fack_ring == NULL) {
+    if (snd_ring) ikcp_free(snd_ring);
+    if (rcv_ring) ikcp_free(rcv_ring);
+    if (fack_ring) ikcp_free(fack_ring);
+    return -2;
+  }
+  memset(snd_ring, 0, sizeof(IKCPSEG *) * size);
+  memset(rcv_ring, 0, sizeof(IKCPSEG *) * size);
+  memset(fack_ring, 0, sizeof(IUINT32) * size);
+
+  if (kcp->ring_size) ikcp_fack_apply(kcp);
+  for (p = kcp->snd_buf.next; p != &kcp->snd_buf; p = p->next) {
+    IKCPSEG *seg = iqueue_entry(p, IKCPSEG, node);
+    snd_ring[seg->sn & (size - 1)] = seg;
+  }
+  for (p = kcp->rcv_buf.next; p != &kcp->rcv_buf; p = p->next) {
+    IKCPSEG *seg = iqueue_entry(p, IKCPSEG, node);
+    rcv_ring[seg->sn & (size - 1)] = seg;
+  }
+
+  ikcp_ring_free(kcp);
+  kcp->snd_ring = snd_ring;
+  kcp->rcv_ring = rcv_ring;
+  kcp->fack_ring = fack_ring;
+  kcp->ring_size = size;
+  return 0;
+}
+
+//---------------------------------------------------------------------
+// congestion control
+//---------------------------------------------------------------------
+
+// classic cwnd/ssthresh: slow start, then additive increase per ack
+static void ikcp_reno_on_ack(ikcpcb *kcp, const struct IKCPCCSAMPLE *rs) {
+  if (!rs->una_moved) return;
+  if (kcp->cwnd < kcp->rmt_wnd) {
+    IUINT32 mss = kcp->mss;
+    if (kcp->cwnd < kcp->ssthresh) {
+      kcp->cwnd++;
+      kcp->incr += mss;
+    } else {
+      if (kcp->incr < mss) kcp->incr = mss;
+      kcp->incr += (mss * mss) / kcp->incr + (mss / 16);
+      if ((kcp->cwnd + 1) * mss <= kcp->incr) {
+#if 1
+        kcp->cwnd = (kcp->incr + mss - 1) / ((mss > 0) ? mss : 1);
+#else
+        kcp->cwnd++;
+#endif
+      }
+    }
+    if (kcp->cwnd > kcp->rmt_wnd) {
+      kcp->cwnd = kcp->rmt_wnd;
+      kcp->incr = kcp->rmt_wnd * mss;
+    }
+  }
+}
+
+static void ikcp_reno_on_loss(ikcpcb *kcp, int event, IUINT32 inflight) {
+  if (event == IKCP_CC_LOSS_FAST) {
+    kcp->ssthresh = inflight / 2;
+    if (kcp->ssthresh < IKCP_THRESH_MIN) kcp->ssthresh = IKCP_THRESH_MIN;
+    kcp->cwnd = kcp->ssthresh + (IUINT32)kcp->fastresend;
+    kcp->incr = kcp->cwnd * kcp->mss;
+  } else {
+    IUINT32 cwnd = _imin_(kcp->cwnd, _imin_(kcp->snd_wnd, kcp->rmt_wnd));
+    kcp->ssthresh = cwnd / 2;
+    if (kcp->ssthresh < IKCP_THRESH_MIN) kcp->ssthresh = IKCP_THRESH_MIN;
+    kcp->cwnd = 1;
+    kcp->incr = kcp->mss;
+  }
+}
+
+static IUINT32 ikcp_reno_cwnd(const ikcpcb *kcp) { return kcp->cwnd; }
+
+static IUINT32 ikcp_none_cwnd(const ikcpcb *kcp) { return 0xffffffff; }
+
+static IUINT32 ikcp_cc_unpaced(const ikcpcb *kcp) { return 0; }
+
+const struct IKCPCC ikcp_cc_reno = {"reno", NULL, NULL, ikcp_reno_on_ack, ikcp_reno_on_loss, ikcp_reno_cwnd,
+                                    ikcp_cc_unpaced};
+
+const struct IKCPCC ikcp_cc_none = {"none", NULL, NULL, NULL, NULL, ikcp_none_cwnd, ikcp_cc_unpaced};
+
+// account an acked segment into the sample of the running ikcp_input,
+// the rate comes from the latest sent segment among the acked ones
+static void ikcp_cc_acked(ikcpcb *kcp, const IKCPSEG *seg) {
+  struct IKCPCCSAMPLE *rs = &kcp->cc_rs;
+  IUINT32 bytes = seg->len + IKCP_OVERHEAD;
+  kcp->delivered += bytes;
+  kcp->delivered_ts = kcp->current;
+  if (rs->acked == 0 || _itimediff(seg->delivered, rs->prior_delivered) > 0) {
+    rs->prior_delivered = seg->delivered;
+    rs->interval = kcp->current - seg->delivered_ts;
+  }
+  rs->acked++;
+  rs->acked_bytes += bytes;
+}
+
 //---------------------------------------------------------------------
 // create a new kcpcb
 //---------------------------------------------------------------------
@@ -257,6 +721,11 @@ ikcpcb *ikcp_create(IUINT32 conv, void *user) {
   kcp->acklist = NULL;
   kcp->ackblock = 0;
   kcp->ackcount = 0;
+  kcp->ack_delay = 0;
+  kcp->ack_max = 0;
+  kcp->ack_range = 0;
+  kcp->ack_since = 0;
+  kcp->ack_now = 0;
   kcp->rx_srtt = 0;
   kcp->rx_rttval = 0;
   kcp->rx_rto = IKCP_RTO_DEF;
@@ -273,7 +742,38 @@ ikcpcb *ikcp_create(IUINT32 conv, void *user) {
   kcp->nocwnd = 0;
   kcp->xmit = 0;
   kcp->dead_link = IKCP_DEADLINK;
+  kcp->pool = NULL;
+  kcp->ring_size = 0;
+  kcp->fack_marks = 0;
+  kcp->snd_ring = NULL;
+  kcp->rcv_ring = NULL;
+  kcp->fack_ring = NULL;
+  kcp->batch_max = 0;
+  kcp->batch_count = 0;
+  kcp->batch_buffer = NULL;
+  kcp->batch_iov = NULL;
+  kcp->cc = &ikcp_cc_reno;
+  kcp->cc_state = NULL;
+  memset(&kcp->cc_rs, 0, sizeof(kcp->cc_rs));
+  kcp->delivered = 0;
+  kcp->delivered_ts = 0;
+  kcp->pace_ts = 0;
+  kcp->pace_credit = 0;
+  kcp->large_max = 0;
+  kcp->nrcv_partial = 0;
+  kcp->drop_next = 0;
+  kcp->drop_pending = 0;
+  kcp->drop_chain = 0;
+  kcp->snd_split = 0;
+  kcp->snd_dropped = 0;
+  kcp->rcv_skipped = 0;
+  kcp->pacer = NULL;
+  memset(&kcp->mtud, 0, sizeof(kcp->mtud));
+  kcp->streams = NULL;
+  kcp->nstreams = 0;
+  kcp->stream_rr = 0;
   kcp->output = NULL;
+  kcp->output_batch = NULL;
   kcp->writelog = NULL;
 
   return kcp;
@@ -306,12 +806,48 @@ void ikcp_release(ikcpcb *kcp) {
       iqueue_del(&seg->node);
       ikcp_segment_delete(kcp, seg);
     }
+    if (kcp->streams) {
+      IUINT32 sid;
+      for (sid = 0; sid < kcp->nstreams; sid++) {
+        struct IKCPSTREAM *st = &kcp->streams[sid];
+        while (!iqueue_is_empty(&st->snd_queue)) {
+          seg = iqueue_entry(st->snd_queue.next, IKCPSEG, node);
+          iqueue_del(&seg->node);
+          ikcp_segment_delete(kcp, seg);
+        }
+        while (!iqueue_is_empty(&st->rcv_queue)) {
+          seg = iqueue_entry(st->rcv_queue.next, IKCPSEG, node);
+          iqueue_del(&seg->node);
+          ikcp_segment_delete(kcp, seg);
+        }
+      }
+      ikcp_free(kcp->streams);
+    }
     if (kcp->buffer) {
       ikcp_free(kcp->buffer);
     }
     if (kcp->acklist) {
       ikcp_free(kcp->acklist);
     }
+    ikcp_ring_free(kcp);
+    if (kcp->pool) {
+      ikcp_pool_release(kcp->pool);
+    }
+    if (kcp->batch_buffer) {
+      ikcp_free(kcp->batch_buffer);
+    }
+    if (kcp->mtud.buffer) {
+      ikcp_free(kcp->mtud.buffer);
+    }
+    if (kcp->batch_iov) {
+      ikcp_free(kcp->batch_iov);
+    }
+    if (kcp->pacer) {
+      ikcp_free(kcp->pacer);
+    }
+    if (kcp->cc->release) {
+      kcp->cc->release(kcp);
+    }
 
     kcp->nrcv_buf = 0;
     kcp->nsnd_buf = 0;
@@ -320,6 +856,10 @@ void ikcp_release(ikcpcb *kcp) {
     kcp->ackcount = 0;
     kcp->buffer = NULL;
     kcp->acklist = NULL;
+    kcp->pool = NULL;
+    kcp->batch_buffer = NULL;
+    kcp->batch_iov = NULL;
+    kcp->pacer = NULL;
     ikcp_free(kcp);
   }
 }
@@ -331,31 +871,216 @@ void ikcp_setoutput(ikcpcb *kcp, int (*output)(const char *buf, int len, ikcpcb
   kcp->output = output;
 }
 
+//---------------------------------------------------------------------
+// set batched output callback
+//---------------------------------------------------------------------
+int ikcp_setoutput_batch(ikcpcb *kcp, int (*output_batch)(const struct iovec *iov, int count, ikcpcb *kcp, void *user),
+                         int max_batch) {
+  char *buffer = NULL;
+  struct iovec *iov = NULL;
+  if (output_batch != NULL) {
+    if (max_batch <= 0) return -1;
+    buffer = (char *)ikcp_malloc((size_t)(kcp->mtu + IKCP_OVERHEAD) * max_batch);
+    iov = (struct iovec *)ikcp_malloc(sizeof(struct iovec) * max_batch);
+    if (buffer == NULL || iov == NULL) {
+      if (buffer) ikcp_free(buffer);
+      if (iov) ikcp_free(iov);
+      return -2;
+    }
+  }
+  if (kcp->batch_buffer) ikcp_free(kcp->batch_buffer);
+  if (kcp->batch_iov) ikcp_free(kcp->batch_iov);
+  kcp->batch_buffer = buffer;
+  kcp->batch_iov = iov;
+  kcp->batch_max = (output_batch != NULL) ? (IUINT32)max_batch : 0;
+  kcp->batch_count = 0;
+  kcp->output_batch = output_batch;
+  return 0;
+}
+
+//---------------------------------------------------------------------
+// large-message mode
+//---------------------------------------------------------------------
+// fragments a message may take: never below what the classic mode
+// already allows, so ordinary peers keep working in large mode
+static IUINT32 ikcp_large_frags(const ikcpcb *kcp) {
+  IUINT32 frags = (kcp->large_max + kcp->mss - 1) / kcp->mss;
+  return _imax_(frags, IKCP_WND_RCV);
+}
+
+// rcv_queue segments that count against rcv_wnd: in large mode the
+// message still being reassembled does not, or it could never complete
+static IUINT32 ikcp_rcv_used(const ikcpcb *kcp) {
+  if (kcp->large_max == 0) return kcp->nrcv_que;
+  return kcp->nrcv_que - kcp->nrcv_partial;
+}
+
+static int ikcp_rcv_room(const ikcpcb *kcp) {
+  if (ikcp_rcv_used(kcp) >= kcp->rcv_wnd) return 0;
+  return kcp->large_max == 0 || kcp->nrcv_partial < ikcp_large_frags(kcp);
+}
+
+//---------------------------------------------------------------------
+// stream queues: without ikcp_setstreams everything is stream 0 and
+// stays in the queues of the kcp itself
+//---------------------------------------------------------------------
+static IUINT32 ikcp_nstreams(const ikcpcb *kcp) {
+  return kcp->streams ? kcp->nstreams : 1;
+}
+
+static struct IQUEUEHEAD *ikcp_sndq(ikcpcb *kcp, IUINT32 sid) {
+  return kcp->streams ? &kcp->streams[sid].snd_queue : &kcp->snd_queue;
+}
+
+static struct IQUEUEHEAD *ikcp_rcvq(const ikcpcb *kcp, IUINT32 sid) {
+  return kcp->streams ? &kcp->streams[sid].rcv_queue : (struct IQUEUEHEAD *)&kcp->rcv_queue;
+}
+
+// the message at the head of a receive queue is complete
+static int ikcp_rcvq_ready(const ikcpcb *kcp, IUINT32 sid) {
+  struct IQUEUEHEAD *q = ikcp_rcvq(kcp, sid);
+  IUINT32 count = kcp->streams ? kcp->streams[sid].nrcv_que : kcp->nrcv_que;
+  if (iqueue_is_empty(q)) return 0;
+  return count >= iqueue_entry(q->next, IKCPSEG, node)->frg + 1;
+}
+
+// size of the complete message at the head of a receive queue
+static int ikcp_rcvq_size(const struct IQUEUEHEAD *q) {
+  const struct IQUEUEHEAD *p;
+  int length = 0;
+  for (p = q->next; p != q; p = p->next) {
+    IKCPSEG *seg = iqueue_entry(p, IKCPSEG, node);
+    length += seg->len;
+    if (seg->frg == 0) break;
+  }
+  return length;
+}
+
+// stream of the message ikcp_recv returns next: the lowest one with a
+// complete message at its head, -1 if none
+static int ikcp_rcv_pick(const ikcpcb *kcp) {
+  IUINT32 sid, n = ikcp_nstreams(kcp);
+  for (sid = 0; sid < n; sid++) {
+    if (ikcp_rcvq_ready(kcp, sid)) return (int)sid;
+  }
+  return -1;
+}
+
+static void ikcp_rcvq_del(ikcpcb *kcp, IUINT32 sid, IKCPSEG *seg) {
+  iqueue_del(&seg->node);
+  ikcp_segment_delete(kcp, seg);
+  kcp->nrcv_que--;
+  if (kcp->streams) kcp->streams[sid].nrcv_que--;
+}
+
+//---------------------------------------------------------------------
+// move available data from rcv_buf -> rcv_queue
+//---------------------------------------------------------------------
+static void ikcp_rcv_queue_add(ikcpcb *kcp, IKCPSEG *seg) {
+  iqueue_del(&seg->node);
+  kcp->nrcv_buf--;
+  iqueue_add_tail(&seg->node, ikcp_rcvq(kcp, seg->stream));
+  kcp->nrcv_que++;
+  if (kcp->streams) {
+    struct IKCPSTREAM *st = &kcp->streams[seg->stream];
+    st->nrcv_que++;
+    kcp->nrcv_partial -= st->nrcv_partial;
+    st->nrcv_partial = (seg->frg == 0) ? 0 : st->nrcv_partial + 1;
+    kcp->nrcv_partial += st->nrcv_partial;
+  } else {
+    kcp->nrcv_partial = (seg->frg == 0) ? 0 : kcp->nrcv_partial + 1;
+  }
+  kcp->rcv_nxt++;
+}
+
+// drop the complete messages at the head of each receive queue that
+// the remote gave up on: any of their fragments is a SKIP marker
+static int ikcp_rcv_skip(ikcpcb *kcp) {
+  struct IQUEUEHEAD *p, *q;
+  IKCPSEG *seg;
+  IUINT32 sid, n = ikcp_nstreams(kcp);
+  int skipped = 0;
+  for (sid = 0; sid < n; sid++) {
+    q = ikcp_rcvq(kcp, sid);
+    while (ikcp_rcvq_ready(kcp, sid)) {
+      IUINT32 count, i;
+      int skip = 0;
+      count = iqueue_entry(q->next, IKCPSEG, node)->frg + 1;
+      for (i = 0, p = q->next; i < count; i++, p = p->next) {
+        if (iqueue_entry(p, IKCPSEG, node)->cmd == IKCP_CMD_SKIP) skip = 1;
+      }
+      if (!skip) break;
+      for (i = 0; i < count; i++) {
+        seg = iqueue_entry(q->next, IKCPSEG, node);
+        ikcp_rcvq_del(kcp, sid, seg);
+      }
+      kcp->rcv_skipped++;
+      skipped = 1;
+    }
+  }
+  return skipped;
+}
+
+static void ikcp_move_rcv_seg(ikcpcb *kcp) {
+  IKCPSEG *seg;
+  if (kcp->rcv_ring) {
+    IUINT32 mask = kcp->ring_size - 1;
+    while (ikcp_rcv_room(kcp)) {
+      seg = kcp->rcv_ring[kcp->rcv_nxt & mask];
+      if (seg == NULL || seg->sn != kcp->rcv_nxt) break;
+      kcp->rcv_ring[kcp->rcv_nxt & mask] = NULL;
+      ikcp_rcv_queue_add(kcp, seg);
+    }
+    return;
+  }
+  while (!iqueue_is_empty(&kcp->rcv_buf)) {
+    seg = iqueue_entry(kcp->rcv_buf.next, IKCPSEG, node);
+    if (seg->sn == kcp->rcv_nxt && ikcp_rcv_room(kcp)) {
+      ikcp_rcv_queue_add(kcp, seg);
+    } else {
+      break;
+    }
+  }
+}
+
+static void ikcp_move_rcv_buf(ikcpcb *kcp) {
+  do {
+    ikcp_move_rcv_seg(kcp);
+  } while (ikcp_rcv_skip(kcp));
+}
+
 //---------------------------------------------------------------------
 // user/upper level recv: returns size, returns below zero for EAGAIN
 //---------------------------------------------------------------------
 int ikcp_recv(ikcpcb *kcp, char *buffer, int len) {
-  struct IQUEUEHEAD *p;
+  return ikcp_recv_stream(kcp, NULL, buffer, len);
+}
+
+int ikcp_recv_stream(ikcpcb *kcp, int *stream, char *buffer, int len) {
+  struct IQUEUEHEAD *p, *q;
   int ispeek = (len < 0) ? 1 : 0;
-  int peeksize;
+  int peeksize, sid;
   int recover = 0;
   IKCPSEG *seg;
   assert(kcp);
 
-  if (iqueue_is_empty(&kcp->rcv_queue)) return -1;
+  if (kcp->nrcv_que == 0) return -1;
 
   if (len < 0) len = -len;
 
-  peeksize = ikcp_peeksize(kcp);
+  sid = ikcp_rcv_pick(kcp);
 
-  if (peeksize < 0) return -2;
+  if (sid < 0) return -2;
+
+  q = ikcp_rcvq(kcp, (IUINT32)sid);
+  peeksize = ikcp_rcvq_size(q);
 
   if (peeksize > len) return -3;
 
-  if (kcp->nrcv_que >= kcp->rcv_wnd) recover = 1;
+  if (ikcp_rcv_used(kcp) >= kcp->rcv_wnd) recover = 1;
 
   // merge fragment
-  for (len = 0, p = kcp->rcv_queue.next; p != &kcp->rcv_queue;) {
+  for (len = 0, p = q->next; p != q;) {
     int fragment;
     seg = iqueue_entry(p, IKCPSEG, node);
     p = p->next;
@@ -373,9 +1098,7 @@ int ikcp_recv(ikcpcb *kcp, char *buffer, int len) {
     }
 
     if (ispeek == 0) {
-      iqueue_del(&seg->node);
-      ikcp_segment_delete(kcp, seg);
-      kcp->nrcv_que--;
+      ikcp_rcvq_del(kcp, (IUINT32)sid, seg);
     }
 
     if (fragment == 0) break;
@@ -384,26 +1107,17 @@ int ikcp_recv(ikcpcb *kcp, char *buffer, int len) {
   assert(len == peeksize);
 
   // move available data from rcv_buf -> rcv_queue
-  while (!iqueue_is_empty(&kcp->rcv_buf)) {
-    seg = iqueue_entry(kcp->rcv_buf.next, IKCPSEG, node);
-    if (seg->sn == kcp->rcv_nxt && kcp->nrcv_que < kcp->rcv_wnd) {
-      iqueue_del(&seg->node);
-      kcp->nrcv_buf--;
-      iqueue_add_tail(&seg->node, &kcp->rcv_queue);
-      kcp->nrcv_que++;
-      kcp->rcv_nxt++;
-    } else {
-      break;
-    }
-  }
+  ikcp_move_rcv_buf(kcp);
 
   // fast recover
-  if (kcp->nrcv_que < kcp->rcv_wnd && recover) {
+  if (ikcp_rcv_used(kcp) < kcp->rcv_wnd && recover) {
     // ready to send back IKCP_CMD_WINS in ikcp_flush
     // tell remote my window size
     kcp->probe |= IKCP_ASK_TELL;
   }
 
+  if (stream) *stream = sid;
+
   return len;
 }
 
@@ -411,38 +1125,177 @@ int ikcp_recv(ikcpcb *kcp, char *buffer, int len) {
 // peek data size
 //---------------------------------------------------------------------
 int ikcp_peeksize(const ikcpcb *kcp) {
-  struct IQUEUEHEAD *p;
+  int sid;
+
+  assert(kcp);
+
+  sid = ikcp_rcv_pick(kcp);
+  if (sid < 0) return -1;
+
+  return ikcp_rcvq_size(ikcp_rcvq(kcp, (IUINT32)sid));
+}
+
+//---------------------------------------------------------------------
+// receive into a buffer the caller reserves once the size is known
+//---------------------------------------------------------------------
+int ikcp_recv_direct(ikcpcb *kcp, ikcp_recv_request_t request, void *user) {
+  struct IQUEUEHEAD *q;
   IKCPSEG *seg;
-  int length = 0;
+  char *buffer;
+  int size, sid;
 
   assert(kcp);
 
-  if (iqueue_is_empty(&kcp->rcv_queue)) return -1;
+  if (kcp->nrcv_que == 0) return -1;
+
+  sid = ikcp_rcv_pick(kcp);
+  if (sid < 0) return -2;
+
+  q = ikcp_rcvq(kcp, (IUINT32)sid);
+  size = ikcp_rcvq_size(q);
+  seg = iqueue_entry(q->next, IKCPSEG, node);
+  buffer = request(seg->data, (int)seg->len, size, user);
+  if (buffer == NULL) return -4;
+
+  return ikcp_recv(kcp, buffer, size);
+}
+
+//---------------------------------------------------------------------
+// user/upper level send, returns below zero for error
+//---------------------------------------------------------------------
+// copy 'size' bytes from the iovec cursor (iov, off) into 'dst' and
+// advance the cursor. a NULL iov_base leaves 'dst' untouched, as
+// ikcp_send does for a NULL buffer.
+static void ikcp_iov_copy(char *dst, const struct iovec **iov, size_t *off, int size) {
+  while (size > 0) {
+    const struct iovec *v = *iov;
+    size_t avail = v->iov_len - *off;
+    int chunk = (avail < (size_t)size) ? (int)avail : size;
+    if (chunk > 0 && v->iov_base) {
+      memcpy(dst, (const char *)v->iov_base + *off, chunk);
+    }
+    dst += chunk;
+    size -= chunk;
+    *off += chunk;
+    if (*off >= v->iov_len) {
+      (*iov)++;
+      *off = 0;
+    }
+  }
+}
+
+// where a message comes from: an iovec cursor, or a callback that
+// writes it straight into the segments
+typedef struct ikcp_send_src {
+  const struct iovec *iov;
+  size_t off;
+  ikcp_send_fill_t fill;
+  void *user;
+} ikcp_send_src;
+
+static int ikcp_src_copy(char *dst, ikcp_send_src *src, int size) {
+  if (src->fill) return src->fill(dst, size, src->user) == size ? 0 : -1;
+  ikcp_iov_copy(dst, &src->iov, &src->off, size);
+  return 0;
+}
+
+static int ikcp_send_iov(ikcpcb *kcp, IUINT32 sid, const struct iovec *iov, int cnt, IUINT32 deadline,
+                         IUINT32 dclass);
+static int ikcp_send_segs(ikcpcb *kcp, IUINT32 sid, ikcp_send_src *src, int len, IUINT32 deadline, IUINT32 dclass);
+
+int ikcp_send(ikcpcb *kcp, const char *buffer, int len) {
+  struct iovec iov;
+  if (len < 0) return -1;
+  iov.iov_base = (void *)buffer;
+  iov.iov_len = (size_t)len;
+  return ikcp_send_iov(kcp, 0, &iov, 1, 0, IKCP_DROP_NEVER);
+}
+
+int ikcp_sendv(ikcpcb *kcp, const struct iovec *iov, int cnt) {
+  return ikcp_send_iov(kcp, 0, iov, cnt, 0, IKCP_DROP_NEVER);
+}
+
+int ikcp_send_fill(ikcpcb *kcp, int len, ikcp_send_fill_t fill, void *user) {
+  ikcp_send_src src;
+  if (len < 0 || fill == NULL) return -1;
+  src.iov = NULL;
+  src.off = 0;
+  src.fill = fill;
+  src.user = user;
+  return ikcp_send_segs(kcp, 0, &src, len, 0, IKCP_DROP_NEVER);
+}
+
+int ikcp_send_ex(ikcpcb *kcp, const char *buffer, int len, IUINT32 ttl, int dclass) {
+  return ikcp_send_stream(kcp, 0, buffer, len, ttl, dclass);
+}
+
+int ikcp_send_stream(ikcpcb *kcp, int stream, const char *buffer, int len, IUINT32 ttl, int dclass) {
+  struct iovec iov;
+  if (len < 0) return -1;
+  iov.iov_base = (void *)buffer;
+  iov.iov_len = (size_t)len;
+  return ikcp_sendv_stream(kcp, stream, &iov, 1, ttl, dclass);
+}
+
+int ikcp_sendv_stream(ikcpcb *kcp, int stream, const struct iovec *iov, int cnt, IUINT32 ttl, int dclass) {
+  IUINT32 deadline = kcp->current + ttl;
+  IUINT32 chain;
+  int sent;
+  if (dclass < IKCP_DROP_NEVER || dclass > IKCP_DROP_CHAIN) return -1;
+  if (stream < 0 || stream >= (int)ikcp_nstreams(kcp)) return -1;
+  if (kcp->stream != 0 && dclass != IKCP_DROP_NEVER) return -1;
+  chain = 1u << stream;
+  if (dclass != IKCP_DROP_CHAIN) {
+    kcp->drop_chain &= ~chain;
+  } else if (kcp->drop_chain & chain) {
+    // depends on a message that is gone, wait for the next chain start
+    kcp->snd_dropped++;
+    return -3;
+  }
+  sent = ikcp_send_iov(kcp, (IUINT32)stream, iov, cnt, deadline, (IUINT32)dclass);
+  if (sent >= 0 && dclass != IKCP_DROP_NEVER) {
+    if (!kcp->drop_pending || _itimediff(deadline, kcp->drop_next) < 0) kcp->drop_next = deadline;
+    kcp->drop_pending = 1;
+  }
+  return sent;
+}
 
-  seg = iqueue_entry(kcp->rcv_queue.next, IKCPSEG, node);
-  if (seg->frg == 0) return seg->len;
+void ikcp_drop_stat(const ikcpcb *kcp, IUINT32 *dropped, IUINT32 *skipped) {
+  if (dropped) *dropped = kcp->snd_dropped;
+  if (skipped) *skipped = kcp->rcv_skipped;
+}
 
-  if (kcp->nrcv_que < seg->frg + 1) return -1;
+static int ikcp_send_iov(ikcpcb *kcp, IUINT32 sid, const struct iovec *iov, int cnt, IUINT32 deadline,
+                         IUINT32 dclass) {
+  ikcp_send_src src;
+  int i, len = 0;
 
-  for (p = kcp->rcv_queue.next; p != &kcp->rcv_queue; p = p->next) {
-    seg = iqueue_entry(p, IKCPSEG, node);
-    length += seg->len;
-    if (seg->frg == 0) break;
+  if (cnt < 0 || (cnt > 0 && iov == NULL)) return -1;
+  for (i = 0; i < cnt; i++) {
+    if (iov[i].iov_len > (size_t)0x7fffffff - len) return -1;
+    len += (int)iov[i].iov_len;
   }
-
-  return length;
+  // skip leading empty entries so the cursor always has data to copy
+  while (cnt > 0 && iov->iov_len == 0) {
+    iov++;
+    cnt--;
+  }
+  src.iov = iov;
+  src.off = 0;
+  src.fill = NULL;
+  src.user = NULL;
+  return ikcp_send_segs(kcp, sid, &src, len, deadline, dclass);
 }
 
-//---------------------------------------------------------------------
-// user/upper level send, returns below zero for error
-//---------------------------------------------------------------------
-int ikcp_send(ikcpcb *kcp, const char *buffer, int len) {
+// segments are built on a local list and queued together, so a failed
+// allocation or fill leaves nothing half-sent behind
+static int ikcp_send_segs(ikcpcb *kcp, IUINT32 sid, ikcp_send_src *src, int len, IUINT32 deadline, IUINT32 dclass) {
+  struct IQUEUEHEAD segs, *queue;
   IKCPSEG *seg;
-  int count, i;
+  int count, i, appended;
   int sent = 0;
 
   assert(kcp->mss > 0);
-  if (len < 0) return -1;
 
   // append to previous segment in streaming mode (if possible)
   if (kcp->stream != 0) {
@@ -456,14 +1309,18 @@ int ikcp_send(ikcpcb *kcp, const char *buffer, int len) {
         if (seg == NULL) {
           return -2;
         }
-        iqueue_add_tail(&seg->node, &kcp->snd_queue);
-        memcpy(seg->data, old->data, old->len);
-        if (buffer) {
-          memcpy(seg->data + old->len, buffer, extend);
-          buffer += extend;
+        if (ikcp_src_copy(seg->data + old->len, src, extend) < 0) {
+          ikcp_segment_delete(kcp, seg);
+          return -4;
         }
+        memcpy(seg->data, old->data, old->len);
+        iqueue_add_tail(&seg->node, &kcp->snd_queue);
+        seg->cmd = IKCP_CMD_PUSH;
         seg->len = old->len + extend;
         seg->frg = 0;
+        seg->deadline = 0;
+        seg->dclass = IKCP_DROP_NEVER;
+        seg->stream = 0;
         len -= extend;
         iqueue_del_init(&old->node);
         ikcp_segment_delete(kcp, old);
@@ -480,35 +1337,52 @@ int ikcp_send(ikcpcb *kcp, const char *buffer, int len) {
   else
     count = (len + kcp->mss - 1) / kcp->mss;
 
-  if (count >= (int)IKCP_WND_RCV) {
+  if (kcp->large_max && kcp->stream == 0) {
+    if (count > (int)ikcp_large_frags(kcp)) return -2;
+  } else if (count >= (int)IKCP_WND_RCV) {
     if (kcp->stream != 0 && sent > 0) return sent;
     return -2;
   }
 
   if (count == 0) count = 1;
 
-  // fragment
+  // fragment straight from the caller's buffers
+  appended = sent;
+  iqueue_init(&segs);
   for (i = 0; i < count; i++) {
     int size = len > (int)kcp->mss ? (int)kcp->mss : len;
+    int err = 0;
     seg = ikcp_segment_new(kcp, size);
     assert(seg);
     if (seg == NULL) {
-      return -2;
+      err = -2;
+    } else if (ikcp_src_copy(seg->data, src, size) < 0) {
+      ikcp_segment_delete(kcp, seg);
+      err = -4;
     }
-    if (buffer && len > 0) {
-      memcpy(seg->data, buffer, size);
+    if (err < 0) {
+      while (!iqueue_is_empty(&segs)) {
+        seg = iqueue_entry(segs.next, IKCPSEG, node);
+        iqueue_del(&seg->node);
+        ikcp_segment_delete(kcp, seg);
+      }
+      return (appended > 0) ? appended : err;
     }
+    seg->cmd = IKCP_CMD_PUSH;
     seg->len = size;
     seg->frg = (kcp->stream == 0) ? (count - i - 1) : 0;
+    seg->deadline = deadline;
+    seg->dclass = dclass;
+    seg->stream = sid;
     iqueue_init(&seg->node);
-    iqueue_add_tail(&seg->node, &kcp->snd_queue);
-    kcp->nsnd_que++;
-    if (buffer) {
-      buffer += size;
-    }
+    iqueue_add_tail(&seg->node, &segs);
     len -= size;
     sent += size;
   }
+  queue = ikcp_sndq(kcp, sid);
+  iqueue_splice(&segs, queue->prev);
+  kcp->nsnd_que += count;
+  if (kcp->streams) kcp->streams[sid].nsnd_que += count;
 
   return sent;
 }
@@ -547,10 +1421,24 @@ static void ikcp_parse_ack(ikcpcb *kcp, IUINT32 sn) {
 
   if (_itimediff(sn, kcp->snd_una) < 0 || _itimediff(sn, kcp->snd_nxt) >= 0) return;
 
+  if (kcp->snd_ring) {
+    IUINT32 pos = sn & (kcp->ring_size - 1);
+    IKCPSEG *seg = kcp->snd_ring[pos];
+    if (seg && seg->sn == sn) {
+      kcp->snd_ring[pos] = NULL;
+      ikcp_cc_acked(kcp, seg);
+      iqueue_del(&seg->node);
+      ikcp_segment_delete(kcp, seg);
+      kcp->nsnd_buf--;
+    }
+    return;
+  }
+
   for (p = kcp->snd_buf.next; p != &kcp->snd_buf; p = next) {
     IKCPSEG *seg = iqueue_entry(p, IKCPSEG, node);
     next = p->next;
     if (sn == seg->sn) {
+      ikcp_cc_acked(kcp, seg);
       iqueue_del(p);
       ikcp_segment_delete(kcp, seg);
       kcp->nsnd_buf--;
@@ -562,12 +1450,40 @@ static void ikcp_parse_ack(ikcpcb *kcp, IUINT32 sn) {
   }
 }
 
+// sn in [start, start + count) of an IKCP_CMD_RACK run
+static void ikcp_parse_ack_run(ikcpcb *kcp, IUINT32 start, IUINT32 count) {
+  struct IQUEUEHEAD *p, *next;
+  IUINT32 i;
+
+  if (kcp->snd_ring) {
+    for (i = 0; i < count; i++) {
+      if (_itimediff(start + i, kcp->snd_nxt) >= 0) break;
+      ikcp_parse_ack(kcp, start + i);
+    }
+    return;
+  }
+
+  // one walk, snd_buf is in sn order
+  for (p = kcp->snd_buf.next; p != &kcp->snd_buf; p = next) {
+    IKCPSEG *seg = iqueue_entry(p, IKCPSEG, node);
+    next = p->next;
+    if (_itimediff(seg->sn, start) < 0) continue;
+    if (_itimediff(seg->sn, start + count) >= 0) break;
+    ikcp_cc_acked(kcp, seg);
+    iqueue_del(p);
+    ikcp_segment_delete(kcp, seg);
+    kcp->nsnd_buf--;
+  }
+}
+
 static void ikcp_parse_una(ikcpcb *kcp, IUINT32 una) {
   struct IQUEUEHEAD *p, *next;
   for (p = kcp->snd_buf.next; p != &kcp->snd_buf; p = next) {
     IKCPSEG *seg = iqueue_entry(p, IKCPSEG, node);
     next = p->next;
     if (_itimediff(una, seg->sn) > 0) {
+      if (kcp->snd_ring) kcp->snd_ring[seg->sn & (kcp->ring_size - 1)] = NULL;
+      ikcp_cc_acked(kcp, seg);
       iqueue_del(p);
       ikcp_segment_delete(kcp, seg);
       kcp->nsnd_buf--;
@@ -582,6 +1498,15 @@ static void ikcp_parse_fastack(ikcpcb *kcp, IUINT32 sn, IUINT32 ts) {
 
   if (_itimediff(sn, kcp->snd_una) < 0 || _itimediff(sn, kcp->snd_nxt) >= 0) return;
 
+#ifndef IKCP_FASTACK_CONSERVE
+  // leave a mark, ikcp_fack_apply hands it out before the next flush
+  if (kcp->snd_ring) {
+    kcp->fack_ring[sn & (kcp->ring_size - 1)]++;
+    kcp->fack_marks++;
+    return;
+  }
+#endif
+
   for (p = kcp->snd_buf.next; p != &kcp->snd_buf; p = next) {
     IKCPSEG *seg = iqueue_entry(p, IKCPSEG, node);
     next = p->next;
@@ -633,6 +1558,7 @@ static void ikcp_ack_push(ikcpcb *kcp, IUINT32 sn, IUINT32 ts) {
   ptr = &kcp->acklist[kcp->ackcount * 2];
   ptr[0] = sn;
   ptr[1] = ts;
+  if (kcp->ackcount == 0) kcp->ack_since = kcp->current;
   kcp->ackcount++;
 }
 
@@ -641,6 +1567,29 @@ static void ikcp_ack_get(const ikcpcb *kcp, int p, IUINT32 *sn, IUINT32 *ts) {
   if (ts) ts[0] = kcp->acklist[p * 2 + 1];
 }
 
+// pending acks go out in this flush unless the ack policy holds them
+static int ikcp_ack_due(const ikcpcb *kcp) {
+  if (kcp->ack_now) return 1;
+  if (kcp->ack_max > 0 && kcp->ackcount >= kcp->ack_max) return 1;
+  return _itimediff(kcp->current, kcp->ack_since) >= (long)kcp->ack_delay;
+}
+
+// sort acklist by sn, arrival order is mostly sorted already
+static void ikcp_ack_sort(ikcpcb *kcp) {
+  IUINT32 *list = kcp->acklist;
+  IUINT32 i, j, sn, ts;
+  for (i = 1; i < kcp->ackcount; i++) {
+    sn = list[i * 2];
+    ts = list[i * 2 + 1];
+    for (j = i; j > 0 && _itimediff(list[(j - 1) * 2], sn) > 0; j--) {
+      list[j * 2] = list[(j - 1) * 2];
+      list[j * 2 + 1] = list[(j - 1) * 2 + 1];
+    }
+    list[j * 2] = sn;
+    list[j * 2 + 1] = ts;
+  }
+}
+
 //---------------------------------------------------------------------
 // parse data
 //---------------------------------------------------------------------
@@ -654,6 +1603,21 @@ void ikcp_parse_data(ikcpcb *kcp, IKCPSEG *newseg) {
     return;
   }
 
+  // rcv_buf is kept unordered when indexed, the ring gives the order
+  if (kcp->rcv_ring) {
+    IUINT32 pos = sn & (kcp->ring_size - 1);
+    if (kcp->rcv_ring[pos] == NULL) {
+      kcp->rcv_ring[pos] = newseg;
+      iqueue_init(&newseg->node);
+      iqueue_add_tail(&newseg->node, &kcp->rcv_buf);
+      kcp->nrcv_buf++;
+    } else {
+      ikcp_segment_delete(kcp, newseg);
+    }
+    ikcp_move_rcv_buf(kcp);
+    return;
+  }
+
   for (p = kcp->rcv_buf.prev; p != &kcp->rcv_buf; p = prev) {
     IKCPSEG *seg = iqueue_entry(p, IKCPSEG, node);
     prev = p->prev;
@@ -680,18 +1644,7 @@ void ikcp_parse_data(ikcpcb *kcp, IKCPSEG *newseg) {
 #endif
 
   // move available data from rcv_buf -> rcv_queue
-  while (!iqueue_is_empty(&kcp->rcv_buf)) {
-    IKCPSEG *seg = iqueue_entry(kcp->rcv_buf.next, IKCPSEG, node);
-    if (seg->sn == kcp->rcv_nxt && kcp->nrcv_que < kcp->rcv_wnd) {
-      iqueue_del(&seg->node);
-      kcp->nrcv_buf--;
-      iqueue_add_tail(&seg->node, &kcp->rcv_queue);
-      kcp->nrcv_que++;
-      kcp->rcv_nxt++;
-    } else {
-      break;
-    }
-  }
+  ikcp_move_rcv_buf(kcp);
 
 #if 0
 	ikcp_qprint("queue", &kcp->rcv_queue);
@@ -718,8 +1671,11 @@ int ikcp_input(ikcpcb *kcp, const char *data, long size) {
 
   if (data == NULL || (int)size < (int)IKCP_OVERHEAD) return -1;
 
+  memset(&kcp->cc_rs, 0, sizeof(kcp->cc_rs));
+  kcp->cc_rs.rtt = -1;
+
   while (1) {
-    IUINT32 ts, sn, len, una, conv;
+    IUINT32 ts, sn, len, una, conv, fragment, stream;
     IUINT16 wnd;
     IUINT8 cmd, frg;
     IKCPSEG *seg;
@@ -739,9 +1695,22 @@ int ikcp_input(ikcpcb *kcp, const char *data, long size) {
 
     size -= IKCP_OVERHEAD;
 
+    fragment = frg;
+    stream = 0;
+    if (cmd == IKCP_CMD_PUSHX || cmd == IKCP_CMD_SKIP) {
+      fragment |= ((len >> 16) & 0xfff) << 8;
+      stream = len >> 28;
+      len &= 0xffff;
+      if (cmd == IKCP_CMD_PUSHX) cmd = IKCP_CMD_PUSH;
+      // a message this side can not hold, or a stream it does not have
+      if ((fragment > 0xff && kcp->large_max == 0) || stream >= ikcp_nstreams(kcp)) return -3;
+    }
+
     if ((long)size < (long)len || (int)len < 0) return -2;
 
-    if (cmd != IKCP_CMD_PUSH && cmd != IKCP_CMD_ACK && cmd != IKCP_CMD_WASK && cmd != IKCP_CMD_WINS) return -3;
+    if (cmd != IKCP_CMD_PUSH && cmd != IKCP_CMD_ACK && cmd != IKCP_CMD_WASK && cmd != IKCP_CMD_WINS &&
+        cmd != IKCP_CMD_SKIP && cmd != IKCP_CMD_MTUP && cmd != IKCP_CMD_MTUA && cmd != IKCP_CMD_RACK)
+      return -3;
 
     kcp->rmt_wnd = wnd;
     ikcp_parse_una(kcp, una);
@@ -749,7 +1718,8 @@ int ikcp_input(ikcpcb *kcp, const char *data, long size) {
 
     if (cmd == IKCP_CMD_ACK) {
       if (_itimediff(kcp->current, ts) >= 0) {
-        ikcp_update_ack(kcp, _itimediff(kcp->current, ts));
+        kcp->cc_rs.rtt = (IINT32)_itimediff(kcp->current, ts);
+        ikcp_update_ack(kcp, kcp->cc_rs.rtt);
       }
       ikcp_parse_ack(kcp, sn);
       ikcp_shrink_buf(kcp);
@@ -774,7 +1744,33 @@ int ikcp_input(ikcpcb *kcp, const char *data, long size) {
         ikcp_log(kcp, IKCP_LOG_IN_ACK, "input ack: sn=%lu rtt=%ld rto=%ld", (unsigned long)sn,
                  (long)_itimediff(kcp->current, ts), (long)kcp->rx_rto);
       }
-    } else if (cmd == IKCP_CMD_PUSH) {
+    } else if (cmd == IKCP_CMD_RACK) {
+      const char *run = data;
+      IUINT32 start, last, i;
+      IUINT16 count;
+      if (len % IKCP_RACK_RUN != 0) return -2;
+      if (_itimediff(kcp->current, ts) >= 0) {
+        kcp->cc_rs.rtt = (IINT32)_itimediff(kcp->current, ts);
+        ikcp_update_ack(kcp, kcp->cc_rs.rtt);
+      }
+      for (i = 0; i < len; i += IKCP_RACK_RUN) {
+        run = ikcp_decode32u(run, &start);
+        run = ikcp_decode16u(run, &count);
+        if (count == 0) continue;
+        ikcp_parse_ack_run(kcp, start, count);
+        last = start + count - 1;
+        if (flag == 0 || _itimediff(last, maxack) > 0) {
+          flag = 1;
+          maxack = last;
+          latest_ts = ts;
+        }
+      }
+      ikcp_shrink_buf(kcp);
+      if (ikcp_canlog(kcp, IKCP_LOG_IN_ACK)) {
+        ikcp_log(kcp, IKCP_LOG_IN_ACK, "input rack: runs=%lu rtt=%ld rto=%ld", (unsigned long)(len / IKCP_RACK_RUN),
+                 (long)_itimediff(kcp->current, ts), (long)kcp->rx_rto);
+      }
+    } else if (cmd == IKCP_CMD_PUSH || cmd == IKCP_CMD_SKIP) {
       if (ikcp_canlog(kcp, IKCP_LOG_IN_DATA)) {
         ikcp_log(kcp, IKCP_LOG_IN_DATA, "input psh: sn=%lu ts=%lu", (unsigned long)sn, (unsigned long)ts);
       }
@@ -784,16 +1780,19 @@ int ikcp_input(ikcpcb *kcp, const char *data, long size) {
 
       if (_itimediff(sn, kcp->rcv_nxt + kcp->rcv_wnd) < 0) {
         ikcp_ack_push(kcp, sn, ts);
+        // the remote needs these acks to fast retransmit or to stop resending
+        if (sn != kcp->rcv_nxt || kcp->nrcv_buf > 0) kcp->ack_now = 1;
         if (_itimediff(sn, kcp->rcv_nxt) >= 0) {
           seg = ikcp_segment_new(kcp, len);
           seg->conv = conv;
           seg->cmd = cmd;
-          seg->frg = frg;
+          seg->frg = fragment;
           seg->wnd = wnd;
           seg->ts = ts;
           seg->sn = sn;
           seg->una = una;
           seg->len = len;
+          seg->stream = stream;
 
           if (len > 0) {
             memcpy(seg->data, data, len);
@@ -814,6 +1813,21 @@ int ikcp_input(ikcpcb *kcp, const char *data, long size) {
       if (ikcp_canlog(kcp, IKCP_LOG_IN_WINS)) {
         ikcp_log(kcp, IKCP_LOG_IN_WINS, "input wins: %lu", (unsigned long)(wnd));
       }
+    } else if (cmd == IKCP_CMD_MTUP) {
+      // answered in ikcp_flush, the padding is not kept
+      kcp->mtud.ack = sn;
+      kcp->mtud.ack_ts = ts;
+      if (ikcp_canlog(kcp, IKCP_LOG_IN_PROBE)) {
+        ikcp_log(kcp, IKCP_LOG_IN_PROBE, "input mtu probe: %lu", (unsigned long)sn);
+      }
+    } else if (cmd == IKCP_CMD_MTUA) {
+      if (kcp->mtud.probe != 0 && sn == kcp->mtud.probe) {
+        kcp->mtud.lo = sn;
+        kcp->mtud.probe = 0;
+      }
+      if (ikcp_canlog(kcp, IKCP_LOG_IN_PROBE)) {
+        ikcp_log(kcp, IKCP_LOG_IN_PROBE, "input mtu probe ack: %lu", (unsigned long)sn);
+      }
     } else {
       return -3;
     }
@@ -826,28 +1840,15 @@ int ikcp_input(ikcpcb *kcp, const char *data, long size) {
     ikcp_parse_fastack(kcp, maxack, latest_ts);
   }
 
-  if (_itimediff(kcp->snd_una, prev_una) > 0) {
-    if (kcp->cwnd < kcp->rmt_wnd) {
-      IUINT32 mss = kcp->mss;
-      if (kcp->cwnd < kcp->ssthresh) {
-        kcp->cwnd++;
-        kcp->incr += mss;
-      } else {
-        if (kcp->incr < mss) kcp->incr = mss;
-        kcp->incr += (mss * mss) / kcp->incr + (mss / 16);
-        if ((kcp->cwnd + 1) * mss <= kcp->incr) {
-#if 1
-          kcp->cwnd = (kcp->incr + mss - 1) / ((mss > 0) ? mss : 1);
-#else
-          kcp->cwnd++;
-#endif
-        }
-      }
-      if (kcp->cwnd > kcp->rmt_wnd) {
-        kcp->cwnd = kcp->rmt_wnd;
-        kcp->incr = kcp->rmt_wnd * mss;
-      }
+  if (kcp->cc->on_ack && (kcp->cc_rs.acked > 0 || _itimediff(kcp->snd_una, prev_una) > 0)) {
+    struct IKCPCCSAMPLE *rs = &kcp->cc_rs;
+    rs->una_moved = _itimediff(kcp->snd_una, prev_una) > 0;
+    rs->delivered = kcp->delivered;
+    rs->inflight = kcp->snd_nxt - kcp->snd_una;
+    if (rs->acked > 0) {
+      rs->rate = (IUINT32)((IUINT64)(rs->delivered - rs->prior_delivered) * 1000 / _imax_(rs->interval, 1));
     }
+    kcp->cc->on_ack(kcp, rs);
   }
 
   return 0;
@@ -857,33 +1858,291 @@ int ikcp_input(ikcpcb *kcp, const char *data, long size) {
 // ikcp_encode_seg
 //---------------------------------------------------------------------
 static char *ikcp_encode_seg(char *ptr, const IKCPSEG *seg) {
+  IUINT32 cmd = seg->cmd, len = seg->len;
+  if (seg->frg > 0xff || seg->stream != 0) {
+    // the fragment counter outgrew its byte (large-message mode) or the
+    // segment is not on stream 0: frg_hi:12 | stream:4 above the length
+    if (cmd == IKCP_CMD_PUSH) cmd = IKCP_CMD_PUSHX;
+    len |= ((seg->frg >> 8) << 16) | (seg->stream << 28);
+  }
   ptr = ikcp_encode32u(ptr, seg->conv);
-  ptr = ikcp_encode8u(ptr, (IUINT8)seg->cmd);
+  ptr = ikcp_encode8u(ptr, (IUINT8)cmd);
   ptr = ikcp_encode8u(ptr, (IUINT8)seg->frg);
   ptr = ikcp_encode16u(ptr, (IUINT16)seg->wnd);
   ptr = ikcp_encode32u(ptr, seg->ts);
   ptr = ikcp_encode32u(ptr, seg->sn);
   ptr = ikcp_encode32u(ptr, seg->una);
-  ptr = ikcp_encode32u(ptr, seg->len);
+  ptr = ikcp_encode32u(ptr, len);
   return ptr;
 }
 
 static int ikcp_wnd_unused(const ikcpcb *kcp) {
-  if (kcp->nrcv_que < kcp->rcv_wnd) {
-    return kcp->rcv_wnd - kcp->nrcv_que;
+  IUINT32 used = ikcp_rcv_used(kcp);
+  if (used < kcp->rcv_wnd) {
+    return kcp->rcv_wnd - used;
   }
   return 0;
 }
 
+//---------------------------------------------------------------------
+// path mtu discovery
+//---------------------------------------------------------------------
+
+// a probe is a datagram of its own, it skips the pacer and never carries
+// anything else: losing it must only say the size does not fit
+static void ikcp_mtud_send(ikcpcb *kcp, IUINT32 size) {
+  struct IKCPMTUD *md = &kcp->mtud;
+  IKCPSEG seg;
+  seg.conv = kcp->conv;
+  seg.cmd = IKCP_CMD_MTUP;
+  seg.frg = 0;
+  seg.stream = 0;
+  seg.wnd = ikcp_wnd_unused(kcp);
+  seg.ts = kcp->current;
+  seg.sn = size;
+  seg.una = kcp->rcv_nxt;
+  seg.len = size - IKCP_OVERHEAD;
+  memset(ikcp_encode_seg(md->buffer, &seg), 0, seg.len);
+  kcp->tx_bytes_total += size;
+  if (kcp->output_batch == NULL) {
+    ikcp_output(kcp, md->buffer, (int)size);
+    return;
+  }
+  kcp->batch_iov[kcp->batch_count].iov_base = md->buffer;
+  kcp->batch_iov[kcp->batch_count].iov_len = size;
+  kcp->batch_count++;
+  ikcp_output_batch(kcp);
+}
+
+// called once ikcp_flush emitted everything: time out the probe in
+// flight, pick the next size, or apply the result of a settled search
+static void ikcp_mtud_step(ikcpcb *kcp) {
+  struct IKCPMTUD *md = &kcp->mtud;
+  IUINT32 current = kcp->current;
+
+  if (md->max == 0 || kcp->state != 0) return;
+
+  if (md->probe != 0) {
+    if (_itimediff(current, md->probe_ts) < kcp->rx_rto) return;
+    if (md->tries >= IKCP_MTUD_TRIES) {
+      md->hi = md->probe - 1;
+      md->probe = 0;
+    }
+  }
+
+  if (md->probe == 0) {
+    if (!md->searching) {
+      if (_itimediff(current, md->next_ts) < 0) return;
+      md->searching = 1;
+      md->lo = kcp->mtu;
+      md->hi = md->max;
+    }
+    if (md->hi < md->lo + IKCP_MTUD_STEP) {
+      md->searching = 0;
+      md->next_ts = current + IKCP_MTUD_RAISE;
+      if (md->lo > kcp->mtu && ikcp_setmtu(kcp, (int)md->lo) == 0 && ikcp_canlog(kcp, IKCP_LOG_OUTPUT)) {
+        ikcp_log(kcp, IKCP_LOG_OUTPUT, "path mtu %lu", (unsigned long)kcp->mtu);
+      }
+      return;
+    }
+    md->probe = (md->lo + md->hi + 1) / 2;
+    md->tries = 0;
+  }
+
+  md->probe_ts = current;
+  md->tries++;
+  ikcp_mtud_send(kcp, md->probe);
+}
+
+//---------------------------------------------------------------------
+// ikcp_flush_rack: the pending acks as IKCP_CMD_RACK runs
+//---------------------------------------------------------------------
+static char *ikcp_flush_rack(ikcpcb *kcp, char **buffer, char *ptr, IKCPSEG *seg) {
+  IUINT32 *list = kcp->acklist;
+  IUINT32 limit = (kcp->mtu - IKCP_OVERHEAD) / IKCP_RACK_RUN;
+  IUINT32 nruns = 0, i, n, sn;
+  int size;
+
+  // echo the newest ack
+  seg->cmd = IKCP_CMD_RACK;
+  seg->sn = list[(kcp->ackcount - 1) * 2];
+  seg->ts = list[(kcp->ackcount - 1) * 2 + 1];
+
+  // runs are built in place, there are never more than acks
+  ikcp_ack_sort(kcp);
+  for (i = 0; i < kcp->ackcount; i++) {
+    sn = list[i * 2];
+    if (_itimediff(sn, kcp->rcv_nxt) < 0) continue;  // una covers it
+    if (nruns > 0) {
+      IUINT32 *r = &list[(nruns - 1) * 2];
+      if (sn == r[0] + r[1] - 1) continue;
+      if (sn == r[0] + r[1] && r[1] < 0xffff) {
+        r[1]++;
+        continue;
+      }
+    }
+    list[nruns * 2] = sn;
+    list[nruns * 2 + 1] = 1;
+    nruns++;
+  }
+
+  // una and ts still go out when every run was covered, a plain ack
+  // carries them or a single sn in fewer bytes
+  if (nruns == 0 || (nruns == 1 && list[1] == 1)) {
+    seg->cmd = IKCP_CMD_ACK;
+    if (nruns == 1) seg->sn = list[0];
+    nruns = 0;
+    size = (int)(ptr - *buffer);
+    if (size + (int)IKCP_OVERHEAD > (int)kcp->mtu) {
+      *buffer = ikcp_flush_output(kcp, *buffer, size);
+      ptr = *buffer;
+    }
+    ptr = ikcp_encode_seg(ptr, seg);
+  }
+  for (i = 0; i < nruns;) {
+    n = _imin_(nruns - i, limit);
+    size = (int)(ptr - *buffer);
+    if (size + (int)(IKCP_OVERHEAD + n * IKCP_RACK_RUN) > (int)kcp->mtu) {
+      *buffer = ikcp_flush_output(kcp, *buffer, size);
+      ptr = *buffer;
+    }
+    seg->len = n * IKCP_RACK_RUN;
+    ptr = ikcp_encode_seg(ptr, seg);
+    for (; n > 0; n--, i++) {
+      ptr = ikcp_encode32u(ptr, list[i * 2]);
+      ptr = ikcp_encode16u(ptr, (unsigned short)list[i * 2 + 1]);
+    }
+  }
+
+  seg->cmd = IKCP_CMD_ACK;
+  seg->len = 0;
+  seg->sn = 0;
+  seg->ts = 0;
+  return ptr;
+}
+
 //---------------------------------------------------------------------
 // ikcp_flush
 //---------------------------------------------------------------------
+//---------------------------------------------------------------------
+// ikcp_send_ex deadlines
+//---------------------------------------------------------------------
+static int ikcp_drop_due(const ikcpcb *kcp, const IKCPSEG *seg, int *broken) {
+  int due;
+  if (seg->dclass != IKCP_DROP_CHAIN) *broken = 0;
+  if (seg->dclass == IKCP_DROP_NEVER) return 0;
+  due = _itimediff(kcp->current, seg->deadline) >= 0;
+  if (seg->dclass == IKCP_DROP_CHAIN) {
+    if (*broken) return 1;
+    *broken = due;
+  }
+  return due;
+}
+
+// drop expired messages in sn order. numbered fragments turn into
+// empty SKIP markers that are still delivered reliably, so the remote
+// can close the message and discard whatever part of it arrived.
+// messages not numbered yet just leave snd_queue.
+static void ikcp_drop_expired(ikcpcb *kcp) {
+  struct IQUEUEHEAD *p, *next, *q;
+  int broken[IKCP_STREAM_MAX], in_msg[IKCP_STREAM_MAX], keep;
+  IUINT32 pending = 0, drop_next = 0;
+  IUINT32 sid, n = ikcp_nstreams(kcp);
+
+  // chains and messages are per stream, their segments interleave in snd_buf
+  memset(broken, 0, sizeof(broken));
+  memset(in_msg, 0, sizeof(in_msg));
+
+  for (p = kcp->snd_buf.next; p != &kcp->snd_buf; p = p->next) {
+    IKCPSEG *seg = iqueue_entry(p, IKCPSEG, node);
+    sid = seg->stream;
+    if (ikcp_drop_due(kcp, seg, &broken[sid])) {
+      if (seg->cmd != IKCP_CMD_SKIP) {
+        if (!in_msg[sid]) kcp->snd_dropped++;
+        seg->cmd = IKCP_CMD_SKIP;
+        seg->len = 0;
+      }
+      in_msg[sid] = (seg->frg != 0);
+      continue;
+    }
+    in_msg[sid] = 0;
+    if (seg->dclass != IKCP_DROP_NEVER && seg->cmd != IKCP_CMD_SKIP) {
+      if (!pending || _itimediff(seg->deadline, drop_next) < 0) drop_next = seg->deadline;
+      pending = 1;
+    }
+  }
+
+  // a message cut by the snd_queue -> snd_buf boundary keeps its
+  // queued tail as markers, the remote already holds its head
+  for (sid = 0; sid < n; sid++) {
+    q = ikcp_sndq(kcp, sid);
+    keep = kcp->streams ? kcp->streams[sid].snd_split : kcp->snd_split;
+    for (p = q->next; p != q; p = next) {
+      IKCPSEG *seg = iqueue_entry(p, IKCPSEG, node);
+      int last = (seg->frg == 0);
+      next = p->next;
+      if (ikcp_drop_due(kcp, seg, &broken[sid])) {
+        if (seg->cmd != IKCP_CMD_SKIP && !in_msg[sid]) kcp->snd_dropped++;
+        in_msg[sid] = !last;
+        if (keep) {
+          seg->cmd = IKCP_CMD_SKIP;
+          seg->len = 0;
+        } else {
+          iqueue_del(p);
+          ikcp_segment_delete(kcp, seg);
+          kcp->nsnd_que--;
+          if (kcp->streams) kcp->streams[sid].nsnd_que--;
+        }
+      } else {
+        in_msg[sid] = 0;
+        if (seg->dclass != IKCP_DROP_NEVER && seg->cmd != IKCP_CMD_SKIP) {
+          if (!pending || _itimediff(seg->deadline, drop_next) < 0) drop_next = seg->deadline;
+          pending = 1;
+        }
+      }
+      if (last) keep = 0;
+    }
+    if (broken[sid]) kcp->drop_chain |= 1u << sid;
+  }
+
+  kcp->drop_pending = (int)pending;
+  kcp->drop_next = drop_next;
+}
+
+//---------------------------------------------------------------------
+// stream scheduling
+//---------------------------------------------------------------------
+// deficit round robin over the streams of the most urgent level that
+// has data queued: a stream is picked while its deficit covers its next
+// segment, and every turn that comes to it adds weight * mtu bytes.
+static IUINT32 ikcp_stream_pick(ikcpcb *kcp) {
+  struct IKCPSTREAM *st;
+  IUINT32 i, level = 0xffffffff;
+  for (i = 0; i < kcp->nstreams; i++) {
+    st = &kcp->streams[i];
+    if (st->nsnd_que > 0 && st->prio < level) level = st->prio;
+  }
+  while (1) {
+    st = &kcp->streams[kcp->stream_rr];
+    if (st->nsnd_que == 0) {
+      st->deficit = 0;
+    } else if (st->prio == level) {
+      IKCPSEG *seg = iqueue_entry(st->snd_queue.next, IKCPSEG, node);
+      if (st->deficit >= (IINT32)(seg->len + IKCP_OVERHEAD)) break;
+    }
+    kcp->stream_rr = (kcp->stream_rr + 1) % kcp->nstreams;
+    st = &kcp->streams[kcp->stream_rr];
+    if (st->nsnd_que > 0 && st->prio == level) st->deficit += (IINT32)(st->weight * kcp->mtu);
+  }
+  return kcp->stream_rr;
+}
+
 void ikcp_flush(ikcpcb *kcp) {
   IUINT32 current = kcp->current;
-  char *buffer = kcp->buffer;
+  char *buffer = ikcp_flush_buffer(kcp);
   char *ptr = buffer;
   int size, i;
-  IUINT32 resent, cwnd;
+  IUINT32 resent, cwnd, pacing_rate;
   IUINT32 rtomin;
   struct IQUEUEHEAD *p;
   int change = 0;
@@ -893,30 +2152,56 @@ void ikcp_flush(ikcpcb *kcp) {
   // 'ikcp_update' haven't been called.
   if (kcp->updated == 0) return;
 
+  if (kcp->drop_pending && _itimediff(current, kcp->drop_next) >= 0) {
+    ikcp_drop_expired(kcp);
+  }
+
   seg.conv = kcp->conv;
   seg.cmd = IKCP_CMD_ACK;
   seg.frg = 0;
+  seg.stream = 0;
   seg.wnd = ikcp_wnd_unused(kcp);
   seg.una = kcp->rcv_nxt;
   seg.len = 0;
   seg.sn = 0;
   seg.ts = 0;
 
-  // flush acknowledges
-  int count = kcp->ackcount;
-  for (i = 0; i < count; i++) {
+  // flush acknowledges, unless the ack policy holds them for more
+  if (kcp->ackcount > 0 && ikcp_ack_due(kcp)) {
+    if (kcp->ack_range) {
+      ptr = ikcp_flush_rack(kcp, &buffer, ptr, &seg);
+    } else {
+      int count = kcp->ackcount;
+      for (i = 0; i < count; i++) {
+        size = (int)(ptr - buffer);
+        if (size + (int)IKCP_OVERHEAD > (int)kcp->mtu) {
+          buffer = ikcp_flush_output(kcp, buffer, size);
+          ptr = buffer;
+        }
+        ikcp_ack_get(kcp, i, &seg.sn, &seg.ts);
+        ptr = ikcp_encode_seg(ptr, &seg);
+      }
+    }
+    kcp->ackcount = 0;
+    kcp->ack_now = 0;
+  }
+
+  // answer a path mtu probe, ts tells which one
+  if (kcp->mtud.ack != 0) {
     size = (int)(ptr - buffer);
     if (size + (int)IKCP_OVERHEAD > (int)kcp->mtu) {
-      ikcp_output(kcp, buffer, size);
-      kcp->tx_bytes_total += size;
+      buffer = ikcp_flush_output(kcp, buffer, size);
       ptr = buffer;
     }
-    ikcp_ack_get(kcp, i, &seg.sn, &seg.ts);
+    seg.cmd = IKCP_CMD_MTUA;
+    seg.sn = kcp->mtud.ack;
+    seg.ts = kcp->mtud.ack_ts;
     ptr = ikcp_encode_seg(ptr, &seg);
+    seg.sn = 0;
+    seg.ts = 0;
+    kcp->mtud.ack = 0;
   }
 
-  kcp->ackcount = 0;
-
   // probe window size (if remote window size equals zero)
   if (kcp->rmt_wnd == 0) {
     if (kcp->probe_wait == 0) {
@@ -941,7 +2226,7 @@ void ikcp_flush(ikcpcb *kcp) {
     seg.cmd = IKCP_CMD_WASK;
     size = (int)(ptr - buffer);
     if (size + (int)IKCP_OVERHEAD > (int)kcp->mtu) {
-      ikcp_output(kcp, buffer, size);
+      buffer = ikcp_flush_output(kcp, buffer, size);
       ptr = buffer;
     }
     ptr = ikcp_encode_seg(ptr, &seg);
@@ -952,7 +2237,7 @@ void ikcp_flush(ikcpcb *kcp) {
     seg.cmd = IKCP_CMD_WINS;
     size = (int)(ptr - buffer);
     if (size + (int)IKCP_OVERHEAD > (int)kcp->mtu) {
-      ikcp_output(kcp, buffer, size);
+      buffer = ikcp_flush_output(kcp, buffer, size);
       ptr = buffer;
     }
     ptr = ikcp_encode_seg(ptr, &seg);
@@ -962,14 +2247,44 @@ void ikcp_flush(ikcpcb *kcp) {
 
   // calculate window size
   cwnd = _imin_(kcp->snd_wnd, kcp->rmt_wnd);
-  if (kcp->nocwnd == 0) cwnd = _imin_(kcp->cwnd, cwnd);
+  cwnd = _imin_(kcp->cc->cwnd(kcp), cwnd);
+
+  // nothing in flight: the next delivery rate sample starts now
+  if (iqueue_is_empty(&kcp->snd_buf)) kcp->delivered_ts = current;
+
+  // refill the pacing credit, at most one interval worth of burst. with
+  // the datagram pacer on, it already spaces what leaves and gating the
+  // window here as well would pace twice
+  pacing_rate = kcp->pacer ? 0 : kcp->cc->pacing_rate(kcp);
+  if (pacing_rate > 0) {
+    IINT32 burst = (IINT32)_imax_((IUINT32)((IUINT64)pacing_rate * kcp->interval / 1000), kcp->mtu);
+    IINT32 elapsed = (IINT32)_itimediff(current, kcp->pace_ts);
+    if (elapsed < 0) elapsed = 0;
+    if (elapsed > (IINT32)kcp->interval * 2) elapsed = (IINT32)kcp->interval * 2;
+    kcp->pace_credit += (IINT32)((IUINT64)pacing_rate * elapsed / 1000);
+    if (kcp->pace_credit > burst) kcp->pace_credit = burst;
+  }
+  kcp->pace_ts = current;
 
-  // move data from snd_queue to snd_buf
+  // move data from snd_queue to snd_buf, most urgent stream first
   while (_itimediff(kcp->snd_nxt, kcp->snd_una + cwnd) < 0) {
     IKCPSEG *newseg;
-    if (iqueue_is_empty(&kcp->snd_queue)) break;
-
-    newseg = iqueue_entry(kcp->snd_queue.next, IKCPSEG, node);
+    if (kcp->nsnd_que == 0) break;
+    if (pacing_rate > 0 && kcp->pace_credit <= 0) break;
+
+    if (kcp->streams) {
+      struct IKCPSTREAM *st = &kcp->streams[ikcp_stream_pick(kcp)];
+      newseg = iqueue_entry(st->snd_queue.next, IKCPSEG, node);
+      // the end of the window is left to level 0 streams
+      if (st->prio > 0 && _itimediff(kcp->snd_nxt, kcp->snd_una + cwnd - cwnd / 8) >= 0) break;
+      st->deficit -= (IINT32)(newseg->len + IKCP_OVERHEAD);
+      st->nsnd_que--;
+      st->snd_split = (newseg->frg != 0);
+    } else {
+      newseg = iqueue_entry(kcp->snd_queue.next, IKCPSEG, node);
+      kcp->snd_split = (newseg->frg != 0);
+    }
+    if (pacing_rate > 0) kcp->pace_credit -= (IINT32)(newseg->len + IKCP_OVERHEAD);
 
     iqueue_del(&newseg->node);
     iqueue_add_tail(&newseg->node, &kcp->snd_buf);
@@ -977,7 +2292,6 @@ void ikcp_flush(ikcpcb *kcp) {
     kcp->nsnd_buf++;
 
     newseg->conv = kcp->conv;
-    newseg->cmd = IKCP_CMD_PUSH;
     newseg->wnd = seg.wnd;
     newseg->ts = current;
     newseg->sn = kcp->snd_nxt++;
@@ -986,6 +2300,10 @@ void ikcp_flush(ikcpcb *kcp) {
     newseg->rto = kcp->rx_rto;
     newseg->fastack = 0;
     newseg->xmit = 0;
+    if (kcp->snd_ring) {
+      kcp->snd_ring[newseg->sn & (kcp->ring_size - 1)] = newseg;
+      kcp->fack_ring[newseg->sn & (kcp->ring_size - 1)] = 0;
+    }
   }
 
   // calculate resent
@@ -1004,6 +2322,10 @@ void ikcp_flush(ikcpcb *kcp) {
     kcp->period_retrans = 0;
   }
 
+  if (kcp->snd_ring) {
+    ikcp_fack_apply(kcp);
+  }
+
   // flush data segments
   for (p = kcp->snd_buf.next; p != &kcp->snd_buf; p = p->next) {
     IKCPSEG *segment = iqueue_entry(p, IKCPSEG, node);
@@ -1037,7 +2359,11 @@ void ikcp_flush(ikcpcb *kcp) {
 
     if (needsend) {
       int need;
+      // the retransmit timer starts once the pacer lets it go
+      if (kcp->pacer) segment->resendts += ikcp_pace_delay(kcp);
       segment->ts = current;
+      segment->delivered = kcp->delivered;
+      segment->delivered_ts = kcp->delivered_ts;
       segment->wnd = seg.wnd;
       segment->una = kcp->rcv_nxt;
 
@@ -1045,8 +2371,7 @@ void ikcp_flush(ikcpcb *kcp) {
       need = IKCP_OVERHEAD + segment->len;
 
       if (size + need > (int)kcp->mtu) {
-        ikcp_output(kcp, buffer, size);
-        kcp->tx_bytes_total += size;
+        buffer = ikcp_flush_output(kcp, buffer, size);
         ptr = buffer;
       }
 
@@ -1073,32 +2398,25 @@ void ikcp_flush(ikcpcb *kcp) {
 
   // flash remain segments
   size = (int)(ptr - buffer);
-  if (size > 0) {
-    ikcp_output(kcp, buffer, size);
-    // 更新发送的总字节数
-    kcp->tx_bytes_total += size;
+  ikcp_flush_output(kcp, buffer, size);
+  if (kcp->pacer) {
+    ikcp_pace_release(kcp);
+  } else if (kcp->output_batch) {
+    ikcp_output_batch(kcp);
   }
 
-  // update ssthresh
-  if (change) {
+  // a timeout overrides the fast retransmit reaction of the same flush
+  if (kcp->cc->on_loss && (change || lost)) {
     IUINT32 inflight = kcp->snd_nxt - kcp->snd_una;
-    kcp->ssthresh = inflight / 2;
-    if (kcp->ssthresh < IKCP_THRESH_MIN) kcp->ssthresh = IKCP_THRESH_MIN;
-    kcp->cwnd = kcp->ssthresh + resent;
-    kcp->incr = kcp->cwnd * kcp->mss;
-  }
-
-  if (lost) {
-    kcp->ssthresh = cwnd / 2;
-    if (kcp->ssthresh < IKCP_THRESH_MIN) kcp->ssthresh = IKCP_THRESH_MIN;
-    kcp->cwnd = 1;
-    kcp->incr = kcp->mss;
+    kcp->cc->on_loss(kcp, lost ? IKCP_CC_LOSS_RTO : IKCP_CC_LOSS_FAST, inflight);
   }
 
   if (kcp->cwnd < 1) {
     kcp->cwnd = 1;
     kcp->incr = kcp->mss;
   }
+
+  ikcp_mtud_step(kcp);
 }
 
 //---------------------------------------------------------------------
@@ -1129,6 +2447,11 @@ void ikcp_update(ikcpcb *kcp, IUINT32 current) {
       kcp->ts_flush = kcp->current + kcp->interval;
     }
     ikcp_flush(kcp);
+  } else if (kcp->ack_delay > 0 && kcp->ackcount > 0 && ikcp_ack_due(kcp)) {
+    // held acks leave when due, not at the next interval
+    ikcp_flush(kcp);
+  } else if (kcp->pacer && kcp->pacer->count > 0) {
+    ikcp_pace_release(kcp);
   }
 
   if (kcp->traffic_time_start == 0) {
@@ -1179,6 +2502,18 @@ IUINT32 ikcp_check(const ikcpcb *kcp, IUINT32 current) {
 
   tm_flush = _itimediff(ts_flush, current);
 
+  if (kcp->pacer && kcp->pacer->count > 0) {
+    IINT32 wait = ikcp_pace_wait(kcp, current);
+    if (wait <= 0) return current;
+    if (wait < tm_packet) tm_packet = wait;
+  }
+
+  if (kcp->ack_delay > 0 && kcp->ackcount > 0) {
+    IINT32 wait = _itimediff(kcp->ack_since + kcp->ack_delay, current);
+    if (kcp->ack_now || (kcp->ack_max > 0 && kcp->ackcount >= kcp->ack_max) || wait <= 0) return current;
+    if (wait < tm_packet) tm_packet = wait;
+  }
+
   for (p = kcp->snd_buf.next; p != &kcp->snd_buf; p = p->next) {
     const IKCPSEG *seg = iqueue_entry(p, const IKCPSEG, node);
     IINT32 diff = _itimediff(seg->resendts, current);
@@ -1195,14 +2530,48 @@ IUINT32 ikcp_check(const ikcpcb *kcp, IUINT32 current) {
 }
 
 int ikcp_setmtu(ikcpcb *kcp, int mtu) {
-  char *buffer;
+  char *buffer, *batch_buffer = NULL;
+  struct IKCPPACER *pacer = NULL;
   if (mtu < 50 || mtu < (int)IKCP_OVERHEAD) return -1;
+  // queued segments would not fit the datagram and pacer slots
+  if (mtu < (int)kcp->mtu && kcp->nsnd_que + kcp->nsnd_buf > 0) return -3;
+  if ((kcp->large_max || kcp->streams) && mtu - IKCP_OVERHEAD > 0xffff) return -1;
+  if (kcp->large_max && kcp->large_max / (mtu - IKCP_OVERHEAD) >= IKCP_FRG_MAX) return -1;
   buffer = (char *)ikcp_malloc((mtu + IKCP_OVERHEAD) * 3);
   if (buffer == NULL) return -2;
+  if (kcp->output_batch) {
+    batch_buffer = (char *)ikcp_malloc((size_t)(mtu + IKCP_OVERHEAD) * kcp->batch_max);
+    if (batch_buffer == NULL) {
+      ikcp_free(buffer);
+      return -2;
+    }
+  }
+  if (kcp->pacer) {
+    pacer = ikcp_pace_new(mtu, kcp->pacer->rate, kcp->pacer->slots);
+    if (pacer == NULL) {
+      ikcp_free(buffer);
+      if (batch_buffer) ikcp_free(batch_buffer);
+      return -2;
+    }
+    // queued datagrams are laid out for the old mtu, let them go now
+    ikcp_pace_emit(kcp, kcp->pacer->count);
+    pacer->ts = kcp->pacer->ts;
+    pacer->tokens = kcp->pacer->tokens;
+    ikcp_free(kcp->pacer);
+    kcp->pacer = pacer;
+  }
+  if (batch_buffer) {
+    ikcp_free(kcp->batch_buffer);
+    kcp->batch_buffer = batch_buffer;
+  }
   kcp->mtu = mtu;
   kcp->mss = kcp->mtu - IKCP_OVERHEAD;
   ikcp_free(kcp->buffer);
   kcp->buffer = buffer;
+  if (kcp->pool) {
+    kcp->pool->mss = kcp->mss;
+    ikcp_pool_resize(kcp->pool);
+  }
   return 0;
 }
 
@@ -1236,6 +2605,23 @@ int ikcp_nodelay(ikcpcb *kcp, int nodelay, int interval, int resend, int nc) {
   }
   if (nc >= 0) {
     kcp->nocwnd = nc;
+    if (kcp->cc == &ikcp_cc_reno || kcp->cc == &ikcp_cc_none) {
+      kcp->cc = nc ? &ikcp_cc_none : &ikcp_cc_reno;
+    }
+  }
+  return 0;
+}
+
+int ikcp_setcc(ikcpcb *kcp, const struct IKCPCC *cc) {
+  if (cc == NULL) cc = kcp->nocwnd ? &ikcp_cc_none : &ikcp_cc_reno;
+  if (cc->cwnd == NULL || cc->pacing_rate == NULL) return -1;
+  if (kcp->cc->release) kcp->cc->release(kcp);
+  kcp->cc_state = NULL;
+  kcp->cc = cc;
+  kcp->pace_credit = 0;
+  if (cc->init && cc->init(kcp) < 0) {
+    kcp->cc = kcp->nocwnd ? &ikcp_cc_none : &ikcp_cc_reno;
+    return -2;
   }
   return 0;
 }
@@ -1248,12 +2634,170 @@ int ikcp_wndsize(ikcpcb *kcp, int sndwnd, int rcvwnd) {
     if (rcvwnd > 0) {  // must >= max fragment size
       kcp->rcv_wnd = _imax_(rcvwnd, IKCP_WND_RCV);
     }
+    if (kcp->ring_size) {
+      IUINT32 need = ikcp_ring_need(kcp);
+      if (need > kcp->ring_size) return ikcp_ring_build(kcp, need);
+    }
+  }
+  return 0;
+}
+
+int ikcp_wndindex(ikcpcb *kcp, int enable) {
+  IUINT32 i, mask;
+  if (enable) {
+    IUINT32 need = ikcp_ring_need(kcp);
+    if (kcp->ring_size >= need) return 0;
+    return ikcp_ring_build(kcp, need);
+  }
+  if (kcp->ring_size == 0) return 0;
+  // the lists are walked in sn order again, rebuild rcv_buf from the ring
+  ikcp_fack_apply(kcp);
+  mask = kcp->ring_size - 1;
+  iqueue_init(&kcp->rcv_buf);
+  for (i = 0; i < kcp->ring_size; i++) {
+    IKCPSEG *seg = kcp->rcv_ring[(kcp->rcv_nxt + i) & mask];
+    if (seg) iqueue_add_tail(&seg->node, &kcp->rcv_buf);
+  }
+  ikcp_ring_free(kcp);
+  return 0;
+}
+
+int ikcp_setlarge(ikcpcb *kcp, int max_bytes) {
+  if (max_bytes < 0) return -1;
+  // PUSHX keeps the segment length in the lower half of len
+  if (max_bytes > 0 && kcp->mss > 0xffff) return -1;
+  if ((IUINT32)max_bytes / kcp->mss >= IKCP_FRG_MAX) return -1;
+  kcp->large_max = (IUINT32)max_bytes;
+  return 0;
+}
+
+int ikcp_setstreams(ikcpcb *kcp, int count) {
+  struct IKCPSTREAM *streams = NULL;
+  int i;
+  if (count < 1 || count > IKCP_STREAM_MAX) return -1;
+  // stream ids ride in PUSHX, like the large-message fragment counter
+  if (count > 1 && (kcp->stream != 0 || kcp->mss > 0xffff)) return -1;
+  if (kcp->nsnd_que > 0 || kcp->nrcv_que > 0 || kcp->nrcv_buf > 0) return -2;
+  if (count > 1) {
+    streams = (struct IKCPSTREAM *)ikcp_malloc(sizeof(struct IKCPSTREAM) * count);
+    if (streams == NULL) return -2;
+    for (i = 0; i < count; i++) {
+      struct IKCPSTREAM *st = &streams[i];
+      iqueue_init(&st->snd_queue);
+      iqueue_init(&st->rcv_queue);
+      st->nsnd_que = 0;
+      st->nrcv_que = 0;
+      st->nrcv_partial = 0;
+      st->prio = (IUINT32)i;
+      st->weight = 1;
+      st->deficit = 0;
+      st->snd_split = 0;
+    }
+  }
+  if (kcp->streams) ikcp_free(kcp->streams);
+  kcp->streams = streams;
+  kcp->nstreams = (count > 1) ? (IUINT32)count : 0;
+  kcp->stream_rr = 0;
+  kcp->drop_chain = 0;
+  return 0;
+}
+
+int ikcp_stream_setprio(ikcpcb *kcp, int stream, int prio, int weight) {
+  if (stream < 0 || stream >= (int)ikcp_nstreams(kcp) || prio < 0 || weight < 1) return -1;
+  if (kcp->streams == NULL) return 0;
+  kcp->streams[stream].prio = (IUINT32)prio;
+  kcp->streams[stream].weight = (IUINT32)weight;
+  return 0;
+}
+
+int ikcp_setpacing(ikcpcb *kcp, int rate, int slots) {
+  struct IKCPPACER *pacer;
+  if (slots < 0 || slots == 1) return -1;
+  if (slots == 0) slots = IKCP_PACE_SLOTS;
+  if (kcp->pacer && rate >= 0 && kcp->pacer->slots == (IUINT32)slots) {
+    kcp->pacer->rate = (IUINT32)rate;
+    return 0;
+  }
+  pacer = NULL;
+  if (rate >= 0) {
+    pacer = ikcp_pace_new(kcp->mtu, (IUINT32)rate, (IUINT32)slots);
+    if (pacer == NULL) return -2;
+    pacer->ts = kcp->current;
+  }
+  if (kcp->pacer) {
+    ikcp_pace_emit(kcp, kcp->pacer->count);
+    ikcp_free(kcp->pacer);
+  }
+  kcp->pacer = pacer;
+  return 0;
+}
+
+int ikcp_setmtud(ikcpcb *kcp, int min, int max) {
+  struct IKCPMTUD *md = &kcp->mtud;
+  char *buffer;
+  int ret;
+  if (max == 0) {
+    if (md->buffer) ikcp_free(md->buffer);
+    md->buffer = NULL;
+    md->max = 0;
+    md->probe = 0;
+    md->searching = 0;
+    return 0;
+  }
+  if (min < 50 || min < (int)IKCP_OVERHEAD || max < min) return -1;
+  if ((kcp->large_max || kcp->streams) && max - IKCP_OVERHEAD > 0xffff) return -1;
+  buffer = (char *)ikcp_malloc(max);
+  if (buffer == NULL) return -2;
+  if ((IUINT32)min != kcp->mtu) {
+    ret = ikcp_setmtu(kcp, min);
+    if (ret < 0) {
+      ikcp_free(buffer);
+      return ret;
+    }
   }
+  if (md->buffer) ikcp_free(md->buffer);
+  md->buffer = buffer;
+  md->max = (IUINT32)max;
+  md->probe = 0;
+  md->tries = 0;
+  md->searching = 0;
+  md->next_ts = kcp->current;
+  return 0;
+}
+
+int ikcp_setack(ikcpcb *kcp, int delay, int count, int range) {
+  if (delay < 0 || count < 0) return -1;
+  kcp->ack_delay = (IUINT32)delay;
+  kcp->ack_max = (IUINT32)count;
+  kcp->ack_range = range ? 1 : 0;
   return 0;
 }
 
 int ikcp_waitsnd(const ikcpcb *kcp) { return kcp->nsnd_buf + kcp->nsnd_que; }
 
+int ikcp_pool_enable(ikcpcb *kcp, int slab_blocks, int max_slabs) {
+  struct IKCPPOOL *pool;
+  if (kcp->pool) return 0;
+  pool = (struct IKCPPOOL *)ikcp_malloc(sizeof(struct IKCPPOOL));
+  if (pool == NULL) return -2;
+  pool->slab_blocks = (slab_blocks > 0) ? (IUINT32)slab_blocks : IKCP_POOL_SLAB_BLOCKS;
+  pool->max_slabs = (max_slabs > 0) ? (IUINT32)max_slabs : IKCP_POOL_MAX_SLABS;
+  pool->hits = 0;
+  pool->misses = 0;
+  pool->full = IKCP_POOL_FULL;
+  pool->mss = kcp->mss;
+  ikcp_pool_class_init(&pool->cls[IKCP_POOL_SMALL], _imin_(IKCP_POOL_SMALL_SIZE, kcp->mss));
+  ikcp_pool_class_init(&pool->cls[IKCP_POOL_FULL], kcp->mss);
+  ikcp_pool_class_init(&pool->cls[IKCP_POOL_FULL + 1], 0);
+  kcp->pool = pool;
+  return 0;
+}
+
+void ikcp_pool_stat(const ikcpcb *kcp, IUINT32 *hits, IUINT32 *misses) {
+  if (hits) *hits = kcp->pool ? kcp->pool->hits : 0;
+  if (misses) *misses = kcp->pool ? kcp->pool->misses : 0;
+}
+
 // read conv
 IUINT32 ikcp_getconv(const void *ptr) {
   IUINT32 conv;
@@ -1269,4 +2813,10 @@ void ikcp_set_loss_period(ikcpcb *kcp, IUINT32 period_ms) { kcp->loss_period = p
 
 IUINT32 ikcp_get_rx_rate(const ikcpcb *kcp) { return kcp->rx_bytes_per_sec; }
 
-IUINT32 ikcp_get_tx_rate(const ikcpcb *kcp) { return kcp->tx_bytes_per_sec; }
\ No newline at end of file
+IUINT32 ikcp_get_tx_rate(const ikcpcb *kcp) { return kcp->tx_bytes_per_sec; }
+
+IUINT32 ikcp_get_pacing_rate(const ikcpcb *kcp) { return kcp->pacer ? kcp->pacer->rate_used : 0; }
+
+IUINT32 ikcp_get_pacing_queue(const ikcpcb *kcp) { return kcp->pacer ? kcp->pacer->count : 0; }
+
+IUINT32 ikcp_get_mtu(const ikcpcb *kcp) { return kcp->mtu; }
\ No newline at end of file
@@ -15,6 +15,7 @@
 #include <assert.h>
 #include <stddef.h>
 #include <stdlib.h>
+#include <sys/uio.h>
 
 //=====================================================================
 // 32BIT INTEGER DEFINITION
@@ -265,9 +266,109 @@ struct IKCPSEG {
   IUINT32 rto;
   IUINT32 fastack;
   IUINT32 xmit;
+  IUINT32 pool;  // size class the segment was carved from, IKCP_POOL_NONE for heap
+  IUINT32 delivered;     // kcp->delivered when the segment was last sent
+  IUINT32 delivered_ts;  // kcp->delivered_ts when the segment was last sent
+  IUINT32 deadline;      // ikcp_send_ex: dropped once 'current' reaches it
+  IUINT32 dclass;        // IKCP_DROP_*
+  IUINT32 stream;        // ikcp_setstreams stream the message belongs to
   char data[1];
 };
 
+//---------------------------------------------------------------------
+// SEGMENT POOL
+//---------------------------------------------------------------------
+#define IKCP_POOL_SMALL 0  // control / small payload segments
+#define IKCP_POOL_FULL 1   // full mss segments, slots 1 and 2 take turns
+#define IKCP_POOL_CLASS 3  // as the mss changes, see ikcp_setmtu
+#define IKCP_POOL_NONE 0xff
+
+struct IKCPPOOLCLASS {
+  IUINT32 capacity;  // payload bytes each block can hold
+  IUINT32 blksize;   // bytes per block, header included
+  IUINT32 nslab;     // slabs allocated so far
+  IUINT32 inuse;     // blocks handed out and not back yet
+  void *free_list;   // free blocks, linked through their first word
+  void *slabs;       // allocated slabs, linked through their first word
+};
+
+struct IKCPPOOL {
+  struct IKCPPOOLCLASS cls[IKCP_POOL_CLASS];
+  IUINT32 slab_blocks;  // blocks carved from one slab
+  IUINT32 max_slabs;    // upper bound of slabs per class
+  IUINT32 full;         // slot serving full segments, the other one drains
+  IUINT32 mss;          // capacity the full slot should have
+  IUINT32 hits;         // segments served from the pool
+  IUINT32 misses;       // segments that fell back to ikcp_malloc
+};
+
+//---------------------------------------------------------------------
+// PACER: datagrams of ikcp_flush waiting for the token bucket
+//---------------------------------------------------------------------
+#define IKCP_PACE_SLOTS 64
+
+struct IKCPPACER {
+  IUINT32 rate;       // configured bytes/sec, 0 to follow the estimate
+  IUINT32 rate_used;  // rate of the last release, 0 without an estimate
+  IUINT32 slots;      // datagrams the queue holds
+  IUINT32 head;       // slot of the oldest queued datagram
+  IUINT32 count;      // datagrams queued
+  IUINT32 queued;     // bytes queued
+  IUINT32 ts;         // last token refill
+  IINT32 tokens;      // bytes that may leave now, negative after a burst
+  int backlog;        // datagrams were left queued by the last release
+  IUINT32 *len;       // datagram size of each slot
+  char *buffer;       // 'slots' datagrams of (mtu + IKCP_OVERHEAD) bytes
+};
+
+//---------------------------------------------------------------------
+// MTUD: path mtu discovery with padded probes, see ikcp_setmtud
+//---------------------------------------------------------------------
+struct IKCPMTUD {
+  IUINT32 max;        // largest mtu searched for, 0 if discovery is off
+  IUINT32 lo;         // largest mtu a probe got through with
+  IUINT32 hi;         // largest mtu not ruled out yet
+  IUINT32 probe;      // size being probed, 0 between probes
+  IUINT32 probe_ts;   // when the last probe of that size left
+  IUINT32 tries;      // probes of that size sent
+  IUINT32 next_ts;    // when the next search starts
+  int searching;
+  IUINT32 ack;        // size of a remote probe to answer in the next flush, 0 if none
+  IUINT32 ack_ts;     // ts of that probe
+  char *buffer;       // 'max' bytes probes are built in
+};
+
+//---------------------------------------------------------------------
+// CONGESTION CONTROL
+//---------------------------------------------------------------------
+#define IKCP_CC_LOSS_FAST 1  // fast retransmit after 'resend' skipped acks
+#define IKCP_CC_LOSS_RTO 2   // retransmission timeout
+
+struct IKCPCB;
+
+// what one ikcp_input acknowledged, handed to on_ack
+struct IKCPCCSAMPLE {
+  IUINT32 acked;            // segments acked, by ack or una
+  IUINT32 acked_bytes;      // wire bytes of those segments
+  IUINT32 delivered;        // wire bytes delivered since create
+  IUINT32 prior_delivered;  // 'delivered' when the latest sent acked segment left
+  IUINT32 interval;         // millisec the delivery rate was measured over
+  IUINT32 rate;             // delivery rate in bytes/sec, 0 without a sample
+  IINT32 rtt;               // latest rtt sample in millisec, -1 without
+  IUINT32 inflight;         // segments still in flight
+  int una_moved;            // snd_una advanced
+};
+
+struct IKCPCC {
+  const char *name;
+  int (*init)(struct IKCPCB *kcp);      // optional, may set kcp->cc_state
+  void (*release)(struct IKCPCB *kcp);  // optional, frees kcp->cc_state
+  void (*on_ack)(struct IKCPCB *kcp, const struct IKCPCCSAMPLE *rs);
+  void (*on_loss)(struct IKCPCB *kcp, int event, IUINT32 inflight);
+  IUINT32 (*cwnd)(const struct IKCPCB *kcp);         // segments allowed in flight
+  IUINT32 (*pacing_rate)(const struct IKCPCB *kcp);  // bytes/sec, 0 for unpaced
+};
+
 //---------------------------------------------------------------------
 // IKCPCB
 //---------------------------------------------------------------------
@@ -305,18 +406,79 @@ struct IKCPCB {
   IUINT32 *acklist;
   IUINT32 ackcount;
   IUINT32 ackblock;
+  IUINT32 ack_delay;            // millisec an ack may wait for more, 0 acks in every flush
+  IUINT32 ack_max;              // pending acks that go out at once, 0 for no limit
+  int ack_range;                // acks go out as IKCP_CMD_RACK runs, see ikcp_setack
+  IUINT32 ack_since;            // when the oldest pending ack was pushed
+  int ack_now;                  // a pending ack must not wait: data out of order, a hole filled or a duplicate
   void *user;
   char *buffer;
   int fastresend;
   int fastlimit;
   int nocwnd, stream;
   int logmask;
+  struct IKCPPOOL *pool;
+  struct IKCPPACER *pacer;      // NULL unless ikcp_setpacing
+  struct IKCPMTUD mtud;
+  IUINT32 ring_size;            // slots of the sequence index (power of 2), 0 if disabled
+  IUINT32 fack_marks;           // fastack marks not yet applied to snd_buf
+  struct IKCPSEG **snd_ring;    // snd_buf segments indexed by sn & (ring_size - 1)
+  struct IKCPSEG **rcv_ring;    // rcv_buf segments indexed by sn & (ring_size - 1)
+  IUINT32 *fack_ring;           // pending fastack marks indexed like snd_ring
+  IUINT32 batch_max;       // datagrams collected before output_batch is invoked
+  IUINT32 batch_count;     // datagrams pending in batch_iov
+  char *batch_buffer;      // batch_max slots of (mtu + IKCP_OVERHEAD) bytes
+  struct iovec *batch_iov;
+  const struct IKCPCC *cc;      // congestion control, see ikcp_setcc
+  void *cc_state;
+  struct IKCPCCSAMPLE cc_rs;    // sample collected by the running ikcp_input
+  IUINT32 delivered;            // wire bytes acked since create
+  IUINT32 delivered_ts;         // when 'delivered' last grew
+  IUINT32 pace_ts;              // last refill of pace_credit
+  IINT32 pace_credit;           // bytes new segments may still take at pacing_rate
+  IUINT32 large_max;            // largest message in large-message mode, 0 if off
+  IUINT32 nrcv_partial;         // rcv_queue segments of a message not complete yet
+  IUINT32 drop_next;            // earliest deadline of a droppable segment still queued
+  int drop_pending;             // droppable segments are queued, check drop_next
+  IUINT32 drop_chain;           // streams whose last IKCP_DROP_CHAIN message was dropped (bit mask)
+  int snd_split;                // the last segment moved to snd_buf ended mid-message
+  IUINT32 snd_dropped;          // messages dropped by ikcp_send_ex deadlines
+  IUINT32 rcv_skipped;          // messages the remote dropped and this side skipped
+  struct IKCPSTREAM *streams;   // per-stream queues, NULL unless ikcp_setstreams
+  IUINT32 nstreams;
+  IUINT32 stream_rr;            // stream the deficit round robin is at
   int (*output)(const char *buf, int len, struct IKCPCB *kcp, void *user);
+  int (*output_batch)(const struct iovec *iov, int count, struct IKCPCB *kcp, void *user);
   void (*writelog)(const char *log, struct IKCPCB *kcp, void *user);
 };
 
 typedef struct IKCPCB ikcpcb;
 
+//---------------------------------------------------------------------
+// STREAM: one of the ikcp_setstreams queues sharing a conversation
+//---------------------------------------------------------------------
+#define IKCP_STREAM_MAX 16
+
+struct IKCPSTREAM {
+  struct IQUEUEHEAD snd_queue;
+  struct IQUEUEHEAD rcv_queue;
+  IUINT32 nsnd_que;
+  IUINT32 nrcv_que;
+  IUINT32 nrcv_partial;  // rcv_queue segments of a message not complete yet
+  IUINT32 prio;          // 0 is the most urgent level
+  IUINT32 weight;        // share of the bytes sent inside its level
+  IINT32 deficit;        // bytes it may still move this round
+  int snd_split;         // its last segment moved to snd_buf ended mid-message
+};
+
+// drop classes of ikcp_send_ex
+#define IKCP_DROP_NEVER 0  // reliable, the deadline is ignored
+#define IKCP_DROP_SELF 1   // dropped alone once it expires
+#define IKCP_DROP_CHAIN 2  // dropped with the later chain messages depending on it
+
+// see ikcp_recv_direct
+typedef char *(*ikcp_recv_request_t)(const char *head, int headlen, int size, void *user);
+
 #define IKCP_LOG_OUTPUT 1
 #define IKCP_LOG_INPUT 2
 #define IKCP_LOG_SEND 4
@@ -349,12 +511,67 @@ void ikcp_release(ikcpcb *kcp);
 // set output callback, which will be invoked by kcp
 void ikcp_setoutput(ikcpcb *kcp, int (*output)(const char *buf, int len, ikcpcb *kcp, void *user));
 
+// set batched output callback: ikcp_flush collects up to 'max_batch'
+// datagrams and hands them over in one call (eg. to sendmmsg). pass
+// NULL to go back to the per-datagram 'output' callback.
+int ikcp_setoutput_batch(ikcpcb *kcp, int (*output_batch)(const struct iovec *iov, int count, ikcpcb *kcp, void *user),
+                         int max_batch);
+
 // user/upper level recv: returns size, returns below zero for EAGAIN
 int ikcp_recv(ikcpcb *kcp, char *buffer, int len);
 
 // user/upper level send, returns below zero for error
 int ikcp_send(ikcpcb *kcp, const char *buffer, int len);
 
+// partially reliable send for media that goes stale: if the message is
+// not delivered within 'ttl' millisec (of the 'current' clock given to
+// ikcp_update) it is dropped from snd_queue/snd_buf, and the remote is
+// told to skip it. with IKCP_DROP_CHAIN the later chain messages go with
+// it, up to the next message of another class (eg. an I-frame after
+// P-frames), and new chain messages are refused with -3 until then.
+// not available in stream mode.
+int ikcp_send_ex(ikcpcb *kcp, const char *buffer, int len, IUINT32 ttl, int dclass);
+
+// split the conversation into 'count' independent message streams (at
+// most IKCP_STREAM_MAX, 1 goes back to one): each has its own queues,
+// so a big video frame queued on one stream does not hold back control
+// or audio messages of another. both ends need the same count, and it
+// can only change while nothing is queued. not available in stream mode.
+// stream 'n' starts at priority level 'n' with weight 1.
+int ikcp_setstreams(ikcpcb *kcp, int count);
+
+// ikcp_flush moves segments of the lowest 'prio' level first, always;
+// streams of the same level share the bytes sent by 'weight'. streams
+// above level 0 also leave 1/8 of the window to level 0 streams.
+int ikcp_stream_setprio(ikcpcb *kcp, int stream, int prio, int weight);
+
+// ikcp_send_ex on one stream ('ttl' 0 with IKCP_DROP_NEVER for reliable)
+int ikcp_send_stream(ikcpcb *kcp, int stream, const char *buffer, int len, IUINT32 ttl, int dclass);
+
+// ikcp_sendv on one stream, same arguments and results as ikcp_send_stream
+int ikcp_sendv_stream(ikcpcb *kcp, int stream, const struct iovec *iov, int cnt, IUINT32 ttl, int dclass);
+
+// ikcp_recv that also tells the stream of the message ('stream' can be
+// NULL). complete messages of lower stream numbers come out first.
+int ikcp_recv_stream(ikcpcb *kcp, int *stream, char *buffer, int len);
+
+// messages dropped by ikcp_send_ex / dropped by the remote and skipped
+// here, any pointer can be NULL
+void ikcp_drop_stat(const ikcpcb *kcp, IUINT32 *dropped, IUINT32 *skipped);
+
+// gather send: one message made of 'cnt' buffers (eg. a frame header
+// and a payload still in its ring buffer), fragmented straight into
+// segments without assembling it first. same results as ikcp_send
+int ikcp_sendv(ikcpcb *kcp, const struct iovec *iov, int cnt);
+
+// fill send: a 'len' bytes message produced straight into the segments,
+// 'fill' is called in order with each segment's 'data' and must write
+// exactly 'size' bytes (eg. encrypt a ring buffer chunk in place of a
+// copy). if it writes less, nothing of the message is queued and -4 is
+// returned. otherwise same results as ikcp_send
+typedef int (*ikcp_send_fill_t)(char *data, int size, void *user);
+int ikcp_send_fill(ikcpcb *kcp, int len, ikcp_send_fill_t fill, void *user);
+
 // update state (call it repeatedly, every 10ms-100ms), or you can ask
 // ikcp_check when to call it again (without ikcp_input/_send calling).
 // 'current' - current timestamp in millisec.
@@ -378,12 +595,65 @@ void ikcp_flush(ikcpcb *kcp);
 // check the size of next message in the recv queue
 int ikcp_peeksize(const ikcpcb *kcp);
 
-// change MTU size, default is 1400
+// direct receive: 'request' gets the first fragment of the next message
+// and its total size, and returns where to reassemble it, eg. a slot
+// from CRingBuf::RequestWriteFrame that the caller commits once this
+// returns the size. returns -1/-2 like ikcp_recv, -4 if 'request'
+// returned NULL; the message then stays queued.
+int ikcp_recv_direct(ikcpcb *kcp, ikcp_recv_request_t request, void *user);
+
+// change MTU size, default is 1400. returns -3 for a smaller mtu while
+// segments cut for the old one are still queued or in flight.
 int ikcp_setmtu(ikcpcb *kcp, int mtu);
 
+// path mtu discovery: the mtu drops to 'min', a size any path carries,
+// and padded probes binary search up to 'max' (both datagram sizes).
+// a size is ruled out after 3 unanswered probes, the largest one that
+// got through is applied with ikcp_setmtu once the search settles, and
+// a new search for a larger mtu starts every 10 minutes. a smaller path
+// mtu is not detected mid-session. the remote answers probes whether or
+// not it searches itself, older peers drop them and the mtu stays 'min'.
+// the socket has to set DF (IP_PMTUDISC_PROBE) or probes get fragmented.
+// 'max' 0 turns it off and leaves the mtu where it is.
+int ikcp_setmtud(ikcpcb *kcp, int min, int max);
+
+// ack policy: acks wait up to 'delay' millisec or until 'count' of them
+// are pending, so fewer and fuller datagrams carry them. ikcp_check
+// wakes up for them and ikcp_update sends them between intervals. data
+// out of order, data that fills a hole and duplicates are acked at
+// once, so fast retransmit and loss recovery do not wait. acks echo the
+// ts they acknowledge, the wait shows in the remote srtt, but keep
+// 'delay' below the remote min rto or it resends early. 'range' 1
+// sends the acks of a flush as IKCP_CMD_RACK: sorted runs of sn, 6
+// bytes each, leaving out those below una, which already covers them.
+// older peers reject IKCP_CMD_RACK, acks of either kind are always
+// understood. 0, 0, 0 acks every sn in the next flush.
+int ikcp_setack(ikcpcb *kcp, int delay, int count, int range);
+
 // set maximum window size: sndwnd=32, rcvwnd=32 by default
 int ikcp_wndsize(ikcpcb *kcp, int sndwnd, int rcvwnd);
 
+// index snd_buf/rcv_buf by sequence number, which makes ack marking and
+// out-of-order insertion O(1) instead of O(window). worth it for windows
+// of a few hundred segments and more. enable: 1 on, 0 back to the lists.
+int ikcp_wndindex(ikcpcb *kcp, int enable);
+
+// large-message mode: messages up to 'max_bytes' go through as one
+// message instead of failing at 128 fragments. both ends have to turn
+// it on, fragments past the 255th use a command older peers reject.
+// the receive queue holds at most one message in progress per stream
+// on top of rcv_wnd. 0 turns it off.
+int ikcp_setlarge(ikcpcb *kcp, int max_bytes);
+
+// pace what ikcp_flush outputs: datagrams wait in a queue of 'slots'
+// (0 for IKCP_PACE_SLOTS) and leave through a token bucket at 'rate'
+// bytes/sec, or if 'rate' is 0 at the congestion control pacing rate,
+// falling back to 5/4 of the window per srtt. ikcp_check then wakes up
+// for the next datagram, not the next interval, so schedule ikcp_update
+// with it. a full queue lets its oldest datagram go early. works with
+// either output callback. 'rate' < 0 turns pacing off.
+int ikcp_setpacing(ikcpcb *kcp, int rate, int slots);
+
 // get how many packet is waiting to be sent
 int ikcp_waitsnd(const ikcpcb *kcp);
 
@@ -394,11 +664,32 @@ int ikcp_waitsnd(const ikcpcb *kcp);
 // nc: 0:normal congestion control(default), 1:disable congestion control
 int ikcp_nodelay(ikcpcb *kcp, int nodelay, int interval, int resend, int nc);
 
+// built-in congestion control: classic cwnd/ssthresh (nc=0), none (nc=1),
+// and delivery rate / min rtt based (see ikcp_bbr.c)
+extern const struct IKCPCC ikcp_cc_reno;
+extern const struct IKCPCC ikcp_cc_none;
+extern const struct IKCPCC ikcp_cc_bbr;
+
+// switch congestion control, NULL restores the one picked by 'nc'.
+// 'nc' of a later ikcp_nodelay only switches between reno and none.
+int ikcp_setcc(ikcpcb *kcp, const struct IKCPCC *cc);
+
 void ikcp_log(ikcpcb *kcp, int mask, const char *fmt, ...);
 
 // setup allocator
 void ikcp_allocator(void *(*new_malloc)(size_t), void (*new_free)(void *));
 
+// enable the per-kcp segment pool, 'slab_blocks' segments are carved
+// from one allocation and each size class grows up to 'max_slabs' slabs.
+// pass 0 to use the defaults (32 blocks, 8 slabs). the full class
+// follows the mss: after ikcp_setmtu (or path mtu discovery) new full
+// segments come from a fresh class, and the old one is freed once its
+// segments are all back.
+int ikcp_pool_enable(ikcpcb *kcp, int slab_blocks, int max_slabs);
+
+// read pool counters, any pointer can be NULL
+void ikcp_pool_stat(const ikcpcb *kcp, IUINT32 *hits, IUINT32 *misses);
+
 // read conv
 IUINT32 ikcp_getconv(const void *ptr);
 
@@ -417,6 +708,15 @@ IUINT32 ikcp_get_rx_rate(const ikcpcb *kcp);
 // 获取发送速率
 IUINT32 ikcp_get_tx_rate(const ikcpcb *kcp);
 
+// 获取当前节拍发送速率（字节/秒），未开启或尚无估计时为0
+IUINT32 ikcp_get_pacing_rate(const ikcpcb *kcp);
+
+// 获取节拍队列中等待发出的报文数
+IUINT32 ikcp_get_pacing_queue(const ikcpcb *kcp);
+
+// 获取当前mtu，开启路径MTU探测后会在运行时变大
+IUINT32 ikcp_get_mtu(const ikcpcb *kcp);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,291 @@
+//=====================================================================
+//
+// ikcp_bbr.c - delivery rate / min rtt based congestion control
+//
+// a BBR style model for ikcp_setcc(kcp, &ikcp_cc_bbr): the bottleneck
+// bandwidth is the windowed max of the delivery rate samples, the
+// propagation delay the windowed min of the rtt samples, and kcp sends
+// at gain * bandwidth while keeping about two bdp in flight. loss is
+// not taken as a congestion signal, so a lossy wifi link keeps its
+// throughput and the queue of the bottleneck stays short.
+//
+//=====================================================================
+#include <stdlib.h>
+#include <string.h>
+
+#include "ikcp.h"
+
+#define BBR_UNIT 256
+#define BBR_HIGH_GAIN (BBR_UNIT * 2885 / 1000 + 1)  // 2/ln(2), doubles the rate each round
+#define BBR_DRAIN_GAIN (BBR_UNIT * 1000 / 2885)
+#define BBR_CWND_GAIN (BBR_UNIT * 2)
+#define BBR_BW_ROUNDS 10          // rounds of the max bandwidth filter
+#define BBR_MIN_RTT_WIN 10000     // millisec the min rtt sample stays valid
+#define BBR_PROBE_RTT_TIME 200    // millisec spent with a minimal window
+#define BBR_FULL_BW_THRESH (BBR_UNIT * 5 / 4)
+#define BBR_FULL_BW_ROUNDS 3
+#define BBR_MIN_CWND 4
+#define BBR_INIT_CWND 10
+#define BBR_CYCLE_LEN 8
+
+enum { BBR_STARTUP, BBR_DRAIN, BBR_PROBE_BW, BBR_PROBE_RTT };
+
+static const IUINT32 bbr_pacing_gain[BBR_CYCLE_LEN] = {
+    BBR_UNIT * 5 / 4, BBR_UNIT * 3 / 4, BBR_UNIT, BBR_UNIT, BBR_UNIT, BBR_UNIT, BBR_UNIT, BBR_UNIT};
+
+struct bbr_sample {
+  IUINT32 round;
+  IUINT32 value;
+};
+
+typedef struct ikcp_bbr {
+  int mode;
+  struct bbr_sample bw[3];  // best, 2nd and 3rd best of the max filter
+  IUINT32 min_rtt;          // millisec, 0xffffffff until sampled
+  IUINT32 min_rtt_ts;
+  IUINT32 round_count;
+  IUINT32 next_round_delivered;
+  int round_start;
+  IUINT32 full_bw;
+  int full_bw_count;
+  int full_bw_reached;
+  int cycle_index;
+  IUINT32 cycle_ts;
+  IUINT32 probe_rtt_done_ts;  // 0 until inflight dropped to the minimum
+  IUINT32 probe_rtt_round;
+  IUINT32 pacing_gain;
+  IUINT32 cwnd_gain;
+  IUINT32 cwnd;
+  IUINT32 prior_cwnd;  // window saved across probe rtt and timeouts
+  IUINT32 recovery_round;
+  int in_recovery;
+} ikcp_bbr;
+
+static inline IINT32 bbr_diff(IUINT32 later, IUINT32 earlier) { return (IINT32)(later - earlier); }
+
+static inline IUINT32 _bbr_min(IUINT32 a, IUINT32 b) { return a <= b ? a : b; }
+
+static inline IUINT32 _bbr_max(IUINT32 a, IUINT32 b) { return a >= b ? a : b; }
+
+// windowed max filter over the last BBR_BW_ROUNDS rounds, kept as the
+// best three samples like the kernel's win_minmax
+static IUINT32 bbr_max_update(struct bbr_sample *m, IUINT32 round, IUINT32 value) {
+  struct bbr_sample val = {round, value};
+
+  if (value >= m[0].value || round - m[2].round > BBR_BW_ROUNDS) {
+    m[0] = m[1] = m[2] = val;
+    return m[0].value;
+  }
+  if (value >= m[1].value) {
+    m[1] = m[2] = val;
+  } else if (value >= m[2].value) {
+    m[2] = val;
+  }
+
+  if (round - m[0].round > BBR_BW_ROUNDS) {
+    m[0] = m[1];
+    m[1] = m[2];
+    m[2] = val;
+    if (round - m[0].round > BBR_BW_ROUNDS) {
+      m[0] = m[1];
+      m[1] = m[2];
+    }
+  } else if (m[1].round == m[0].round && round - m[1].round > BBR_BW_ROUNDS / 4) {
+    m[1] = m[2] = val;
+  } else if (m[2].round == m[1].round && round - m[2].round > BBR_BW_ROUNDS / 2) {
+    m[2] = val;
+  }
+  return m[0].value;
+}
+
+static IUINT32 bbr_bw(const ikcp_bbr *bbr) { return bbr->bw[0].value; }
+
+// segments for 'gain' times the estimated bdp. kcp acks only go out on
+// a flush, so one interval of data is added on top of the pipe
+static IUINT32 bbr_target_cwnd(const ikcpcb *kcp, const ikcp_bbr *bbr, IUINT32 gain) {
+  IUINT64 bytes;
+  IUINT32 cwnd;
+  if (bbr->min_rtt == 0xffffffff || bbr_bw(bbr) == 0) return BBR_INIT_CWND;
+  bytes = (IUINT64)bbr_bw(bbr) * (bbr->min_rtt + kcp->interval) / 1000;
+  cwnd = (IUINT32)(bytes * gain / BBR_UNIT / kcp->mtu) + 2;
+  return cwnd < BBR_MIN_CWND ? BBR_MIN_CWND : cwnd;
+}
+
+static IUINT32 bbr_inflight_bytes(const ikcpcb *kcp, const struct IKCPCCSAMPLE *rs) { return rs->inflight * kcp->mtu; }
+
+static void bbr_enter_probe_bw(ikcp_bbr *bbr, IUINT32 current) {
+  bbr->mode = BBR_PROBE_BW;
+  bbr->cwnd_gain = BBR_CWND_GAIN;
+  // start anywhere but the drain phase of the cycle
+  bbr->cycle_index = BBR_CYCLE_LEN - 1 - (rand() % (BBR_CYCLE_LEN - 1));
+  bbr->pacing_gain = bbr_pacing_gain[bbr->cycle_index];
+  bbr->cycle_ts = current;
+}
+
+static void bbr_update_round(ikcp_bbr *bbr, const struct IKCPCCSAMPLE *rs) {
+  bbr->round_start = 0;
+  if (rs->acked > 0 && bbr_diff(rs->prior_delivered, bbr->next_round_delivered) >= 0) {
+    bbr->next_round_delivered = rs->delivered;
+    bbr->round_count++;
+    bbr->round_start = 1;
+  }
+}
+
+static void bbr_update_bw(ikcp_bbr *bbr, const struct IKCPCCSAMPLE *rs) {
+  if (rs->rate == 0) return;
+  // a sample shorter than the min rtt comes from ack compression
+  if (bbr->min_rtt != 0xffffffff && rs->interval < bbr->min_rtt && rs->rate > bbr_bw(bbr)) return;
+  bbr_max_update(bbr->bw, bbr->round_count, rs->rate);
+}
+
+static void bbr_check_full_bw(ikcp_bbr *bbr) {
+  if (bbr->full_bw_reached || !bbr->round_start) return;
+  if ((IUINT64)bbr_bw(bbr) * BBR_UNIT >= (IUINT64)bbr->full_bw * BBR_FULL_BW_THRESH) {
+    bbr->full_bw = bbr_bw(bbr);
+    bbr->full_bw_count = 0;
+    return;
+  }
+  if (++bbr->full_bw_count >= BBR_FULL_BW_ROUNDS) bbr->full_bw_reached = 1;
+}
+
+static void bbr_update_cycle(ikcpcb *kcp, ikcp_bbr *bbr, const struct IKCPCCSAMPLE *rs) {
+  IUINT32 inflight = bbr_inflight_bytes(kcp, rs);
+  IUINT64 bdp;
+  int next;
+
+  if (bbr->mode != BBR_PROBE_BW || bbr->min_rtt == 0xffffffff) return;
+  bdp = (IUINT64)bbr_bw(bbr) * bbr->min_rtt / 1000;
+  next = bbr_diff(kcp->current, bbr->cycle_ts) > (IINT32)bbr->min_rtt;
+  // stay probing until the extra data is actually in flight, leave
+  // the drain phase as soon as the queue it built is gone
+  if (bbr->pacing_gain > BBR_UNIT && inflight < bdp * bbr->pacing_gain / BBR_UNIT && rs->inflight > 0) next = 0;
+  if (bbr->pacing_gain < BBR_UNIT && inflight <= bdp) next = 1;
+  if (next) {
+    bbr->cycle_index = (bbr->cycle_index + 1) % BBR_CYCLE_LEN;
+    bbr->pacing_gain = bbr_pacing_gain[bbr->cycle_index];
+    bbr->cycle_ts = kcp->current;
+  }
+}
+
+static void bbr_update_mode(ikcpcb *kcp, ikcp_bbr *bbr, const struct IKCPCCSAMPLE *rs) {
+  if (bbr->mode == BBR_STARTUP && bbr->full_bw_reached) {
+    bbr->mode = BBR_DRAIN;
+    bbr->pacing_gain = BBR_DRAIN_GAIN;
+    bbr->cwnd_gain = BBR_HIGH_GAIN;
+  }
+  if (bbr->mode == BBR_DRAIN && rs->inflight <= bbr_target_cwnd(kcp, bbr, BBR_UNIT)) {
+    bbr_enter_probe_bw(bbr, kcp->current);
+  }
+}
+
+static void bbr_update_min_rtt(ikcpcb *kcp, ikcp_bbr *bbr, const struct IKCPCCSAMPLE *rs) {
+  int expired = bbr->min_rtt != 0xffffffff && bbr_diff(kcp->current, bbr->min_rtt_ts) > BBR_MIN_RTT_WIN;
+
+  if (rs->rtt >= 0 && ((IUINT32)rs->rtt <= bbr->min_rtt || expired)) {
+    bbr->min_rtt = (IUINT32)rs->rtt;
+    bbr->min_rtt_ts = kcp->current;
+  }
+
+  if (expired && bbr->mode != BBR_PROBE_RTT) {
+    bbr->mode = BBR_PROBE_RTT;
+    bbr->pacing_gain = BBR_UNIT;
+    bbr->cwnd_gain = BBR_UNIT;
+    bbr->prior_cwnd = _bbr_max(bbr->prior_cwnd, bbr->cwnd);
+    bbr->probe_rtt_done_ts = 0;
+  }
+
+  if (bbr->mode != BBR_PROBE_RTT) return;
+
+  if (bbr->probe_rtt_done_ts == 0 && rs->inflight <= BBR_MIN_CWND) {
+    bbr->probe_rtt_done_ts = kcp->current + BBR_PROBE_RTT_TIME;
+    bbr->probe_rtt_round = bbr->round_count;
+    if (bbr->probe_rtt_done_ts == 0) bbr->probe_rtt_done_ts = 1;
+  } else if (bbr->probe_rtt_done_ts != 0 && bbr->round_count != bbr->probe_rtt_round &&
+             bbr_diff(kcp->current, bbr->probe_rtt_done_ts) >= 0) {
+    bbr->min_rtt_ts = kcp->current;
+    bbr->cwnd = _bbr_max(bbr->cwnd, bbr->prior_cwnd);
+    bbr->prior_cwnd = 0;
+    if (bbr->full_bw_reached) {
+      bbr_enter_probe_bw(bbr, kcp->current);
+    } else {
+      bbr->mode = BBR_STARTUP;
+      bbr->pacing_gain = BBR_HIGH_GAIN;
+      bbr->cwnd_gain = BBR_HIGH_GAIN;
+    }
+  }
+}
+
+static void bbr_update_cwnd(ikcpcb *kcp, ikcp_bbr *bbr, const struct IKCPCCSAMPLE *rs) {
+  IUINT32 target = bbr_target_cwnd(kcp, bbr, bbr->cwnd_gain);
+
+  if (bbr->in_recovery && bbr->round_count != bbr->recovery_round) {
+    // a round after the timeout, go back to the window before it
+    bbr->in_recovery = 0;
+    bbr->cwnd = _bbr_max(bbr->cwnd, bbr->prior_cwnd);
+    bbr->prior_cwnd = 0;
+  }
+
+  // grow by what was acked, before the pipe is full without a cap
+  if (bbr->full_bw_reached) {
+    bbr->cwnd = _bbr_min(bbr->cwnd + rs->acked, target);
+  } else {
+    bbr->cwnd += rs->acked;
+  }
+  if (bbr->cwnd < BBR_MIN_CWND) bbr->cwnd = BBR_MIN_CWND;
+  if (bbr->mode == BBR_PROBE_RTT) bbr->cwnd = _bbr_min(bbr->cwnd, BBR_MIN_CWND);
+}
+
+static int ikcp_bbr_init(ikcpcb *kcp) {
+  ikcp_bbr *bbr = (ikcp_bbr *)malloc(sizeof(ikcp_bbr));
+  if (bbr == NULL) return -1;
+  memset(bbr, 0, sizeof(ikcp_bbr));
+  bbr->mode = BBR_STARTUP;
+  bbr->min_rtt = 0xffffffff;
+  bbr->min_rtt_ts = kcp->current;
+  bbr->next_round_delivered = kcp->delivered;
+  bbr->pacing_gain = BBR_HIGH_GAIN;
+  bbr->cwnd_gain = BBR_HIGH_GAIN;
+  bbr->cwnd = BBR_INIT_CWND;
+  kcp->cc_state = bbr;
+  return 0;
+}
+
+static void ikcp_bbr_release(ikcpcb *kcp) {
+  free(kcp->cc_state);
+  kcp->cc_state = NULL;
+}
+
+static void ikcp_bbr_on_ack(ikcpcb *kcp, const struct IKCPCCSAMPLE *rs) {
+  ikcp_bbr *bbr = (ikcp_bbr *)kcp->cc_state;
+  bbr_update_round(bbr, rs);
+  bbr_update_bw(bbr, rs);
+  bbr_check_full_bw(bbr);
+  bbr_update_cycle(kcp, bbr, rs);
+  bbr_update_mode(kcp, bbr, rs);
+  bbr_update_min_rtt(kcp, bbr, rs);
+  bbr_update_cwnd(kcp, bbr, rs);
+}
+
+// only a timeout shrinks the window, and just for one round: the rate
+// model stays as it is since wifi loss is rarely caused by congestion
+static void ikcp_bbr_on_loss(ikcpcb *kcp, int event, IUINT32 inflight) {
+  ikcp_bbr *bbr = (ikcp_bbr *)kcp->cc_state;
+  if (event != IKCP_CC_LOSS_RTO || bbr->in_recovery) return;
+  bbr->in_recovery = 1;
+  bbr->recovery_round = bbr->round_count;
+  bbr->prior_cwnd = _bbr_max(bbr->prior_cwnd, bbr->cwnd);
+  bbr->cwnd = BBR_MIN_CWND;
+}
+
+static IUINT32 ikcp_bbr_cwnd(const ikcpcb *kcp) { return ((const ikcp_bbr *)kcp->cc_state)->cwnd; }
+
+static IUINT32 ikcp_bbr_pacing_rate(const ikcpcb *kcp) {
+  const ikcp_bbr *bbr = (const ikcp_bbr *)kcp->cc_state;
+  IUINT64 rate;
+  if (bbr_bw(bbr) == 0) return 0;  // no sample yet, the window alone limits
+  rate = (IUINT64)bbr_bw(bbr) * bbr->pacing_gain / BBR_UNIT;
+  return rate > 0xffffffff ? 0xffffffff : (IUINT32)rate;
+}
+
+const struct IKCPCC ikcp_cc_bbr = {"bbr",           ikcp_bbr_init,    ikcp_bbr_release,    ikcp_bbr_on_ack,
+                                   ikcp_bbr_on_loss, ikcp_bbr_cwnd, ikcp_bbr_pacing_rate};
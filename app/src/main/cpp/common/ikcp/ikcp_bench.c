@@ -0,0 +1,274 @@
+//=====================================================================
+//
+// ikcp_bench.c - host side micro benchmarks for ikcp
+//
+// build on a linux host:
+//   gcc -O2 -DIKCP_BENCH_MAIN ikcp.c ikcp_bbr.c ikcp_fec.c ikcp_bench.c
+//       -o ikcp_bench -lpthread
+//
+//=====================================================================
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ikcp.h"
+#include "ikcp_fec.h"
+
+#define BENCH_PAYLOAD 1000  // one data segment per datagram with the default mtu
+#define BENCH_ROUNDS 20
+
+typedef struct bench_link {
+  char *data;  // captured datagrams, 1500 bytes apart
+  int *len;
+  int count;
+  int capacity;
+} BenchLink;
+
+static long long bench_now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int bench_output(const char *buf, int len, ikcpcb *kcp, void *user) {
+  BenchLink *link = (BenchLink *)user;
+  if (link->count >= link->capacity) return -1;
+  memcpy(link->data + (size_t)link->count * 1500, buf, len);
+  link->len[link->count++] = len;
+  return 0;
+}
+
+static void bench_deliver(ikcpcb *kcp, BenchLink *link, int index) {
+  ikcp_input(kcp, link->data + (size_t)index * 1500, link->len[index]);
+}
+
+// one round: 'wnd' segments go out, all but the first reach the receiver
+// in reverse order, so the receive window sees worst case out-of-order
+// insertion and the sender sees acks far away from snd_una. the first
+// segment is delivered last to slide both windows.
+static void bench_window_round(ikcpcb *snd, ikcpcb *rcv, BenchLink *to_rcv, BenchLink *to_snd, int wnd,
+                               IUINT32 *current, long long *rcv_ns, long long *snd_ns) {
+  static char payload[BENCH_PAYLOAD];
+  char buffer[BENCH_PAYLOAD];
+  long long start;
+  int i;
+
+  to_rcv->count = 0;
+  to_snd->count = 0;
+  for (i = 0; i < wnd; i++) ikcp_send(snd, payload, sizeof(payload));
+  *current += 10;
+  ikcp_update(snd, *current);
+
+  start = bench_now_ns();
+  for (i = to_rcv->count - 1; i > 0; i--) bench_deliver(rcv, to_rcv, i);
+  *rcv_ns += bench_now_ns() - start;
+
+  *current += 10;
+  ikcp_update(rcv, *current);
+  start = bench_now_ns();
+  for (i = 0; i < to_snd->count; i++) bench_deliver(snd, to_snd, i);
+  *snd_ns += bench_now_ns() - start;
+
+  to_snd->count = 0;
+  bench_deliver(rcv, to_rcv, 0);
+  *current += 10;
+  ikcp_update(rcv, *current);
+  for (i = 0; i < to_snd->count; i++) bench_deliver(snd, to_snd, i);
+  while (ikcp_recv(rcv, buffer, sizeof(buffer)) > 0) {
+  }
+}
+
+static void bench_window(int wnd, int indexed) {
+  BenchLink to_rcv, to_snd;
+  ikcpcb *snd, *rcv;
+  IUINT32 current = 0;
+  long long rcv_ns = 0, snd_ns = 0;
+  int round;
+
+  to_rcv.capacity = to_snd.capacity = wnd * 2 + 16;
+  to_rcv.data = (char *)malloc((size_t)to_rcv.capacity * 1500);
+  to_snd.data = (char *)malloc((size_t)to_snd.capacity * 1500);
+  to_rcv.len = (int *)malloc(sizeof(int) * to_rcv.capacity);
+  to_snd.len = (int *)malloc(sizeof(int) * to_snd.capacity);
+  to_rcv.count = to_snd.count = 0;
+
+  snd = ikcp_create(0x12345678, &to_rcv);
+  rcv = ikcp_create(0x12345678, &to_snd);
+  snd->output = bench_output;
+  rcv->output = bench_output;
+  ikcp_nodelay(snd, 1, 10, 0, 1);
+  ikcp_nodelay(rcv, 1, 10, 0, 1);
+  ikcp_wndsize(snd, wnd, wnd);
+  ikcp_wndsize(rcv, wnd, wnd);
+  ikcp_wndindex(snd, indexed);
+  ikcp_wndindex(rcv, indexed);
+
+  for (round = 0; round < BENCH_ROUNDS; round++) {
+    bench_window_round(snd, rcv, &to_rcv, &to_snd, wnd, &current, &rcv_ns, &snd_ns);
+  }
+
+  printf("wnd=%-5d %-7s data in: %8.1f ns/seg   ack in: %8.1f ns/seg\n", wnd, indexed ? "indexed" : "list",
+         (double)rcv_ns / ((double)BENCH_ROUNDS * (wnd - 1)), (double)snd_ns / ((double)BENCH_ROUNDS * (wnd - 1)));
+
+  ikcp_release(snd);
+  ikcp_release(rcv);
+  free(to_rcv.data);
+  free(to_snd.data);
+  free(to_rcv.len);
+  free(to_snd.len);
+}
+
+// compare the linked list windows with ikcp_wndindex at 128/512/2048
+int ikcp_bench_window_main(void) {
+  static const int wnds[] = {128, 512, 2048};
+  int i;
+  for (i = 0; i < (int)(sizeof(wnds) / sizeof(wnds[0])); i++) {
+    bench_window(wnds[i], 0);
+    bench_window(wnds[i], 1);
+  }
+  return 0;
+}
+
+#define BENCH_FEC_PACKETS 20000
+#define BENCH_FEC_LEN 1200
+
+typedef struct bench_fec_link {
+  BenchLink shards;
+  ikcp_fec_decoder *dec;
+  unsigned char *seen;  // datagrams that reached the receiver, by sequence
+  IUINT32 rng;
+  int loss;   // percent
+  int burst;  // a loss drops this many shards in a row
+  int dropping;
+} BenchFecLink;
+
+static int bench_fec_capture(const char *buf, int len, void *user) {
+  return bench_output(buf, len, NULL, &((BenchFecLink *)user)->shards);
+}
+
+static int bench_fec_deliver(const char *buf, int len, void *user) {
+  BenchFecLink *link = (BenchFecLink *)user;
+  IUINT32 seq;
+  if (len < 8) return -1;
+  memcpy(&seq, buf + 4, 4);
+  if (seq < BENCH_FEC_PACKETS) link->seen[seq] = 1;
+  return 0;
+}
+
+static int bench_fec_lost(BenchFecLink *link) {
+  if (link->dropping > 0) {
+    link->dropping--;
+    return 1;
+  }
+  link->rng = link->rng * 1103515245u + 12345u;
+  if ((int)((link->rng >> 16) % 100) >= link->loss) return 0;
+  link->dropping = link->burst - 1;
+  return 1;
+}
+
+// pass BENCH_FEC_PACKETS datagrams through a lossy link, report the
+// share that neither arrived nor was rebuilt
+static void bench_fec_loss(int type, int data, int parity, int loss, int burst) {
+  BenchFecLink link;
+  ikcp_fec_encoder *enc = ikcp_fec_encoder_create(type, data, parity, BENCH_FEC_LEN);
+  char buffer[BENCH_FEC_LEN];
+  IUINT32 seq, missing = 0;
+  int i;
+
+  memset(&link, 0, sizeof(link));
+  link.shards.capacity = IKCP_FEC_MAX_SHARDS;
+  link.shards.data = (char *)malloc((size_t)link.shards.capacity * 1500);
+  link.shards.len = (int *)malloc(sizeof(int) * link.shards.capacity);
+  link.dec = ikcp_fec_decoder_create(BENCH_FEC_LEN);
+  link.seen = (unsigned char *)calloc(BENCH_FEC_PACKETS, 1);
+  link.rng = 0x2545f491;
+  link.loss = loss;
+  link.burst = burst;
+  memset(buffer, 0x5a, sizeof(buffer));
+
+  for (seq = 0; seq < BENCH_FEC_PACKETS; seq++) {
+    memcpy(buffer + 4, &seq, 4);
+    link.shards.count = 0;
+    ikcp_fec_encode(enc, buffer, BENCH_FEC_LEN - (int)(seq % 200), bench_fec_capture, &link);
+    for (i = 0; i < link.shards.count; i++) {
+      if (bench_fec_lost(&link)) continue;
+      ikcp_fec_decode(link.dec, link.shards.data + (size_t)i * 1500, link.shards.len[i], bench_fec_deliver, &link);
+    }
+  }
+  for (seq = 0; seq < BENCH_FEC_PACKETS; seq++) missing += !link.seen[seq];
+
+  printf("%s(%2d,%d) loss %2d%% burst %d: residual %6.2f%%\n", type == IKCP_FEC_XOR ? "xor" : "rs ", data, parity,
+         loss, burst, 100.0 * missing / BENCH_FEC_PACKETS);
+
+  ikcp_fec_encoder_release(enc);
+  ikcp_fec_decoder_release(link.dec);
+  free(link.shards.data);
+  free(link.shards.len);
+  free(link.seen);
+}
+
+// encode and decode speed, every group losing 'parity' data shards
+static void bench_fec_speed(int type, int data, int parity) {
+  BenchFecLink link;
+  ikcp_fec_encoder *enc = ikcp_fec_encoder_create(type, data, parity, BENCH_FEC_LEN);
+  char buffer[BENCH_FEC_LEN];
+  long long enc_ns = 0, dec_ns = 0, start;
+  IUINT32 seq;
+  int i;
+
+  memset(&link, 0, sizeof(link));
+  link.shards.capacity = IKCP_FEC_MAX_SHARDS;
+  link.shards.data = (char *)malloc((size_t)link.shards.capacity * 1500);
+  link.shards.len = (int *)malloc(sizeof(int) * link.shards.capacity);
+  link.dec = ikcp_fec_decoder_create(BENCH_FEC_LEN);
+  link.seen = (unsigned char *)calloc(BENCH_FEC_PACKETS, 1);
+  memset(buffer, 0x5a, sizeof(buffer));
+
+  for (seq = 0; seq < BENCH_FEC_PACKETS; seq++) {
+    memcpy(buffer + 4, &seq, 4);
+    start = bench_now_ns();
+    ikcp_fec_encode(enc, buffer, BENCH_FEC_LEN, bench_fec_capture, &link);
+    enc_ns += bench_now_ns() - start;
+    if (seq % data != (IUINT32)(data - 1)) continue;
+    // the group is complete: drop its first 'parity' data shards
+    start = bench_now_ns();
+    for (i = parity; i < link.shards.count; i++) {
+      ikcp_fec_decode(link.dec, link.shards.data + (size_t)i * 1500, link.shards.len[i], bench_fec_deliver, &link);
+    }
+    dec_ns += bench_now_ns() - start;
+    link.shards.count = 0;
+  }
+
+  printf("%s(%2d,%d) encode %8.1f MB/s   decode %8.1f MB/s\n", type == IKCP_FEC_XOR ? "xor" : "rs ", data,
+         parity, (double)BENCH_FEC_PACKETS * BENCH_FEC_LEN * 1000.0 / enc_ns,
+         (double)BENCH_FEC_PACKETS * BENCH_FEC_LEN * 1000.0 / dec_ns);
+
+  ikcp_fec_encoder_release(enc);
+  ikcp_fec_decoder_release(link.dec);
+  free(link.shards.data);
+  free(link.shards.len);
+  free(link.seen);
+}
+
+// fec speed and residual loss of xor(10,1), rs(10,3) and rs(20,5)
+int ikcp_bench_fec_main(void) {
+  static const int codes[][3] = {{IKCP_FEC_XOR, 10, 1}, {IKCP_FEC_RS, 10, 3}, {IKCP_FEC_RS, 20, 5}};
+  static const int losses[] = {1, 5, 10, 20};
+  int i, j;
+  for (i = 0; i < 3; i++) bench_fec_speed(codes[i][0], codes[i][1], codes[i][2]);
+  for (i = 0; i < 3; i++) {
+    for (j = 0; j < (int)(sizeof(losses) / sizeof(losses[0])); j++) {
+      bench_fec_loss(codes[i][0], codes[i][1], codes[i][2], losses[j], 1);
+    }
+    bench_fec_loss(codes[i][0], codes[i][1], codes[i][2], 5, 3);
+  }
+  return 0;
+}
+
+#ifdef IKCP_BENCH_MAIN
+int main(void) {
+  ikcp_bench_window_main();
+  return ikcp_bench_fec_main();
+}
+#endif
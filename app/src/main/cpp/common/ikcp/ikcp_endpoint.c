@@ -0,0 +1,577 @@
+//=====================================================================
+//
+// ikcp_endpoint.c - many kcp sessions sharing one udp socket
+//
+//=====================================================================
+#define _GNU_SOURCE
+#include "ikcp_endpoint.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define IKCP_ENDPOINT_HEAD 24  // kcp segment header, shorter datagrams are dropped
+#define IKCP_ENDPOINT_MAX_SESSIONS 0xffff
+#define IKCP_ENDPOINT_FEC_FLUSH 20  // ms a partial fec group waits before its parity goes out
+
+typedef struct IKCPSESSION {
+  ikcp_endpoint *ep;
+  ikcpcb *kcp;
+  void *user;
+  IUINT32 conv;
+  struct sockaddr_in peer;
+  ikcp_sched_node sched;
+  int next;        // next slot in the hash chain, or free list
+  int generation;  // bumped on close so stale handles are rejected
+  int used;
+  int touched;     // fed by the current ikcp_endpoint_input
+  ikcp_fec_encoder *fec_enc;  // set by ikcp_endpoint_setfec
+  ikcp_fec_decoder *fec_dec;  // created by the first shard received
+  IUINT32 fec_ts;             // kcp->current when the open fec group got its first shard
+} ikcp_session;
+
+struct IKCPENDPOINT {
+  int fd;
+  unsigned short port;
+  int started;  // wheel is based on the first update time
+  ikcp_sched wheel;
+  ikcp_session *sessions;
+  int max_sessions;
+  int free_head;
+  int *buckets;
+  IUINT32 bucket_mask;
+  ikcp_endpoint_accept_t accept;
+  void *accept_user;
+  IUINT32 drops;
+  int touched[IKCP_ENDPOINT_DRAIN + IKCP_ENDPOINT_BATCH];
+  char ring[IKCP_ENDPOINT_BATCH][IKCP_ENDPOINT_MTU];
+  struct iovec ring_iov[IKCP_ENDPOINT_BATCH];
+  struct sockaddr_in ring_from[IKCP_ENDPOINT_BATCH];
+  struct mmsghdr ring_msgs[IKCP_ENDPOINT_BATCH];
+  // shards of fec sessions are staged here, kcp's own batch is consumed
+  char tx[IKCP_ENDPOINT_BATCH][IKCP_ENDPOINT_MTU];
+  struct iovec tx_iov[IKCP_ENDPOINT_BATCH];
+  struct mmsghdr tx_msgs[IKCP_ENDPOINT_BATCH];
+  int tx_count;
+};
+
+//---------------------------------------------------------------------
+// session table
+//---------------------------------------------------------------------
+
+// the top byte of a conv only carries cam/stream seq, the 24 random
+// bits and the peer spread the sessions over the buckets
+static IUINT32 ikcp_endpoint_hash(IUINT32 conv, const struct sockaddr_in *peer) {
+  IUINT32 h = IKCP_CONV_RANDOM(conv) ^ (conv >> 24);
+  h ^= peer->sin_addr.s_addr * 0x9e3779b1u;
+  h ^= (IUINT32)peer->sin_port << 16;
+  h ^= h >> 15;
+  return h * 0x85ebca6bu;
+}
+
+static int ikcp_endpoint_same_peer(const struct sockaddr_in *a, const struct sockaddr_in *b) {
+  return a->sin_addr.s_addr == b->sin_addr.s_addr && a->sin_port == b->sin_port;
+}
+
+static int ikcp_endpoint_handle(const ikcp_session *s, int index) { return (s->generation << 16) | (index + 1); }
+
+static ikcp_session *ikcp_endpoint_session(const ikcp_endpoint *ep, int handle) {
+  int index = (handle & 0xffff) - 1;
+  ikcp_session *s;
+  if (ep == NULL || handle <= 0 || index < 0 || index >= ep->max_sessions) return NULL;
+  s = &ep->sessions[index];
+  if (!s->used || s->generation != (handle >> 16)) return NULL;
+  return s;
+}
+
+static int ikcp_endpoint_find(const ikcp_endpoint *ep, IUINT32 conv, const struct sockaddr_in *peer) {
+  int index = ep->buckets[ikcp_endpoint_hash(conv, peer) & ep->bucket_mask];
+  while (index >= 0) {
+    const ikcp_session *s = &ep->sessions[index];
+    if (s->conv == conv && ikcp_endpoint_same_peer(&s->peer, peer)) return index;
+    index = s->next;
+  }
+  return -1;
+}
+
+static void ikcp_endpoint_unlink(ikcp_endpoint *ep, int index) {
+  ikcp_session *s = &ep->sessions[index];
+  int *link = &ep->buckets[ikcp_endpoint_hash(s->conv, &s->peer) & ep->bucket_mask];
+  while (*link >= 0) {
+    if (*link == index) {
+      *link = s->next;
+      break;
+    }
+    link = &ep->sessions[*link].next;
+  }
+}
+
+// input or a send changed what the session has to do, make it due on the
+// next tick instead of at the deadline it was queued at. a no-op before
+// the first ikcp_endpoint_update, the wheel is not running yet
+static void ikcp_endpoint_wakeup(ikcp_endpoint *ep, ikcp_session *s) {
+  ikcp_sched_wakeup(&ep->wheel, &s->sched, ep->wheel.jiffies);
+}
+
+//---------------------------------------------------------------------
+// output
+//---------------------------------------------------------------------
+static int ikcp_endpoint_sendmmsg(int fd, struct mmsghdr *msgs, int count) {
+  int sent = 0;
+  while (sent < count) {
+    int ret = sendmmsg(fd, msgs + sent, count - sent, 0);
+    if (ret <= 0) {
+      if (ret < 0 && errno == EINTR) continue;
+      break;
+    }
+    sent += ret;
+  }
+  return sent;
+}
+
+static int ikcp_endpoint_sendto(const char *buf, int len, void *user) {
+  ikcp_session *s = (ikcp_session *)user;
+  if (sendto(s->ep->fd, buf, len, 0, (struct sockaddr *)&s->peer, sizeof(s->peer)) < 0) return -1;
+  return 0;
+}
+
+static void ikcp_endpoint_tx_flush(ikcp_endpoint *ep) {
+  if (ep->tx_count > 0) ikcp_endpoint_sendmmsg(ep->fd, ep->tx_msgs, ep->tx_count);
+  ep->tx_count = 0;
+}
+
+// stage one fec shard for the next sendmmsg
+static int ikcp_endpoint_tx_stage(const char *buf, int len, void *user) {
+  ikcp_session *s = (ikcp_session *)user;
+  ikcp_endpoint *ep = s->ep;
+  struct mmsghdr *msg;
+  if (ep->tx_count >= IKCP_ENDPOINT_BATCH) ikcp_endpoint_tx_flush(ep);
+  msg = &ep->tx_msgs[ep->tx_count];
+  memcpy(ep->tx[ep->tx_count], buf, len);
+  ep->tx_iov[ep->tx_count].iov_len = len;
+  msg->msg_hdr.msg_name = &s->peer;
+  msg->msg_hdr.msg_namelen = sizeof(s->peer);
+  ep->tx_count++;
+  return 0;
+}
+
+static int ikcp_endpoint_fec_encode(ikcp_session *s, const char *buf, int len, ikcp_fec_emit_t emit) {
+  if (ikcp_fec_encoder_pending(s->fec_enc) == 0) s->fec_ts = s->kcp->current;
+  return ikcp_fec_encode(s->fec_enc, buf, len, emit, s);
+}
+
+static int ikcp_endpoint_output(const char *buf, int len, ikcpcb *kcp, void *user) {
+  ikcp_session *s = (ikcp_session *)user;
+  if (s->fec_enc) return ikcp_endpoint_fec_encode(s, buf, len, ikcp_endpoint_sendto) < 0 ? -1 : 0;
+  return ikcp_endpoint_sendto(buf, len, s);
+}
+
+static int ikcp_endpoint_output_batch(const struct iovec *iov, int count, ikcpcb *kcp, void *user) {
+  ikcp_session *s = (ikcp_session *)user;
+  struct mmsghdr msgs[IKCP_ENDPOINT_BATCH];
+  int i;
+
+  if (s->fec_enc) {
+    for (i = 0; i < count; i++) {
+      ikcp_endpoint_fec_encode(s, (const char *)iov[i].iov_base, (int)iov[i].iov_len, ikcp_endpoint_tx_stage);
+    }
+    ikcp_endpoint_tx_flush(s->ep);
+    return count;
+  }
+
+  memset(msgs, 0, sizeof(msgs[0]) * count);
+  for (i = 0; i < count; i++) {
+    msgs[i].msg_hdr.msg_name = &s->peer;
+    msgs[i].msg_hdr.msg_namelen = sizeof(s->peer);
+    msgs[i].msg_hdr.msg_iov = (struct iovec *)&iov[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+  return ikcp_endpoint_sendmmsg(s->ep->fd, msgs, count);
+}
+
+// the tail of a burst rarely fills a fec group, close it once it has
+// waited IKCP_ENDPOINT_FEC_FLUSH so its datagrams are protected too
+static void ikcp_endpoint_on_update(ikcp_sched_node *node, IUINT32 current) {
+  ikcp_session *s = (ikcp_session *)node->user;
+  if (s->fec_enc == NULL || ikcp_fec_encoder_pending(s->fec_enc) == 0) return;
+  if ((IINT32)(current - s->fec_ts) < IKCP_ENDPOINT_FEC_FLUSH) return;
+  ikcp_fec_flush(s->fec_enc, ikcp_endpoint_tx_stage, s);
+  ikcp_endpoint_tx_flush(s->ep);
+}
+
+//---------------------------------------------------------------------
+// endpoint
+//---------------------------------------------------------------------
+ikcp_endpoint *ikcp_endpoint_create(unsigned short port, int max_sessions) {
+  ikcp_endpoint *ep;
+  struct sockaddr_in local;
+  socklen_t local_len = sizeof(local);
+  IUINT32 buckets = 16;
+  int i;
+
+  if (max_sessions <= 0 || max_sessions > IKCP_ENDPOINT_MAX_SESSIONS) return NULL;
+  while (buckets < (IUINT32)max_sessions * 2) buckets <<= 1;
+
+  ep = (ikcp_endpoint *)calloc(1, sizeof(ikcp_endpoint));
+  if (ep == NULL) return NULL;
+  ep->fd = -1;
+  ep->sessions = (ikcp_session *)calloc(max_sessions, sizeof(ikcp_session));
+  ep->buckets = (int *)malloc(sizeof(int) * buckets);
+  if (ep->sessions == NULL || ep->buckets == NULL) goto fail;
+
+  ep->max_sessions = max_sessions;
+  ep->bucket_mask = buckets - 1;
+  for (i = 0; i < (int)buckets; i++) ep->buckets[i] = -1;
+  for (i = 0; i < max_sessions; i++) {
+    ep->sessions[i].next = (i + 1 < max_sessions) ? i + 1 : -1;
+    ep->sessions[i].generation = 1;
+  }
+  ep->free_head = 0;
+
+  for (i = 0; i < IKCP_ENDPOINT_BATCH; i++) {
+    ep->ring_iov[i].iov_base = ep->ring[i];
+    ep->ring_iov[i].iov_len = IKCP_ENDPOINT_MTU;
+    ep->ring_msgs[i].msg_hdr.msg_iov = &ep->ring_iov[i];
+    ep->ring_msgs[i].msg_hdr.msg_iovlen = 1;
+    ep->ring_msgs[i].msg_hdr.msg_name = &ep->ring_from[i];
+    ep->tx_iov[i].iov_base = ep->tx[i];
+    ep->tx_msgs[i].msg_hdr.msg_iov = &ep->tx_iov[i];
+    ep->tx_msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+
+  ep->fd = socket(AF_INET, SOCK_DGRAM, 0);
+  if (ep->fd < 0) goto fail;
+  memset(&local, 0, sizeof(local));
+  local.sin_family = AF_INET;
+  local.sin_port = htons(port);
+  local.sin_addr.s_addr = INADDR_ANY;
+  if (bind(ep->fd, (struct sockaddr *)&local, sizeof(local)) < 0) goto fail;
+  if (getsockname(ep->fd, (struct sockaddr *)&local, &local_len) == 0) ep->port = ntohs(local.sin_port);
+  return ep;
+
+fail:
+  if (ep->fd >= 0) close(ep->fd);
+  free(ep->sessions);
+  free(ep->buckets);
+  free(ep);
+  return NULL;
+}
+
+void ikcp_endpoint_release(ikcp_endpoint *ep) {
+  int i;
+  if (ep == NULL) return;
+  for (i = 0; i < ep->max_sessions; i++) {
+    ikcp_session *s = &ep->sessions[i];
+    if (s->used) ikcp_endpoint_close(ep, ikcp_endpoint_handle(s, i));
+  }
+  if (ep->fd >= 0) close(ep->fd);
+  free(ep->sessions);
+  free(ep->buckets);
+  free(ep);
+}
+
+int ikcp_endpoint_fd(const ikcp_endpoint *ep) { return ep ? ep->fd : -1; }
+
+unsigned short ikcp_endpoint_port(const ikcp_endpoint *ep) { return ep ? ep->port : 0; }
+
+void ikcp_endpoint_set_accept(ikcp_endpoint *ep, ikcp_endpoint_accept_t accept, void *user) {
+  ep->accept = accept;
+  ep->accept_user = user;
+}
+
+int ikcp_endpoint_open(ikcp_endpoint *ep, IUINT32 conv, const struct sockaddr_in *peer, void *user) {
+  ikcp_session *s;
+  IUINT32 slot;
+  int index;
+
+  if (ep == NULL || peer == NULL) return IKCP_ENDPOINT_EINVAL;
+  if (ikcp_endpoint_find(ep, conv, peer) >= 0) return IKCP_ENDPOINT_EEXIST;
+  if (ep->free_head < 0) return IKCP_ENDPOINT_EFULL;
+
+  index = ep->free_head;
+  s = &ep->sessions[index];
+  s->kcp = ikcp_create(conv, s);
+  if (s->kcp == NULL) return IKCP_ENDPOINT_ENOMEM;
+  s->kcp->output = ikcp_endpoint_output;
+  // segments come from per-session slabs instead of one malloc each
+  if (ikcp_setoutput_batch(s->kcp, ikcp_endpoint_output_batch, IKCP_ENDPOINT_BATCH) < 0 ||
+      ikcp_pool_enable(s->kcp, 0, 0) < 0) {
+    ikcp_release(s->kcp);
+    s->kcp = NULL;
+    return IKCP_ENDPOINT_ENOMEM;
+  }
+  ep->free_head = s->next;
+
+  s->ep = ep;
+  s->user = user;
+  s->conv = conv;
+  s->peer = *peer;
+  s->used = 1;
+  s->touched = 0;
+  s->fec_enc = NULL;
+  s->fec_dec = NULL;
+  memset(&s->sched, 0, sizeof(s->sched));
+  s->sched.on_update = ikcp_endpoint_on_update;
+  s->sched.user = s;
+
+  slot = ikcp_endpoint_hash(conv, peer) & ep->bucket_mask;
+  s->next = ep->buckets[slot];
+  ep->buckets[slot] = index;
+
+  // before the first update the wheel has no time base yet
+  if (ep->started) ikcp_sched_add(&ep->wheel, &s->sched, s->kcp, ep->wheel.jiffies);
+  return ikcp_endpoint_handle(s, index);
+}
+
+int ikcp_endpoint_close(ikcp_endpoint *ep, int handle) {
+  ikcp_session *s = ikcp_endpoint_session(ep, handle);
+  int index;
+  if (s == NULL) return IKCP_ENDPOINT_EINVAL;
+  index = (int)(s - ep->sessions);
+
+  ikcp_sched_del(&ep->wheel, &s->sched);
+  ikcp_endpoint_unlink(ep, index);
+  ikcp_release(s->kcp);
+  ikcp_fec_encoder_release(s->fec_enc);
+  ikcp_fec_decoder_release(s->fec_dec);
+  s->kcp = NULL;
+  s->fec_enc = NULL;
+  s->fec_dec = NULL;
+  s->user = NULL;
+  s->used = 0;
+  s->generation = (s->generation + 1) & 0x7fff;
+  if (s->generation == 0) s->generation = 1;
+  s->next = ep->free_head;
+  ep->free_head = index;
+  return 0;
+}
+
+ikcpcb *ikcp_endpoint_kcp(const ikcp_endpoint *ep, int handle) {
+  ikcp_session *s = ikcp_endpoint_session(ep, handle);
+  return s ? s->kcp : NULL;
+}
+
+void *ikcp_endpoint_user(const ikcp_endpoint *ep, int handle) {
+  ikcp_session *s = ikcp_endpoint_session(ep, handle);
+  return s ? s->user : NULL;
+}
+
+int ikcp_endpoint_setfec(ikcp_endpoint *ep, int handle, int type, int data, int parity) {
+  ikcp_session *s = ikcp_endpoint_session(ep, handle);
+  ikcp_fec_encoder *enc;
+  int mtu;
+
+  if (s == NULL) return IKCP_ENDPOINT_EINVAL;
+  // shards need room for the fec header inside the same datagram
+  mtu = (int)s->kcp->mtu + (s->fec_enc ? IKCP_FEC_OVERHEAD : 0);
+  if (data <= 0) {
+    if (s->fec_enc == NULL) return 0;
+    ikcp_fec_encoder_release(s->fec_enc);
+    s->fec_enc = NULL;
+    return ikcp_setmtu(s->kcp, mtu);
+  }
+
+  // sized for the largest datagram, path mtu discovery may grow the mtu
+  enc = ikcp_fec_encoder_create(type, data, parity, IKCP_ENDPOINT_MTU - IKCP_FEC_OVERHEAD);
+  if (enc == NULL) return IKCP_ENDPOINT_EINVAL;
+  if (ikcp_setmtu(s->kcp, mtu - IKCP_FEC_OVERHEAD) < 0) {
+    ikcp_fec_encoder_release(enc);
+    return IKCP_ENDPOINT_EINVAL;
+  }
+  ikcp_fec_encoder_release(s->fec_enc);
+  s->fec_enc = enc;
+  return 0;
+}
+
+int ikcp_endpoint_setmtud(ikcp_endpoint *ep, int handle, int min, int max) {
+  ikcp_session *s = ikcp_endpoint_session(ep, handle);
+  int overhead, val = IP_PMTUDISC_PROBE;
+
+  if (s == NULL || max > IKCP_ENDPOINT_MTU) return IKCP_ENDPOINT_EINVAL;
+  // probes have to be dropped, not fragmented, and must not be refused
+  // locally because of the path mtu the kernel has cached
+  if (max > 0 && setsockopt(ep->fd, IPPROTO_IP, IP_MTU_DISCOVER, &val, sizeof(val)) < 0) {
+    return IKCP_ENDPOINT_ESOCKET;
+  }
+  overhead = s->fec_enc ? IKCP_FEC_OVERHEAD : 0;
+  if (ikcp_setmtud(s->kcp, min - overhead, max > 0 ? max - overhead : 0) < 0) return IKCP_ENDPOINT_EINVAL;
+  return 0;
+}
+
+void ikcp_endpoint_fec_stat(const ikcp_endpoint *ep, int handle, IUINT32 *parity, IUINT32 *recovered,
+                            IUINT32 *unrecovered) {
+  ikcp_session *s = ikcp_endpoint_session(ep, handle);
+  if (parity) *parity = 0;
+  if (recovered) *recovered = 0;
+  if (unrecovered) *unrecovered = 0;
+  if (s == NULL) return;
+  if (s->fec_enc) ikcp_fec_encoder_stat(s->fec_enc, NULL, parity);
+  if (s->fec_dec) ikcp_fec_decoder_stat(s->fec_dec, recovered, unrecovered);
+}
+
+int ikcp_endpoint_send(ikcp_endpoint *ep, int handle, const char *buffer, int len) {
+  ikcp_session *s = ikcp_endpoint_session(ep, handle);
+  int ret;
+  if (s == NULL) return IKCP_ENDPOINT_EINVAL;
+  ret = ikcp_send(s->kcp, buffer, len);
+  if (ret >= 0) ikcp_endpoint_wakeup(ep, s);
+  return ret;
+}
+
+int ikcp_endpoint_sendv(ikcp_endpoint *ep, int handle, const struct iovec *iov, int cnt) {
+  ikcp_session *s = ikcp_endpoint_session(ep, handle);
+  int ret;
+  if (s == NULL) return IKCP_ENDPOINT_EINVAL;
+  ret = ikcp_sendv(s->kcp, iov, cnt);
+  if (ret >= 0) ikcp_endpoint_wakeup(ep, s);
+  return ret;
+}
+
+int ikcp_endpoint_send_fill(ikcp_endpoint *ep, int handle, int len, ikcp_send_fill_t fill, void *user) {
+  ikcp_session *s = ikcp_endpoint_session(ep, handle);
+  int ret;
+  if (s == NULL) return IKCP_ENDPOINT_EINVAL;
+  ret = ikcp_send_fill(s->kcp, len, fill, user);
+  if (ret >= 0) ikcp_endpoint_wakeup(ep, s);
+  return ret;
+}
+
+int ikcp_endpoint_send_ex(ikcp_endpoint *ep, int handle, const char *buffer, int len, IUINT32 ttl, int dclass) {
+  ikcp_session *s = ikcp_endpoint_session(ep, handle);
+  int ret;
+  if (s == NULL) return IKCP_ENDPOINT_EINVAL;
+  ret = ikcp_send_ex(s->kcp, buffer, len, ttl, dclass);
+  if (ret >= 0) ikcp_endpoint_wakeup(ep, s);
+  return ret;
+}
+
+int ikcp_endpoint_send_stream(ikcp_endpoint *ep, int handle, int stream, const char *buffer, int len, IUINT32 ttl,
+                              int dclass) {
+  ikcp_session *s = ikcp_endpoint_session(ep, handle);
+  int ret;
+  if (s == NULL) return IKCP_ENDPOINT_EINVAL;
+  ret = ikcp_send_stream(s->kcp, stream, buffer, len, ttl, dclass);
+  if (ret >= 0) ikcp_endpoint_wakeup(ep, s);
+  return ret;
+}
+
+int ikcp_endpoint_sendv_stream(ikcp_endpoint *ep, int handle, int stream, const struct iovec *iov, int cnt,
+                               IUINT32 ttl, int dclass) {
+  ikcp_session *s = ikcp_endpoint_session(ep, handle);
+  int ret;
+  if (s == NULL) return IKCP_ENDPOINT_EINVAL;
+  ret = ikcp_sendv_stream(s->kcp, stream, iov, cnt, ttl, dclass);
+  if (ret >= 0) ikcp_endpoint_wakeup(ep, s);
+  return ret;
+}
+
+int ikcp_endpoint_recv(ikcp_endpoint *ep, int handle, char *buffer, int len) {
+  ikcp_session *s = ikcp_endpoint_session(ep, handle);
+  if (s == NULL) return IKCP_ENDPOINT_EINVAL;
+  return ikcp_recv(s->kcp, buffer, len);
+}
+
+int ikcp_endpoint_recv_direct(ikcp_endpoint *ep, int handle, ikcp_recv_request_t request, void *user) {
+  ikcp_session *s = ikcp_endpoint_session(ep, handle);
+  if (s == NULL) return IKCP_ENDPOINT_EINVAL;
+  return ikcp_recv_direct(s->kcp, request, user);
+}
+
+int ikcp_endpoint_recv_stream(ikcp_endpoint *ep, int handle, int *stream, char *buffer, int len) {
+  ikcp_session *s = ikcp_endpoint_session(ep, handle);
+  if (s == NULL) return IKCP_ENDPOINT_EINVAL;
+  return ikcp_recv_stream(s->kcp, stream, buffer, len);
+}
+
+static int ikcp_endpoint_fec_input(const char *buf, int len, void *user) {
+  ikcp_session *s = (ikcp_session *)user;
+  return ikcp_input(s->kcp, buf, len);
+}
+
+// route one datagram, returns the session index or -1 if dropped
+static int ikcp_endpoint_route(ikcp_endpoint *ep, const char *data, int len, const struct sockaddr_in *from) {
+  IUINT32 conv;
+  int index;
+
+  // the empty shards padding a flushed fec group are shorter than a kcp header
+  if (len < IKCP_ENDPOINT_HEAD && !ikcp_fec_is_shard(data, len)) return -1;
+  conv = ikcp_getconv(data);
+  index = ikcp_endpoint_find(ep, conv, from);
+  if (index < 0 && ep->accept) {
+    ikcp_session *s = ikcp_endpoint_session(ep, ep->accept(ep, conv, from, ep->accept_user));
+    if (s && s->conv == conv && ikcp_endpoint_same_peer(&s->peer, from)) index = (int)(s - ep->sessions);
+  }
+  if (index < 0) return -1;
+  if (ikcp_fec_is_shard(data, len)) {
+    ikcp_session *s = &ep->sessions[index];
+    if (s->fec_dec == NULL) s->fec_dec = ikcp_fec_decoder_create(IKCP_ENDPOINT_MTU);
+    if (s->fec_dec == NULL || ikcp_fec_decode(s->fec_dec, data, len, ikcp_endpoint_fec_input, s) < 0) return -1;
+    return index;
+  }
+  if (ikcp_input(ep->sessions[index].kcp, data, len) < 0) return -1;
+  return index;
+}
+
+int ikcp_endpoint_input(ikcp_endpoint *ep) {
+  int total = 0, touched = 0, i;
+
+  if (ep == NULL || ep->fd < 0) return IKCP_ENDPOINT_EINVAL;
+
+  while (total < IKCP_ENDPOINT_DRAIN) {
+    int n;
+    for (i = 0; i < IKCP_ENDPOINT_BATCH; i++) ep->ring_msgs[i].msg_hdr.msg_namelen = sizeof(ep->ring_from[i]);
+    n = recvmmsg(ep->fd, ep->ring_msgs, IKCP_ENDPOINT_BATCH, MSG_DONTWAIT, NULL);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+      return total > 0 ? total : IKCP_ENDPOINT_ESOCKET;
+    }
+    if (n == 0) break;
+    for (i = 0; i < n; i++) {
+      int index = ikcp_endpoint_route(ep, ep->ring[i], (int)ep->ring_msgs[i].msg_len, &ep->ring_from[i]);
+      if (index < 0) {
+        ep->drops++;
+        continue;
+      }
+      if (!ep->sessions[index].touched) {
+        ep->sessions[index].touched = 1;
+        ep->touched[touched++] = index;
+      }
+    }
+    total += n;
+    if (n < IKCP_ENDPOINT_BATCH) break;
+  }
+
+  // one flush per session so the acks of a burst leave together
+  for (i = 0; i < touched; i++) {
+    ikcp_session *s = &ep->sessions[ep->touched[i]];
+    s->touched = 0;
+    if (!s->used) continue;
+    ikcp_flush(s->kcp);
+    ikcp_endpoint_wakeup(ep, s);
+  }
+  return total;
+}
+
+int ikcp_endpoint_update(ikcp_endpoint *ep, IUINT32 current) {
+  int i;
+  if (ep == NULL) return IKCP_ENDPOINT_EINVAL;
+  if (!ep->started) {
+    ikcp_sched_init(&ep->wheel, current);
+    ep->started = 1;
+    for (i = 0; i < ep->max_sessions; i++) {
+      ikcp_session *s = &ep->sessions[i];
+      if (s->used) ikcp_sched_add(&ep->wheel, &s->sched, s->kcp, current);
+    }
+  }
+  return ikcp_sched_run(&ep->wheel, current);
+}
+
+IUINT32 ikcp_endpoint_timeout(const ikcp_endpoint *ep, IUINT32 current, IUINT32 limit) {
+  if (ep == NULL || !ep->started) return 0;
+  return ikcp_sched_timeout(&ep->wheel, current, limit);
+}
+
+IUINT32 ikcp_endpoint_drops(const ikcp_endpoint *ep) { return ep ? ep->drops : 0; }
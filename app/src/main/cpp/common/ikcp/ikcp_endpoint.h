@@ -0,0 +1,131 @@
+//=====================================================================
+//
+// ikcp_endpoint.h - many kcp sessions sharing one udp socket
+//
+// incoming datagrams are routed by (conv, peer addr) through a hash
+// table, sessions are created and destroyed through integer handles
+// and driven by an ikcp_sched timer wheel. not thread safe: use an
+// endpoint from the thread that owns it.
+//
+//=====================================================================
+#ifndef __IKCP_ENDPOINT_H__
+#define __IKCP_ENDPOINT_H__
+
+#include <netinet/in.h>
+
+#include "ikcp.h"
+#include "ikcp_fec.h"
+#include "ikcp_sched.h"
+
+// conv layout of COMM_API_GenerateConv: stream_seq:4 | cam_seq:4 | random:24
+#define IKCP_CONV_CAM_SEQ(conv) (((conv) >> 24) & 0x0f)
+#define IKCP_CONV_STREAM_SEQ(conv) (((conv) >> 28) & 0x0f)
+#define IKCP_CONV_RANDOM(conv) ((conv) & 0xffffff)
+
+#define IKCP_ENDPOINT_BATCH 16     // datagrams per sendmmsg / recvmmsg
+#define IKCP_ENDPOINT_DRAIN 64     // datagrams routed per ikcp_endpoint_input
+#define IKCP_ENDPOINT_MTU 1500
+
+#define IKCP_ENDPOINT_EINVAL -1    // bad argument or stale handle
+#define IKCP_ENDPOINT_ESOCKET -2   // socket / bind failure
+#define IKCP_ENDPOINT_EFULL -3     // no free session slot
+#define IKCP_ENDPOINT_EEXIST -4    // (conv, peer) already open
+#define IKCP_ENDPOINT_ENOMEM -5
+
+typedef struct IKCPENDPOINT ikcp_endpoint;
+
+// called for a datagram of an unknown (conv, peer): return the handle
+// of a session opened for it, or a negative value to drop the datagram
+typedef int (*ikcp_endpoint_accept_t)(ikcp_endpoint *ep, IUINT32 conv, const struct sockaddr_in *peer, void *user);
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// bind a udp socket on 'port' (0 for an ephemeral port)
+ikcp_endpoint *ikcp_endpoint_create(unsigned short port, int max_sessions);
+
+// close every session and the socket
+void ikcp_endpoint_release(ikcp_endpoint *ep);
+
+int ikcp_endpoint_fd(const ikcp_endpoint *ep);
+
+// local port the socket is bound to
+unsigned short ikcp_endpoint_port(const ikcp_endpoint *ep);
+
+void ikcp_endpoint_set_accept(ikcp_endpoint *ep, ikcp_endpoint_accept_t accept, void *user);
+
+// open a session, returns its handle (> 0) or IKCP_ENDPOINT_E*. its
+// segments come from the kcp segment pool, see ikcp_pool_enable
+int ikcp_endpoint_open(ikcp_endpoint *ep, IUINT32 conv, const struct sockaddr_in *peer, void *user);
+
+int ikcp_endpoint_close(ikcp_endpoint *ep, int handle);
+
+// kcp of a session for ikcp_nodelay / ikcp_wndsize etc, NULL if stale
+ikcpcb *ikcp_endpoint_kcp(const ikcp_endpoint *ep, int handle);
+
+void *ikcp_endpoint_user(const ikcp_endpoint *ep, int handle);
+
+// protect what a session sends with fec groups of 'data' datagrams and
+// 'parity' shards (IKCP_FEC_XOR / IKCP_FEC_RS), 'data' 0 turns it off.
+// the session mtu shrinks by IKCP_FEC_OVERHEAD while it is on. shards
+// received are decoded whether or not the session sends them itself
+int ikcp_endpoint_setfec(ikcp_endpoint *ep, int handle, int type, int data, int parity);
+
+// path mtu discovery for a session, see ikcp_setmtud. 'min' and 'max'
+// are udp payload sizes up to IKCP_ENDPOINT_MTU, the fec header is taken
+// off when fec is on, so call it after ikcp_endpoint_setfec. sets DF on
+// the socket (IP_PMTUDISC_PROBE), which every session of it then shares.
+// 'max' 0 turns it off
+int ikcp_endpoint_setmtud(ikcp_endpoint *ep, int handle, int min, int max);
+
+// parity shards sent, datagrams rebuilt and groups left incomplete
+void ikcp_endpoint_fec_stat(const ikcp_endpoint *ep, int handle, IUINT32 *parity, IUINT32 *recovered,
+                            IUINT32 *unrecovered);
+
+// the send wrappers make the session due on the next ikcp_endpoint_update
+int ikcp_endpoint_send(ikcp_endpoint *ep, int handle, const char *buffer, int len);
+
+// ikcp_sendv on a session
+int ikcp_endpoint_sendv(ikcp_endpoint *ep, int handle, const struct iovec *iov, int cnt);
+
+// ikcp_send_fill on a session
+int ikcp_endpoint_send_fill(ikcp_endpoint *ep, int handle, int len, ikcp_send_fill_t fill, void *user);
+
+// ikcp_send_ex on a session
+int ikcp_endpoint_send_ex(ikcp_endpoint *ep, int handle, const char *buffer, int len, IUINT32 ttl, int dclass);
+
+// ikcp_send_stream on a session, see ikcp_setstreams
+int ikcp_endpoint_send_stream(ikcp_endpoint *ep, int handle, int stream, const char *buffer, int len, IUINT32 ttl,
+                              int dclass);
+
+// ikcp_sendv_stream on a session
+int ikcp_endpoint_sendv_stream(ikcp_endpoint *ep, int handle, int stream, const struct iovec *iov, int cnt,
+                               IUINT32 ttl, int dclass);
+
+int ikcp_endpoint_recv(ikcp_endpoint *ep, int handle, char *buffer, int len);
+
+// ikcp_recv_direct on a session
+int ikcp_endpoint_recv_direct(ikcp_endpoint *ep, int handle, ikcp_recv_request_t request, void *user);
+
+// ikcp_recv_stream on a session
+int ikcp_endpoint_recv_stream(ikcp_endpoint *ep, int handle, int *stream, char *buffer, int len);
+
+// drain the socket, feed every datagram to its session and flush each
+// touched session once, it is then due on the next update. returns datagrams routed, < 0 on socket error
+int ikcp_endpoint_input(ikcp_endpoint *ep);
+
+// update the sessions that are due at 'current' millisec
+int ikcp_endpoint_update(ikcp_endpoint *ep, IUINT32 current);
+
+// millisec until ikcp_endpoint_update has work again, at most 'limit'
+IUINT32 ikcp_endpoint_timeout(const ikcp_endpoint *ep, IUINT32 current, IUINT32 limit);
+
+// datagrams dropped since create: unknown session or too short
+IUINT32 ikcp_endpoint_drops(const ikcp_endpoint *ep);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
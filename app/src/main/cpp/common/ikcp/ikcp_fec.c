@@ -0,0 +1,416 @@
+//=====================================================================
+//
+// ikcp_fec.c - forward error correction between kcp and udp
+//
+// the code is a systematic cauchy matrix over GF(256) with its columns
+// scaled so the first parity row is all ones: a single parity shard is
+// then the plain xor of the group and IKCP_FEC_XOR needs no own decoder.
+//
+//=====================================================================
+#include "ikcp_fec.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+static IUINT8 gf_exp[512];
+static IUINT8 gf_log[256];
+static IUINT8 gf_mul_table[256][256];
+static pthread_once_t gf_once = PTHREAD_ONCE_INIT;
+
+static void gf_init(void) {
+  int i, j, x = 1;
+  for (i = 0; i < 255; i++) {
+    gf_exp[i] = (IUINT8)x;
+    gf_log[x] = (IUINT8)i;
+    x <<= 1;
+    if (x & 0x100) x ^= 0x11d;
+  }
+  for (i = 255; i < 512; i++) gf_exp[i] = gf_exp[i - 255];
+  for (i = 1; i < 256; i++) {
+    for (j = 1; j < 256; j++) gf_mul_table[i][j] = gf_exp[gf_log[i] + gf_log[j]];
+  }
+}
+
+static inline IUINT8 gf_mul(IUINT8 a, IUINT8 b) { return gf_mul_table[a][b]; }
+
+static inline IUINT8 gf_inv(IUINT8 a) { return gf_exp[255 - gf_log[a]]; }
+
+// dst[0, len) ^= c * src[0, len)
+static void gf_mul_add(IUINT8 *dst, const IUINT8 *src, IUINT8 c, int len) {
+  const IUINT8 *mt = gf_mul_table[c];
+  int i;
+  if (c == 0) return;
+  if (c == 1) {
+    for (i = 0; i < len; i++) dst[i] ^= src[i];
+    return;
+  }
+  for (i = 0; i < len; i++) dst[i] ^= mt[src[i]];
+}
+
+// parity rows of the generator, 'parity' x 'data'
+static void fec_matrix(IUINT8 *m, int data, int parity) {
+  int i, j;
+  for (i = 0; i < parity; i++) {
+    for (j = 0; j < data; j++) m[i * data + j] = gf_inv((IUINT8)((data + i) ^ j));
+  }
+  // scaling a column keeps every square submatrix of [I; C] invertible
+  for (j = 0; j < data; j++) {
+    IUINT8 s = gf_inv(m[j]);
+    for (i = 0; i < parity; i++) m[i * data + j] = gf_mul(m[i * data + j], s);
+  }
+}
+
+// invert the n x n matrix 'a' into 'inv' by gauss-jordan, 'a' is destroyed
+static int fec_invert(IUINT8 *a, IUINT8 *inv, int n) {
+  int i, j, k;
+  memset(inv, 0, (size_t)n * n);
+  for (i = 0; i < n; i++) inv[i * n + i] = 1;
+  for (i = 0; i < n; i++) {
+    IUINT8 s;
+    if (a[i * n + i] == 0) {
+      for (k = i + 1; k < n; k++) {
+        if (a[k * n + i]) break;
+      }
+      if (k == n) return -1;
+      for (j = 0; j < n; j++) {
+        IUINT8 t = a[i * n + j];
+        a[i * n + j] = a[k * n + j];
+        a[k * n + j] = t;
+        t = inv[i * n + j];
+        inv[i * n + j] = inv[k * n + j];
+        inv[k * n + j] = t;
+      }
+    }
+    s = gf_inv(a[i * n + i]);
+    for (j = 0; j < n; j++) {
+      a[i * n + j] = gf_mul(a[i * n + j], s);
+      inv[i * n + j] = gf_mul(inv[i * n + j], s);
+    }
+    for (k = 0; k < n; k++) {
+      IUINT8 f = a[k * n + i];
+      if (k == i || f == 0) continue;
+      gf_mul_add(&a[k * n], &a[i * n], f, n);
+      gf_mul_add(&inv[k * n], &inv[i * n], f, n);
+    }
+  }
+  return 0;
+}
+
+static char *fec_encode_head(char *p, IUINT32 conv, int cmd, int index, int data, int parity, IUINT32 group) {
+  memcpy(p, &conv, 4);  // conv stays as kcp wrote it
+  p[4] = (char)cmd;
+  p[5] = (char)index;
+  p[6] = (char)data;
+  p[7] = (char)parity;
+  p[8] = (char)(group >> 24);
+  p[9] = (char)(group >> 16);
+  p[10] = (char)(group >> 8);
+  p[11] = (char)group;
+  return p + IKCP_FEC_HEAD;
+}
+
+//---------------------------------------------------------------------
+// encoder
+//---------------------------------------------------------------------
+struct IKCPFECENC {
+  int data, parity;
+  int symbol;       // bytes of a (len:2 | datagram) slot
+  IUINT32 group;
+  int count;        // data shards in the current group
+  int maxlen;       // longest symbol of the current group
+  IUINT32 conv;     // conv of the current group
+  IUINT8 *shards;   // 'data' symbols of the current group
+  int *lens;
+  char *out;        // staging for one shard
+  IUINT8 matrix[IKCP_FEC_MAX_SHARDS * IKCP_FEC_MAX_SHARDS];
+  IUINT32 nencoded, nparity;
+};
+
+ikcp_fec_encoder *ikcp_fec_encoder_create(int type, int data, int parity, int mtu) {
+  ikcp_fec_encoder *enc;
+  if (data < 1 || parity < 1 || data + parity > IKCP_FEC_MAX_SHARDS || mtu <= 0) return NULL;
+  if (type == IKCP_FEC_XOR && parity != 1) return NULL;
+  if (type != IKCP_FEC_XOR && type != IKCP_FEC_RS) return NULL;
+  pthread_once(&gf_once, gf_init);
+
+  enc = (ikcp_fec_encoder *)calloc(1, sizeof(ikcp_fec_encoder));
+  if (enc == NULL) return NULL;
+  enc->data = data;
+  enc->parity = parity;
+  enc->symbol = 2 + mtu;
+  enc->shards = (IUINT8 *)malloc((size_t)enc->symbol * data);
+  enc->lens = (int *)malloc(sizeof(int) * data);
+  enc->out = (char *)malloc(IKCP_FEC_HEAD + enc->symbol);
+  if (enc->shards == NULL || enc->lens == NULL || enc->out == NULL) {
+    ikcp_fec_encoder_release(enc);
+    return NULL;
+  }
+  fec_matrix(enc->matrix, data, parity);
+  return enc;
+}
+
+void ikcp_fec_encoder_release(ikcp_fec_encoder *enc) {
+  if (enc == NULL) return;
+  free(enc->shards);
+  free(enc->lens);
+  free(enc->out);
+  free(enc);
+}
+
+// emit the parity shards of the current group and start the next one
+static int fec_encode_parity(ikcp_fec_encoder *enc, ikcp_fec_emit_t emit, void *user) {
+  int i, j;
+  for (i = 0; i < enc->parity; i++) {
+    IUINT8 *p = (IUINT8 *)fec_encode_head(enc->out, enc->conv, IKCP_FEC_CMD_PARITY, enc->data + i, enc->data,
+                                          enc->parity, enc->group);
+    memset(p, 0, enc->maxlen);
+    for (j = 0; j < enc->data; j++) {
+      gf_mul_add(p, enc->shards + (size_t)enc->symbol * j, enc->matrix[i * enc->data + j], enc->lens[j]);
+    }
+    emit(enc->out, IKCP_FEC_HEAD + enc->maxlen, user);
+    enc->nparity++;
+  }
+  enc->group++;
+  enc->count = 0;
+  return enc->parity;
+}
+
+int ikcp_fec_encode(ikcp_fec_encoder *enc, const char *buf, int len, ikcp_fec_emit_t emit, void *user) {
+  IUINT8 *slot;
+  IUINT32 conv;
+
+  if (len < 4 || len + 2 > enc->symbol) return -1;
+  memcpy(&conv, buf, 4);
+  // a group stays with one conv, the decoder only sees that session
+  if (enc->count > 0 && conv != enc->conv) {
+    enc->group++;
+    enc->count = 0;
+  }
+  if (enc->count == 0) {
+    enc->conv = conv;
+    enc->maxlen = 0;
+  }
+
+  memcpy(fec_encode_head(enc->out, conv, IKCP_FEC_CMD_DATA, enc->count, enc->data, enc->parity, enc->group), buf, len);
+  emit(enc->out, IKCP_FEC_HEAD + len, user);
+  enc->nencoded++;
+
+  slot = enc->shards + (size_t)enc->symbol * enc->count;
+  slot[0] = (IUINT8)(len >> 8);
+  slot[1] = (IUINT8)len;
+  memcpy(slot + 2, buf, len);
+  enc->lens[enc->count] = len + 2;
+  if (len + 2 > enc->maxlen) enc->maxlen = len + 2;
+  if (++enc->count < enc->data) return 1;
+  return 1 + fec_encode_parity(enc, emit, user);
+}
+
+int ikcp_fec_flush(ikcp_fec_encoder *enc, ikcp_fec_emit_t emit, void *user) {
+  int emitted = 0;
+  if (enc->count == 0) return 0;
+  // empty data shards: a bare header on the wire, a zero symbol in the code
+  while (enc->count < enc->data) {
+    IUINT8 *slot = enc->shards + (size_t)enc->symbol * enc->count;
+    fec_encode_head(enc->out, enc->conv, IKCP_FEC_CMD_DATA, enc->count, enc->data, enc->parity, enc->group);
+    emit(enc->out, IKCP_FEC_HEAD, user);
+    slot[0] = 0;
+    slot[1] = 0;
+    enc->lens[enc->count] = 2;
+    enc->count++;
+    emitted++;
+  }
+  return emitted + fec_encode_parity(enc, emit, user);
+}
+
+int ikcp_fec_encoder_pending(const ikcp_fec_encoder *enc) { return enc->count; }
+
+void ikcp_fec_encoder_stat(const ikcp_fec_encoder *enc, IUINT32 *data, IUINT32 *parity) {
+  if (data) *data = enc->nencoded;
+  if (parity) *parity = enc->nparity;
+}
+
+//---------------------------------------------------------------------
+// decoder
+//---------------------------------------------------------------------
+struct fec_group {
+  IUINT32 group;
+  int used;
+  int done;  // every data shard is there, or was rebuilt
+  int data, parity;
+  int have;
+  IUINT8 present[IKCP_FEC_MAX_SHARDS];
+  int lens[IKCP_FEC_MAX_SHARDS];
+  IUINT8 *shards;  // (data + parity) symbols
+  int capacity;    // symbols 'shards' can hold
+};
+
+struct IKCPFECDEC {
+  int symbol;
+  struct fec_group groups[IKCP_FEC_WINDOW];
+  IUINT8 matrix[IKCP_FEC_MAX_SHARDS * IKCP_FEC_MAX_SHARDS];
+  IUINT8 a[IKCP_FEC_MAX_SHARDS * IKCP_FEC_MAX_SHARDS];
+  IUINT8 inv[IKCP_FEC_MAX_SHARDS * IKCP_FEC_MAX_SHARDS];
+  int matrix_data, matrix_parity;  // layout 'matrix' was built for
+  IUINT8 *work;                    // one rebuilt symbol
+  IUINT32 recovered, unrecovered;
+};
+
+ikcp_fec_decoder *ikcp_fec_decoder_create(int mtu) {
+  ikcp_fec_decoder *dec;
+  if (mtu <= 0) return NULL;
+  pthread_once(&gf_once, gf_init);
+  dec = (ikcp_fec_decoder *)calloc(1, sizeof(ikcp_fec_decoder));
+  if (dec == NULL) return NULL;
+  dec->symbol = 2 + mtu;
+  dec->work = (IUINT8 *)malloc(dec->symbol);
+  if (dec->work == NULL) {
+    free(dec);
+    return NULL;
+  }
+  return dec;
+}
+
+void ikcp_fec_decoder_release(ikcp_fec_decoder *dec) {
+  int i;
+  if (dec == NULL) return;
+  for (i = 0; i < IKCP_FEC_WINDOW; i++) free(dec->groups[i].shards);
+  free(dec->work);
+  free(dec);
+}
+
+int ikcp_fec_is_shard(const char *buf, int len) {
+  return len >= IKCP_FEC_HEAD && ((IUINT8)buf[4] == IKCP_FEC_CMD_DATA || (IUINT8)buf[4] == IKCP_FEC_CMD_PARITY);
+}
+
+static void fec_group_close(ikcp_fec_decoder *dec, struct fec_group *g) {
+  if (g->used && !g->done) dec->unrecovered++;
+  g->used = 0;
+}
+
+static int fec_group_open(ikcp_fec_decoder *dec, struct fec_group *g, IUINT32 group, int data, int parity) {
+  int total = data + parity;
+  fec_group_close(dec, g);
+  if (g->capacity < total) {
+    IUINT8 *shards = (IUINT8 *)realloc(g->shards, (size_t)dec->symbol * total);
+    if (shards == NULL) return -1;
+    g->shards = shards;
+    g->capacity = total;
+  }
+  g->group = group;
+  g->used = 1;
+  g->done = 0;
+  g->data = data;
+  g->parity = parity;
+  g->have = 0;
+  memset(g->present, 0, sizeof(g->present));
+  return 0;
+}
+
+// rebuild the missing data shards of 'g' from any 'data' shards it has
+static int fec_group_recover(ikcp_fec_decoder *dec, struct fec_group *g, ikcp_fec_emit_t emit, void *user) {
+  int rows[IKCP_FEC_MAX_SHARDS];
+  int n = 0, maxlen = 0, emitted = 0, i, j, t;
+  int k = g->data;
+
+  if (dec->matrix_data != g->data || dec->matrix_parity != g->parity) {
+    fec_matrix(dec->matrix, g->data, g->parity);
+    dec->matrix_data = g->data;
+    dec->matrix_parity = g->parity;
+  }
+
+  for (i = 0; i < g->data + g->parity && n < k; i++) {
+    if (g->present[i]) rows[n++] = i;
+  }
+  for (t = 0; t < k; t++) {
+    int r = rows[t];
+    if (r < k) {
+      memset(&dec->a[t * k], 0, k);
+      dec->a[t * k + r] = 1;
+    } else {
+      memcpy(&dec->a[t * k], &dec->matrix[(r - k) * k], k);
+    }
+    if (g->lens[r] > maxlen) maxlen = g->lens[r];
+  }
+  if (fec_invert(dec->a, dec->inv, k) < 0) return 0;
+
+  for (j = 0; j < k; j++) {
+    int len;
+    if (g->present[j]) continue;
+    memset(dec->work, 0, maxlen);
+    for (t = 0; t < k; t++) {
+      gf_mul_add(dec->work, g->shards + (size_t)dec->symbol * rows[t], dec->inv[j * k + t], g->lens[rows[t]]);
+    }
+    len = (dec->work[0] << 8) | dec->work[1];
+    if (len + 2 > maxlen) continue;  // corrupt group, leave the gap to arq
+    memcpy(g->shards + (size_t)dec->symbol * j, dec->work, len + 2);
+    g->lens[j] = len + 2;
+    g->present[j] = 1;
+    if (len == 0) continue;  // padding of a flushed group
+    emit((const char *)dec->work + 2, len, user);
+    dec->recovered++;
+    emitted++;
+  }
+  return emitted;
+}
+
+int ikcp_fec_decode(ikcp_fec_decoder *dec, const char *buf, int len, ikcp_fec_emit_t emit, void *user) {
+  const IUINT8 *p = (const IUINT8 *)buf;
+  int cmd, index, data, parity, emitted = 0, i, have_data;
+  IUINT32 group;
+  struct fec_group *g;
+  IUINT8 *slot;
+
+  if (!ikcp_fec_is_shard(buf, len)) return -1;
+  cmd = p[4];
+  index = p[5];
+  data = p[6];
+  parity = p[7];
+  group = ((IUINT32)p[8] << 24) | ((IUINT32)p[9] << 16) | ((IUINT32)p[10] << 8) | p[11];
+  buf += IKCP_FEC_HEAD;
+  len -= IKCP_FEC_HEAD;
+  if (data < 1 || parity < 1 || data + parity > IKCP_FEC_MAX_SHARDS || index >= data + parity) return -1;
+  if ((cmd == IKCP_FEC_CMD_DATA) != (index < data)) return -1;
+  if (len + (cmd == IKCP_FEC_CMD_DATA ? 2 : 0) > dec->symbol) return -1;
+
+  // data goes on right away, the group only keeps a copy. empty data
+  // shards only pad a group the sender flushed early
+  if (cmd == IKCP_FEC_CMD_DATA && len > 0) {
+    emit(buf, len, user);
+    emitted++;
+  }
+
+  g = &dec->groups[group % IKCP_FEC_WINDOW];
+  if (!g->used || g->group != group) {
+    if (g->used && (IINT32)(group - g->group) < 0) return emitted;  // older than the window
+    if (fec_group_open(dec, g, group, data, parity) < 0) return emitted;
+  }
+  if (g->done || g->data != data || g->parity != parity || g->present[index]) return emitted;
+
+  slot = g->shards + (size_t)dec->symbol * index;
+  if (cmd == IKCP_FEC_CMD_DATA) {
+    slot[0] = (IUINT8)(len >> 8);
+    slot[1] = (IUINT8)len;
+    memcpy(slot + 2, buf, len);
+    g->lens[index] = len + 2;
+  } else {
+    memcpy(slot, buf, len);
+    g->lens[index] = len;
+  }
+  g->present[index] = 1;
+  g->have++;
+
+  for (i = 0, have_data = 0; i < data; i++) have_data += g->present[i];
+  if (have_data == data) {
+    g->done = 1;
+  } else if (g->have >= data) {
+    emitted += fec_group_recover(dec, g, emit, user);
+    g->done = 1;
+  }
+  return emitted;
+}
+
+void ikcp_fec_decoder_stat(const ikcp_fec_decoder *dec, IUINT32 *recovered, IUINT32 *unrecovered) {
+  if (recovered) *recovered = dec->recovered;
+  if (unrecovered) *unrecovered = dec->unrecovered;
+}
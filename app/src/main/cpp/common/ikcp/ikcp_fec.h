@@ -0,0 +1,83 @@
+//=====================================================================
+//
+// ikcp_fec.h - forward error correction between kcp and udp
+//
+// every 'data' datagrams of a session form a group that is followed by
+// 'parity' shards, any 'data' shards of a group rebuild the missing
+// datagrams without waiting for a retransmission. a shard keeps the
+// conv in front so endpoints still demultiplex it:
+//
+//   conv:4 | type:1 | index:1 | data:1 | parity:1 | group:4 | payload
+//
+// data shards carry the kcp datagram as it is, parity shards carry
+// the code of (len:2 | datagram) zero padded to the longest one. the
+// decoder learns the layout from the shards, only the sender is set up.
+//
+//=====================================================================
+#ifndef __IKCP_FEC_H__
+#define __IKCP_FEC_H__
+
+#include "ikcp.h"
+
+#define IKCP_FEC_XOR 1  // one parity shard, the xor of the group
+#define IKCP_FEC_RS 2   // reed-solomon over GF(256), any 'parity' losses
+
+#define IKCP_FEC_CMD_DATA 0xf1  // type byte, outside of the IKCP_CMD_* range
+#define IKCP_FEC_CMD_PARITY 0xf2
+
+#define IKCP_FEC_HEAD 12      // shard header
+#define IKCP_FEC_OVERHEAD 14  // header plus the length word of parity shards
+#define IKCP_FEC_MAX_SHARDS 64  // data + parity
+#define IKCP_FEC_WINDOW 4       // groups the decoder keeps open
+
+typedef struct IKCPFECENC ikcp_fec_encoder;
+typedef struct IKCPFECDEC ikcp_fec_decoder;
+
+// receives every shard to send, or every datagram to hand to ikcp_input
+typedef int (*ikcp_fec_emit_t)(const char *buf, int len, void *user);
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// 'mtu' is the largest datagram that will be encoded
+ikcp_fec_encoder *ikcp_fec_encoder_create(int type, int data, int parity, int mtu);
+
+void ikcp_fec_encoder_release(ikcp_fec_encoder *enc);
+
+// emit 'buf' as a data shard, and the parity shards once it completes a
+// group. returns shards emitted, < 0 on error
+int ikcp_fec_encode(ikcp_fec_encoder *enc, const char *buf, int len, ikcp_fec_emit_t emit, void *user);
+
+// close the current group before it is full: pad it with empty data
+// shards and emit its parity, so the datagrams at the tail of a burst
+// are protected too. returns shards emitted, 0 if no group is open
+int ikcp_fec_flush(ikcp_fec_encoder *enc, ikcp_fec_emit_t emit, void *user);
+
+// data shards in the group still open
+int ikcp_fec_encoder_pending(const ikcp_fec_encoder *enc);
+
+// datagrams encoded / parity shards emitted since create
+void ikcp_fec_encoder_stat(const ikcp_fec_encoder *enc, IUINT32 *data, IUINT32 *parity);
+
+ikcp_fec_decoder *ikcp_fec_decoder_create(int mtu);
+
+void ikcp_fec_decoder_release(ikcp_fec_decoder *dec);
+
+// is this datagram a fec shard
+int ikcp_fec_is_shard(const char *buf, int len);
+
+// take a shard: a data shard is emitted right away, a group that gets
+// enough shards emits the datagrams it was missing. the empty shards of
+// a flushed group are never emitted. returns datagrams emitted, < 0 for
+// a malformed shard
+int ikcp_fec_decode(ikcp_fec_decoder *dec, const char *buf, int len, ikcp_fec_emit_t emit, void *user);
+
+// datagrams rebuilt / groups closed with data still missing
+void ikcp_fec_decoder_stat(const ikcp_fec_decoder *dec, IUINT32 *recovered, IUINT32 *unrecovered);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,136 @@
+//=====================================================================
+//
+// ikcp_sched.c - hierarchical timer wheel driving many kcp sessions
+//
+//=====================================================================
+#include "ikcp_sched.h"
+
+#define IKCP_SCHED_ROOT_MASK (IKCP_SCHED_ROOT_SIZE - 1)
+#define IKCP_SCHED_NODE_MASK (IKCP_SCHED_NODE_SIZE - 1)
+
+static inline IINT32 ikcp_sched_diff(IUINT32 later, IUINT32 earlier) { return (IINT32)(later - earlier); }
+
+// shift of the slot index at upper 'level'
+static inline int ikcp_sched_shift(int level) { return IKCP_SCHED_ROOT_BITS + level * IKCP_SCHED_NODE_BITS; }
+
+static void ikcp_sched_queue(ikcp_sched *sched, ikcp_sched_node *node) {
+  IUINT32 expire = node->expire;
+  IINT32 delta = ikcp_sched_diff(expire, sched->jiffies);
+  struct IQUEUEHEAD *head;
+  int level;
+
+  if (delta < 0) {
+    // already late, expire on the next tick
+    head = &sched->root[sched->jiffies & IKCP_SCHED_ROOT_MASK];
+  } else if (delta < IKCP_SCHED_ROOT_SIZE) {
+    head = &sched->root[expire & IKCP_SCHED_ROOT_MASK];
+  } else {
+    for (level = 0; level < IKCP_SCHED_LEVELS - 1; level++) {
+      if (delta < (1 << ikcp_sched_shift(level + 1))) break;
+    }
+    if (delta >= (1 << ikcp_sched_shift(IKCP_SCHED_LEVELS))) {
+      // beyond the wheel span, park in the farthest slot
+      expire = sched->jiffies + (1 << ikcp_sched_shift(IKCP_SCHED_LEVELS)) - 1;
+      node->expire = expire;
+    }
+    head = &sched->levels[level][(expire >> ikcp_sched_shift(level)) & IKCP_SCHED_NODE_MASK];
+  }
+  iqueue_add_tail(&node->node, head);
+}
+
+// move the nodes of an upper level slot down to where they belong now
+static int ikcp_sched_cascade(ikcp_sched *sched, int level, int index) {
+  struct IQUEUEHEAD list;
+  iqueue_init(&list);
+  iqueue_splice_init(&sched->levels[level][index], &list);
+  while (!iqueue_is_empty(&list)) {
+    ikcp_sched_node *node = iqueue_entry(list.next, ikcp_sched_node, node);
+    iqueue_del(&node->node);
+    ikcp_sched_queue(sched, node);
+  }
+  return index;
+}
+
+void ikcp_sched_init(ikcp_sched *sched, IUINT32 current) {
+  int i, level;
+  sched->jiffies = current;
+  sched->count = 0;
+  for (i = 0; i < IKCP_SCHED_ROOT_SIZE; i++) iqueue_init(&sched->root[i]);
+  for (level = 0; level < IKCP_SCHED_LEVELS; level++) {
+    for (i = 0; i < IKCP_SCHED_NODE_SIZE; i++) iqueue_init(&sched->levels[level][i]);
+  }
+}
+
+void ikcp_sched_add(ikcp_sched *sched, ikcp_sched_node *node, ikcpcb *kcp, IUINT32 current) {
+  ikcp_sched_del(sched, node);
+  node->kcp = kcp;
+  node->expire = ikcp_check(kcp, current);
+  node->active = 1;
+  sched->count++;
+  ikcp_sched_queue(sched, node);
+}
+
+void ikcp_sched_del(ikcp_sched *sched, ikcp_sched_node *node) {
+  if (!node->active) return;
+  iqueue_del(&node->node);
+  node->active = 0;
+  sched->count--;
+}
+
+void ikcp_sched_wakeup(ikcp_sched *sched, ikcp_sched_node *node, IUINT32 current) {
+  if (!node->active) return;
+  iqueue_del(&node->node);
+  node->expire = current;
+  ikcp_sched_queue(sched, node);
+}
+
+int ikcp_sched_run(ikcp_sched *sched, IUINT32 current) {
+  int updated = 0;
+
+  while (ikcp_sched_diff(current, sched->jiffies) >= 0) {
+    int index = sched->jiffies & IKCP_SCHED_ROOT_MASK;
+    struct IQUEUEHEAD list;
+    int level;
+
+    if (index == 0) {
+      for (level = 0; level < IKCP_SCHED_LEVELS; level++) {
+        int slot = (sched->jiffies >> ikcp_sched_shift(level)) & IKCP_SCHED_NODE_MASK;
+        if (ikcp_sched_cascade(sched, level, slot) != 0) break;
+      }
+    }
+
+    iqueue_init(&list);
+    iqueue_splice_init(&sched->root[index], &list);
+    sched->jiffies++;
+
+    while (!iqueue_is_empty(&list)) {
+      ikcp_sched_node *node = iqueue_entry(list.next, ikcp_sched_node, node);
+      iqueue_del(&node->node);
+      ikcp_update(node->kcp, current);
+      node->expire = ikcp_check(node->kcp, current);
+      ikcp_sched_queue(sched, node);
+      updated++;
+      // the callback may remove the node or release the session
+      if (node->on_update) node->on_update(node, current);
+    }
+  }
+
+  return updated;
+}
+
+IUINT32 ikcp_sched_timeout(const ikcp_sched *sched, IUINT32 current, IUINT32 limit) {
+  IINT32 behind = ikcp_sched_diff(current, sched->jiffies);
+  IUINT32 tick, step;
+
+  if (sched->count == 0) return limit;
+  if (behind >= 0) return 0;
+
+  // nodes only live in the root slots ahead of jiffies or in upper
+  // levels that cascade once the root index wraps to 0
+  for (tick = sched->jiffies, step = 0; step < limit; tick++, step++) {
+    if ((tick & IKCP_SCHED_ROOT_MASK) == 0) break;
+    if (!iqueue_is_empty(&sched->root[tick & IKCP_SCHED_ROOT_MASK])) break;
+  }
+  step += (IUINT32)(-behind);
+  return step < limit ? step : limit;
+}
@@ -0,0 +1,69 @@
+//=====================================================================
+//
+// ikcp_sched.h - hierarchical timer wheel driving many kcp sessions
+//
+// every session sits in the wheel at its ikcp_check() deadline, so a
+// tick only touches the sessions that are due and idle sessions cost
+// nothing but the slot they occupy. not thread safe: add, remove and
+// run sessions from the thread that owns them.
+//
+//=====================================================================
+#ifndef __IKCP_SCHED_H__
+#define __IKCP_SCHED_H__
+
+#include "ikcp.h"
+
+#define IKCP_SCHED_ROOT_BITS 8  // first level: 256 slots of 1ms
+#define IKCP_SCHED_NODE_BITS 6  // upper levels: 64 slots each
+#define IKCP_SCHED_ROOT_SIZE (1 << IKCP_SCHED_ROOT_BITS)
+#define IKCP_SCHED_NODE_SIZE (1 << IKCP_SCHED_NODE_BITS)
+#define IKCP_SCHED_LEVELS 3  // upper levels, 2^26 ms span in total
+
+typedef struct IKCPSCHEDNODE ikcp_sched_node;
+
+struct IKCPSCHEDNODE {
+  struct IQUEUEHEAD node;
+  ikcpcb *kcp;
+  IUINT32 expire;  // ikcp_check() deadline the node is queued at
+  int active;
+  // optional, invoked after ikcp_update with the session due
+  void (*on_update)(ikcp_sched_node *node, IUINT32 current);
+  void *user;
+};
+
+typedef struct IKCPSCHED {
+  IUINT32 jiffies;  // next tick to expire
+  int count;        // sessions in the wheel
+  struct IQUEUEHEAD root[IKCP_SCHED_ROOT_SIZE];
+  struct IQUEUEHEAD levels[IKCP_SCHED_LEVELS][IKCP_SCHED_NODE_SIZE];
+} ikcp_sched;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// init an empty wheel starting at 'current' millisec
+void ikcp_sched_init(ikcp_sched *sched, IUINT32 current);
+
+// queue a session at ikcp_check(kcp, current), re-queue if already active.
+// the node must be zeroed before it is added the first time
+void ikcp_sched_add(ikcp_sched *sched, ikcp_sched_node *node, ikcpcb *kcp, IUINT32 current);
+
+// remove a session from the wheel
+void ikcp_sched_del(ikcp_sched *sched, ikcp_sched_node *node);
+
+// make a session due now, eg. after ikcp_input or ikcp_send
+void ikcp_sched_wakeup(ikcp_sched *sched, ikcp_sched_node *node, IUINT32 current);
+
+// expire every tick up to 'current': ikcp_update the sessions that are
+// due and re-queue them at their next deadline. returns sessions updated
+int ikcp_sched_run(ikcp_sched *sched, IUINT32 current);
+
+// millisec until ikcp_sched_run has work again, at most 'limit'
+IUINT32 ikcp_sched_timeout(const ikcp_sched *sched, IUINT32 current, IUINT32 limit);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,323 @@
+//=====================================================================
+//
+// ikcp_test.c - host side regression checks for ikcp
+//
+// build and run on a linux host:
+//   gcc -O2 -DIKCP_TEST_MAIN ikcp.c ikcp_fec.c ikcp_test.c -lpthread -o ikcp_test && ./ikcp_test
+//
+// every check prints one line, the exit code is the number of failures
+//
+//=====================================================================
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ikcp.h"
+#include "ikcp_fec.h"
+
+#define TEST_MTU 1400
+#define TEST_PAYLOAD 1000  // one data segment per datagram with TEST_MTU
+#define TEST_LINK_MAX 256
+
+// wire constants private to ikcp.c
+#define TEST_OVERHEAD 24
+#define TEST_CMD_PUSH 81
+#define TEST_CMD_ACK 82
+#define TEST_CMD_WASK 83
+#define TEST_CMD_WINS 84
+#define TEST_CMD_PUSHX 85
+#define TEST_CMD_SKIP 86
+#define TEST_CMD_RACK 89
+#define TEST_RACK_RUN 6
+
+typedef struct test_link {
+  char data[TEST_LINK_MAX][TEST_MTU];
+  int len[TEST_LINK_MAX];
+  IUINT32 at[TEST_LINK_MAX];  // 'test_now' when the datagram left
+  int count;
+} TestLink;
+
+static IUINT32 test_now;
+
+static int test_output(const char *buf, int len, ikcpcb *kcp, void *user) {
+  TestLink *link = (TestLink *)user;
+  if (link->count >= TEST_LINK_MAX || len > TEST_MTU) return -1;
+  memcpy(link->data[link->count], buf, len);
+  link->len[link->count] = len;
+  link->at[link->count] = test_now;
+  link->count++;
+  return 0;
+}
+
+static IUINT32 test_get32(const char *p) {
+  const unsigned char *u = (const unsigned char *)p;
+  return (IUINT32)u[0] | ((IUINT32)u[1] << 8) | ((IUINT32)u[2] << 16) | ((IUINT32)u[3] << 24);
+}
+
+static IUINT32 test_get16(const char *p) {
+  const unsigned char *u = (const unsigned char *)p;
+  return (IUINT32)u[0] | ((IUINT32)u[1] << 8);
+}
+
+static int test_report(const char *name, int ok) {
+  printf("%-28s %s\n", name, ok ? "ok" : "FAILED");
+  return ok ? 0 : 1;
+}
+
+// a paced receiver with range acks: every sn it received comes back in
+// the RACK runs, and the data segment it sends behind them in the same
+// datagram carries the time the datagram left. the pacer must step over
+// the RACK payload instead of reading the runs as the next header.
+static int ikcp_test_pace_rack(void) {
+  static TestLink a_out, b_out;
+  static char payload[TEST_PAYLOAD];
+  ikcpcb *a = ikcp_create(0x11223344, &a_out);
+  ikcpcb *b = ikcp_create(0x11223344, &b_out);
+  unsigned char acked[128] = {0}, sent[128] = {0};
+  int i, pushes = 0, stamped = 0, runs = 0, ok = 1;
+
+  ikcp_setoutput(a, test_output);
+  ikcp_setoutput(b, test_output);
+  ikcp_setmtu(a, TEST_MTU);
+  ikcp_setmtu(b, TEST_MTU);
+  ikcp_wndsize(a, 128, 128);
+  ikcp_wndsize(b, 128, 128);
+  ikcp_nodelay(a, 1, 10, 2, 1);
+  ikcp_nodelay(b, 1, 10, 2, 1);
+  ikcp_setack(b, 0, 0, 1);
+  ikcp_setpacing(b, 0, 0);
+
+  test_now = 0;
+  ikcp_update(a, test_now);
+  ikcp_update(b, test_now);
+  for (i = 0; i < 90; i++) ikcp_send(a, payload, sizeof(payload));
+  test_now = 10;
+  ikcp_update(a, test_now);
+
+  // lose sn 0, 82 and 84 so the acks form several runs above una
+  for (i = 0; i < a_out.count; i++) {
+    IUINT32 sn = test_get32(a_out.data[i] + 12);
+    if (sn == 0 || sn == 82 || sn == 84) continue;
+    if (sn < sizeof(sent)) sent[sn] = 1;
+    ikcp_input(b, a_out.data[i], a_out.len[i]);
+  }
+  ikcp_send(b, payload, 200);
+  test_now = 20;
+  ikcp_update(b, test_now);
+  for (i = 0; i < 20 && ikcp_waitsnd(b) > 0; i++) {
+    test_now += 5;
+    ikcp_update(b, test_now);
+  }
+
+  for (i = 0; i < b_out.count; i++) {
+    const char *p = b_out.data[i];
+    int off = 0, size = b_out.len[i];
+    while (off + (int)TEST_OVERHEAD <= size) {
+      IUINT32 cmd = (unsigned char)p[off + 4];
+      IUINT32 ts = test_get32(p + off + 8);
+      IUINT32 len = test_get32(p + off + 20), r;
+      if (cmd == TEST_CMD_PUSHX || cmd == TEST_CMD_SKIP) len &= 0xffff;
+      if (off + (int)TEST_OVERHEAD + (int)len > size) {
+        ok = 0;
+        break;
+      }
+      if (cmd == TEST_CMD_PUSH || cmd == TEST_CMD_PUSHX) {
+        pushes++;
+        stamped += (ts == b_out.at[i]);
+      } else if (cmd == TEST_CMD_RACK) {
+        for (r = 0; r < len / TEST_RACK_RUN; r++) {
+          IUINT32 first = test_get32(p + off + TEST_OVERHEAD + r * TEST_RACK_RUN);
+          IUINT32 count = test_get16(p + off + TEST_OVERHEAD + r * TEST_RACK_RUN + 4), sn;
+          for (sn = first; sn < first + count; sn++) {
+            if (sn < sizeof(acked)) acked[sn] = 1;
+          }
+          runs++;
+        }
+      } else if (cmd == TEST_CMD_ACK) {
+        IUINT32 sn = test_get32(p + off + 12);
+        if (sn < sizeof(acked)) acked[sn] = 1;
+      } else if (cmd != TEST_CMD_WASK && cmd != TEST_CMD_WINS) {
+        ok = 0;  // a run read as a header
+      }
+      off += (int)TEST_OVERHEAD + (int)len;
+    }
+    if (off != size) ok = 0;
+  }
+  ok = ok && runs >= 3 && memcmp(acked, sent, sizeof(acked)) == 0;
+  ok = ok && pushes == 1 && stamped == pushes;
+
+  ikcp_release(a);
+  ikcp_release(b);
+  return test_report("pacing + range acks", ok);
+}
+
+// the full segment class follows the mss: segments of the new size come
+// from the pool right after ikcp_setmtu, while segments carved at the
+// old size are still in flight and go back to their own slabs.
+static int ikcp_test_pool_mtu(void) {
+  static TestLink a_out, b_out;
+  static char payload[TEST_PAYLOAD * 5];
+  ikcpcb *a = ikcp_create(0x11223344, &a_out);
+  ikcpcb *b = ikcp_create(0x11223344, &b_out);
+  IUINT32 hits, misses, before;
+  int i, ok = 1;
+
+  ikcp_setoutput(a, test_output);
+  ikcp_setoutput(b, test_output);
+  ikcp_setmtu(a, 600);
+  ikcp_pool_enable(a, 8, 4);
+  ikcp_nodelay(a, 1, 10, 2, 1);
+  ikcp_nodelay(b, 1, 10, 2, 1);
+  test_now = 0;
+  ikcp_update(a, test_now);
+  ikcp_update(b, test_now);
+
+  ikcp_send(a, payload, 5000);  // full 576 byte segments, not acked yet
+  ikcp_pool_stat(a, NULL, &before);
+  ikcp_setmtu(a, TEST_MTU);
+  ikcp_send(a, payload, 5000);  // full segments of the new mss
+  ikcp_pool_stat(a, &hits, &misses);
+  ok = ok && misses == before;
+
+  // everything is acked, the old slabs drain while the new ones serve
+  for (i = 0; i < 50 && (ikcp_waitsnd(a) > 0 || a_out.count > 0); i++) {
+    int j, n = a_out.count;
+    test_now += 10;
+    a_out.count = 0;
+    for (j = 0; j < n; j++) ikcp_input(b, a_out.data[j], a_out.len[j]);
+    ikcp_update(b, test_now);
+    for (j = 0; j < b_out.count; j++) ikcp_input(a, b_out.data[j], b_out.len[j]);
+    b_out.count = 0;
+    while (ikcp_recv(b, payload, sizeof(payload)) > 0) {
+    }
+    ikcp_update(a, test_now);
+  }
+  ikcp_send(a, payload, 5000);
+  ikcp_pool_stat(a, &hits, &misses);
+  ok = ok && misses == before && ikcp_waitsnd(a) > 0;
+
+  ikcp_release(a);
+  ikcp_release(b);
+  return test_report("pool across mtu change", ok);
+}
+
+static int test_capture(const char *buf, int len, void *user) {
+  TestLink *link = (TestLink *)user;
+  if (link->count >= TEST_LINK_MAX || len > TEST_MTU) return -1;
+  memcpy(link->data[link->count], buf, len);
+  link->len[link->count] = len;
+  link->count++;
+  return 0;
+}
+
+// a group closed early by ikcp_fec_flush still rebuilds a lost datagram,
+// and the empty shards padding it never come out of the decoder
+static int ikcp_test_fec_flush(void) {
+  static TestLink wire, out;
+  static const int types[2][2] = {{IKCP_FEC_RS, 3}, {IKCP_FEC_XOR, 1}};
+  char datagram[300];
+  int t, i, ok = 1;
+
+  for (i = 0; i < (int)sizeof(datagram); i++) datagram[i] = (char)(i * 13 + 1);
+  for (t = 0; t < 2; t++) {
+    ikcp_fec_encoder *enc = ikcp_fec_encoder_create(types[t][0], 8, types[t][1], TEST_MTU);
+    ikcp_fec_decoder *dec = ikcp_fec_decoder_create(TEST_MTU);
+    IUINT32 recovered = 0;
+
+    wire.count = out.count = 0;
+    ikcp_fec_encode(enc, datagram, sizeof(datagram), test_capture, &wire);
+    ok = ok && ikcp_fec_encoder_pending(enc) == 1;
+    ok = ok && ikcp_fec_flush(enc, test_capture, &wire) == 7 + types[t][1];
+    ok = ok && ikcp_fec_encoder_pending(enc) == 0 && ikcp_fec_flush(enc, test_capture, &wire) == 0;
+
+    // lose the only real datagram
+    for (i = 1; i < wire.count; i++) ikcp_fec_decode(dec, wire.data[i], wire.len[i], test_capture, &out);
+    ikcp_fec_decoder_stat(dec, &recovered, NULL);
+    ok = ok && out.count == 1 && recovered == 1;
+    ok = ok && out.len[0] == (int)sizeof(datagram) && memcmp(out.data[0], datagram, sizeof(datagram)) == 0;
+
+    ikcp_fec_encoder_release(enc);
+    ikcp_fec_decoder_release(dec);
+  }
+  return test_report("fec partial group flush", ok);
+}
+
+// a frame far above the IKCP_WND_RCV fragment cap does not fit in one
+// message, but goes through intact as one mss sized message per slice,
+// each a slice header and its payload gathered from the frame in place
+static int ikcp_test_large_frame(void) {
+  static TestLink a_out, b_out;
+  static char frame[600 * 1024], got[600 * 1024];
+  ikcpcb *a = ikcp_create(0x11223344, &a_out);
+  ikcpcb *b = ikcp_create(0x11223344, &b_out);
+  int slice, slices, i, received = 0, ok = 1;
+
+  ikcp_setoutput(a, test_output);
+  ikcp_setoutput(b, test_output);
+  ikcp_setmtu(a, TEST_MTU);
+  ikcp_setmtu(b, TEST_MTU);
+  ikcp_wndsize(a, 128, 128);
+  ikcp_wndsize(b, 128, 128);
+  ikcp_nodelay(a, 1, 10, 2, 1);
+  ikcp_nodelay(b, 1, 10, 2, 1);
+  for (i = 0; i < (int)sizeof(frame); i++) frame[i] = (char)(i * 7 + (i >> 11));
+  test_now = 0;
+  ikcp_update(a, test_now);
+  ikcp_update(b, test_now);
+
+  ok = ok && ikcp_send(a, frame, sizeof(frame)) == -2 && ikcp_waitsnd(a) == 0;
+
+  slice = (int)a->mss - 8;
+  slices = ((int)sizeof(frame) + slice - 1) / slice;
+  for (i = 0; i < slices && ok; i++) {
+    struct iovec iov[2];
+    IUINT32 head[2];
+    head[0] = (IUINT32)i;
+    head[1] = (IUINT32)(i == slices - 1 ? (int)sizeof(frame) - i * slice : slice);
+    iov[0].iov_base = head;
+    iov[0].iov_len = sizeof(head);
+    iov[1].iov_base = frame + i * slice;
+    iov[1].iov_len = head[1];
+    ok = ikcp_sendv_stream(a, 0, iov, 2, 0, IKCP_DROP_NEVER) == (int)(sizeof(head) + head[1]);
+  }
+
+  for (i = 0; i < 200 && ok && received < slices; i++) {
+    char msg[TEST_MTU];
+    int j, n;
+    test_now += 10;
+    ikcp_update(a, test_now);
+    for (j = 0; j < a_out.count; j++) ikcp_input(b, a_out.data[j], a_out.len[j]);
+    a_out.count = 0;
+    ikcp_update(b, test_now);
+    for (j = 0; j < b_out.count; j++) ikcp_input(a, b_out.data[j], b_out.len[j]);
+    b_out.count = 0;
+    while ((n = ikcp_recv(b, msg, sizeof(msg))) > 0) {
+      IUINT32 head[2];
+      memcpy(head, msg, sizeof(head));
+      if (n > (int)a->mss || head[0] != (IUINT32)received || n != (int)(sizeof(head) + head[1])) {
+        ok = 0;
+        break;
+      }
+      memcpy(got + head[0] * slice, msg + sizeof(head), head[1]);
+      received++;
+    }
+  }
+  ok = ok && received == slices && memcmp(got, frame, sizeof(frame)) == 0;
+
+  ikcp_release(a);
+  ikcp_release(b);
+  return test_report("large frame as slices", ok);
+}
+
+int ikcp_test_main(void) {
+  int failed = 0;
+  failed += ikcp_test_pace_rack();
+  failed += ikcp_test_pool_mtu();
+  failed += ikcp_test_fec_flush();
+  failed += ikcp_test_large_frame();
+  return failed;
+}
+
+#ifdef IKCP_TEST_MAIN
+int main(void) { return ikcp_test_main(); }
+#endif
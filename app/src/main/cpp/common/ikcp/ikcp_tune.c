@@ -0,0 +1,126 @@
+//=====================================================================
+//
+// ikcp_tune.c - adaptive window / interval / fast resend of a session
+//
+//=====================================================================
+#include "ikcp_tune.h"
+
+#define IKCP_TUNE_LOSS_ENTER 5.0f  // loss percent that makes the path lossy
+#define IKCP_TUNE_LOSS_LEAVE 2.0f  // and clean again
+#define IKCP_TUNE_QUEUE_MIN 20     // millisec of extra rtt that always counts as a queue
+#define IKCP_TUNE_RTT_WINDOW 10000 // millisec the lowest rtt is remembered
+#define IKCP_TUNE_GROW_PERIODS 3   // periods in a row before the window grows
+#define IKCP_TUNE_SHRINK_PERIODS 2 // and before it shrinks
+#define IKCP_TUNE_INTERVAL_STEP 5  // smaller interval changes are not worth it
+
+static inline IINT32 ikcp_tune_diff(IUINT32 later, IUINT32 earlier) { return (IINT32)(later - earlier); }
+
+static int ikcp_tune_clamp(int value, int lo, int hi) { return value < lo ? lo : (value > hi ? hi : value); }
+
+void ikcp_tune_init(ikcp_tune *tune, const ikcpcb *kcp, int min_snd_wnd, int max_snd_wnd) {
+  if (min_snd_wnd < 1) min_snd_wnd = 1;
+  if (max_snd_wnd < min_snd_wnd) max_snd_wnd = min_snd_wnd;
+  tune->min_snd_wnd = min_snd_wnd;
+  tune->max_snd_wnd = max_snd_wnd;
+  tune->snd_wnd = (int)kcp->snd_wnd;
+  tune->interval = (int)kcp->interval;
+  tune->resend = kcp->fastresend;
+  tune->resend_def = kcp->fastresend;
+  tune->rtt_period = 0;
+  tune->rtt_min = 0;
+  tune->rtt_min_ts = 0;
+  tune->delivered = kcp->delivered;
+  tune->lossy = 0;
+  tune->grow = 0;
+  tune->shrink = 0;
+  tune->next_ts = 0;
+  tune->changes = 0;
+}
+
+void ikcp_tune_rtt(ikcp_tune *tune, int rtt, IUINT32 current) {
+  if (rtt <= 0) return;
+  if (tune->rtt_period == 0 || rtt < tune->rtt_period) tune->rtt_period = rtt;
+  // a windowed minimum: an old one expires, the path may have changed
+  if (tune->rtt_min == 0 || rtt <= tune->rtt_min || ikcp_tune_diff(current, tune->rtt_min_ts) > IKCP_TUNE_RTT_WINDOW) {
+    tune->rtt_min = rtt;
+    tune->rtt_min_ts = current;
+  }
+}
+
+int ikcp_tune_update(ikcp_tune *tune, ikcpcb *kcp, IUINT32 current) {
+  int snd_wnd = tune->snd_wnd, interval = tune->interval, resend = tune->resend;
+  IINT32 queue, floor;
+  IUINT32 delivered;
+  float loss;
+
+  if (tune->next_ts == 0) {
+    tune->next_ts = current + IKCP_TUNE_PERIOD;
+    snd_wnd = ikcp_tune_clamp(snd_wnd, tune->min_snd_wnd, tune->max_snd_wnd);
+  } else {
+    if (ikcp_tune_diff(current, tune->next_ts) < 0) return 0;
+    tune->next_ts = current + IKCP_TUNE_PERIOD;
+
+    if (tune->rtt_period == 0) ikcp_tune_rtt(tune, (int)ikcp_getsrtt(kcp), current);
+    if (tune->rtt_period == 0) return 0;
+    // bursts come and go within a period, a standing queue does not
+    queue = tune->rtt_period - tune->rtt_min;
+    tune->rtt_period = 0;
+    // segments the acked rate keeps in flight over the base rtt, twice
+    delivered = kcp->delivered - tune->delivered;
+    tune->delivered = kcp->delivered;
+    floor = (IINT32)((IUINT64)delivered * 1000 / IKCP_TUNE_PERIOD * (IUINT32)tune->rtt_min / 1000 * 2 / kcp->mtu);
+
+    // loss, with separate thresholds to enter and leave
+    loss = ikcp_get_lossrate(kcp);
+    if (loss >= IKCP_TUNE_LOSS_ENTER) tune->lossy = 1;
+    if (loss <= IKCP_TUNE_LOSS_LEAVE) tune->lossy = 0;
+
+    if (queue > IKCP_TUNE_QUEUE_MIN && queue > tune->rtt_min / 2) {
+      tune->shrink++;
+      tune->grow = 0;
+    } else if (queue < tune->rtt_min / 4 + IKCP_TUNE_QUEUE_MIN / 2 && kcp->nsnd_que > 0 &&
+               (int)kcp->nsnd_buf + 2 >= snd_wnd) {
+      // data waits and the window, not the path, holds it back
+      tune->grow++;
+      tune->shrink = 0;
+    } else {
+      tune->grow = 0;
+      tune->shrink = 0;
+    }
+    if (tune->shrink >= IKCP_TUNE_SHRINK_PERIODS) {
+      snd_wnd = snd_wnd * 3 / 4;
+      if (snd_wnd < floor) snd_wnd = (floor < tune->snd_wnd) ? floor : tune->snd_wnd;
+      tune->shrink = 0;
+    } else if (tune->grow >= IKCP_TUNE_GROW_PERIODS) {
+      snd_wnd += (snd_wnd / 8 > 2) ? snd_wnd / 8 : 2;
+      tune->grow = 0;
+    }
+    snd_wnd = ikcp_tune_clamp(snd_wnd, tune->min_snd_wnd, tune->max_snd_wnd);
+
+    // a lossy path wants fast acks and retransmits, a clean one flushes
+    // every eighth of the rtt
+    if (tune->lossy) {
+      interval = IKCP_TUNE_MIN_INTERVAL;
+    } else {
+      int target = ikcp_tune_clamp(tune->rtt_min / 8, IKCP_TUNE_MIN_INTERVAL, IKCP_TUNE_MAX_INTERVAL);
+      if (target - interval >= IKCP_TUNE_INTERVAL_STEP || interval - target >= IKCP_TUNE_INTERVAL_STEP) {
+        interval = target;
+      }
+    }
+    // a congestion control takes every fast retransmit as a loss and
+    // backs off, only a session without one is better off resending early
+    if (tune->resend_def > 0 && kcp->cc == &ikcp_cc_none) resend = tune->lossy ? 1 : tune->resend_def;
+  }
+
+  if (snd_wnd == tune->snd_wnd && interval == tune->interval && resend == tune->resend &&
+      snd_wnd == (int)kcp->snd_wnd) {
+    return 0;
+  }
+  tune->snd_wnd = snd_wnd;
+  tune->interval = interval;
+  tune->resend = resend;
+  tune->changes++;
+  ikcp_wndsize(kcp, snd_wnd, 0);
+  ikcp_nodelay(kcp, -1, interval, resend, -1);
+  return 1;
+}
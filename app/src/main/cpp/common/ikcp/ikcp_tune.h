@@ -0,0 +1,63 @@
+//=====================================================================
+//
+// ikcp_tune.h - adaptive window / interval / fast resend of a session
+//
+// once a period the tuner looks at the loss rate, the lowest rtt of the
+// period against the lowest rtt seen lately and the send backlog, then
+// steps snd_wnd, interval and the fast resend threshold. an rtt that
+// stays up for a whole period means a standing queue: the window
+// shrinks, but not below twice what the acked rate fills. loss without
+// a queue is wifi noise: the window stays, acks and, without congestion
+// control (ikcp_cc_none), fast retransmits get quicker. a backlog on a
+// clean path lets the window grow. every change needs a few periods in
+// a row and separate enter / leave thresholds, so it does not flap.
+//
+//=====================================================================
+#ifndef __IKCP_TUNE_H__
+#define __IKCP_TUNE_H__
+
+#include "ikcp.h"
+
+#define IKCP_TUNE_PERIOD 1000      // millisec between decisions
+#define IKCP_TUNE_MIN_INTERVAL 10  // interval range the tuner picks from
+#define IKCP_TUNE_MAX_INTERVAL 40
+
+typedef struct IKCPTUNE {
+  int min_snd_wnd;   // bounds of snd_wnd
+  int max_snd_wnd;
+  int snd_wnd;       // applied parameters
+  int interval;
+  int resend;        // 0 if fast resend was off at init, it stays off
+  int resend_def;    // threshold when the path is clean
+  IINT32 rtt_period; // lowest rtt of this period, 0 without a sample
+  IINT32 rtt_min;    // lowest rtt of the recent window
+  IUINT32 rtt_min_ts;
+  IUINT32 delivered; // kcp->delivered at the last decision
+  int lossy;         // loss above the enter threshold, until below the leave one
+  int grow;          // periods in a row that asked for a larger window
+  int shrink;        // periods in a row that asked for a smaller window
+  IUINT32 next_ts;   // next decision
+  IUINT32 changes;   // parameter changes since init
+} ikcp_tune;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// start from the current parameters of 'kcp', snd_wnd is clamped to
+// [min_snd_wnd, max_snd_wnd] on the first update
+void ikcp_tune_init(ikcp_tune *tune, const ikcpcb *kcp, int min_snd_wnd, int max_snd_wnd);
+
+// feed an rtt sample in millisec, eg. a KcpRttAdv ping. without samples
+// the tuner follows the srtt of kcp
+void ikcp_tune_rtt(ikcp_tune *tune, int rtt, IUINT32 current);
+
+// call it from the update loop: decides at most once per period and
+// applies the result to 'kcp'. returns 1 if a parameter changed
+int ikcp_tune_update(ikcp_tune *tune, ikcpcb *kcp, IUINT32 current);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
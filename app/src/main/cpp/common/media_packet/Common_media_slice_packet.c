@@ -83,7 +83,7 @@ int media_data_slice_unpack(frameInfo_s *frameInfo, char *srcdata, int srcLen, c
       frameInfo->m_utcPts = headerInfo.frameInfo.m_utcPts;
 
       srcIndex += sliceHeadLen;
-      if (headerInfo.m_packetLen <= DATA_MAX_MTU_SIZE - sliceHeadLen) {
+      if (headerInfo.m_packetLen <= DATA_MTU_SIZE_LIMIT - sliceHeadLen) {
         memcpy(tempDate + destIndex, srcdata + srcIndex, headerInfo.m_packetLen);
         srcIndex += headerInfo.m_packetLen;
         destIndex += headerInfo.m_packetLen;
@@ -97,7 +97,7 @@ int media_data_slice_unpack(frameInfo_s *frameInfo, char *srcdata, int srcLen, c
       memcpy(&headerInfo, srcdata + srcIndex, sliceHeadLen);
       srcIndex += sliceHeadLen;
 
-      if (headerInfo.m_packetLen <= DATA_MAX_MTU_SIZE - sliceHeadLen) {
+      if (headerInfo.m_packetLen <= DATA_MTU_SIZE_LIMIT - sliceHeadLen) {
         memcpy(tempDate + destIndex, srcdata + srcIndex, headerInfo.m_packetLen);
         srcIndex += headerInfo.m_packetLen;
         destIndex += headerInfo.m_packetLen;
@@ -113,23 +113,63 @@ int media_data_slice_unpack(frameInfo_s *frameInfo, char *srcdata, int srcLen, c
   return 0;
 }
 
+int media_data_slice_head(frameInfo_s *frameInfo, int srcLen, int sliceSize, int sliceIndex,
+                          sliceDataHeader_s *headerInfo) {
+  int totalpkNum = 0;
+  int sliceLen = 0;
+
+  if (sliceSize == 0) {
+    sliceSize = DATA_MAX_MTU_SIZE;
+  }
+  if (sliceSize < DATA_MIN_MTU_SIZE || sliceSize > DATA_MTU_SIZE_LIMIT || srcLen < 0) {
+    return -1;
+  }
+
+  sliceLen = sliceSize - sizeof(sliceDataHeader_s);
+  totalpkNum = (srcLen / sliceLen) + ((srcLen % (sliceLen) != 0) ? 1 : 0);
+  if (sliceIndex < 0 || sliceIndex >= totalpkNum) {
+    return totalpkNum;
+  }
+
+  memset(headerInfo, 0, sizeof(sliceDataHeader_s));
+  headerInfo->frameInfo.m_EncodeType = frameInfo->m_EncodeType;
+  headerInfo->frameInfo.m_frameType = frameInfo->m_frameType;
+  headerInfo->frameInfo.m_frameRate = frameInfo->m_frameRate;
+  headerInfo->frameInfo.m_frameGop = frameInfo->m_frameGop;
+  headerInfo->frameInfo.m_frameIndex = frameInfo->m_frameIndex;
+  headerInfo->frameInfo.m_frmPts = frameInfo->m_frmPts;
+  headerInfo->frameInfo.m_utcPts = frameInfo->m_utcPts;
+
+  headerInfo->m_sliceTotalNum = totalpkNum;
+  headerInfo->m_sliceIndex = sliceIndex + 1;
+
+  if (sliceIndex != totalpkNum - 1) {
+    headerInfo->m_packetLen = sliceLen;
+  } else {
+    headerInfo->m_packetLen = srcLen - sliceIndex * sliceLen;
+  }
+
+  return totalpkNum;
+}
+
 int media_data_slice_pack(frameInfo_s *frameInfo, char *srcdata, int srcLen, char **destData, int *destLen,
-                          int *packetNum) {
+                          int *packetNum, int sliceSize) {
   int i = 0;
   int totalpkNum = 0;
   int nRet = 0;
   int mAllocSize = 0;
-  int sliceLen = 0;
   int destIndex = 0;
   int srcIndex = 0;
   int sliceHeadLen = sizeof(sliceDataHeader_s);
   sliceDataHeader_s headerInfo;
   char *tempDate = NULL;
 
-  sliceLen = DATA_MAX_MTU_SIZE - sliceHeadLen;
-  totalpkNum = (srcLen / sliceLen) + ((srcLen % (sliceLen) != 0) ? 1 : 0);
+  totalpkNum = media_data_slice_head(frameInfo, srcLen, sliceSize, -1, &headerInfo);
+  if (totalpkNum < 0) {
+    return -1;
+  }
 
-  mAllocSize = totalpkNum * DATA_MAX_MTU_SIZE;
+  mAllocSize = totalpkNum * (sliceSize ? sliceSize : DATA_MAX_MTU_SIZE);
   *destData = (char *)calloc(mAllocSize, 1);
   if (*destData == NULL) {
     return -1;
@@ -140,22 +180,7 @@ int media_data_slice_pack(frameInfo_s *frameInfo, char *srcdata, int srcLen, cha
   srcIndex = 0;
 
   for (i = 0; i < totalpkNum; i++) {
-    headerInfo.frameInfo.m_EncodeType = frameInfo->m_EncodeType;
-    headerInfo.frameInfo.m_frameType = frameInfo->m_frameType;
-    headerInfo.frameInfo.m_frameRate = frameInfo->m_frameRate;
-    headerInfo.frameInfo.m_frameGop = frameInfo->m_frameGop;
-    headerInfo.frameInfo.m_frameIndex = frameInfo->m_frameIndex;
-    headerInfo.frameInfo.m_frmPts = frameInfo->m_frmPts;
-    headerInfo.frameInfo.m_utcPts = frameInfo->m_utcPts;
-
-    headerInfo.m_sliceTotalNum = totalpkNum;
-    headerInfo.m_sliceIndex = i + 1;
-
-    if (i != totalpkNum - 1) {
-      headerInfo.m_packetLen = sliceLen;
-    } else {
-      headerInfo.m_packetLen = srcLen - srcIndex;
-    }
+    media_data_slice_head(frameInfo, srcLen, sliceSize, i, &headerInfo);
     if (headerInfo.m_packetLen) {
       memcpy(tempDate + destIndex, &headerInfo, sliceHeadLen);
       destIndex += sliceHeadLen;
@@ -197,4 +222,44 @@ const char *kcp_fream_type_to_string(FREAM_TYPE_E type) {
     default:
       return "UNKNOWN_FREAM_TYPE";
   }
+}
+
+// FREAM_TYPE_E 对应的kcp流号, 见KCP_STREAM_E
+int kcp_fream_type_to_stream(FREAM_TYPE_E type) {
+  switch (type) {
+    case FREAM_TYPE_VIDEO_I:
+    case FREAM_TYPE_VIDEO_P:
+      return KCP_STREAM_VIDEO;
+    case FREAM_TYPE_AUDIO:
+      return KCP_STREAM_AUDIO;
+    case FREAM_TYPE_FILE:
+    case FREAM_TYPE_REPEATER:
+      return KCP_STREAM_FILE;
+    default:
+      return KCP_STREAM_CTRL;
+  }
+}
+
+static unsigned char *media_put_be(unsigned char *p, unsigned long long v, int bytes) {
+  for (int i = bytes - 1; i >= 0; i--, v >>= 8) {
+    p[i] = (unsigned char)v;
+  }
+  return p + bytes;
+}
+
+// 帧头里切片后还能还原的字段按大端拼成 FRAME_AAD_SIZE 字节，作为 AES-GCM 的 aad，
+// 收发两端按 media_data_slice_unpack 还原出的 frameInfo 算出来一致，结构体的填充字节不参与
+int media_frame_aad(const frameInfo_s *frameInfo, unsigned char *aad) {
+  unsigned char *p = aad;
+  if (frameInfo == NULL || aad == NULL) {
+    return -1;
+  }
+  p = media_put_be(p, frameInfo->m_frameType, 2);
+  p = media_put_be(p, frameInfo->m_EncodeType, 2);
+  p = media_put_be(p, frameInfo->m_frameRate, 2);
+  p = media_put_be(p, frameInfo->m_frameGop, 2);
+  p = media_put_be(p, frameInfo->m_frameIndex, 8);
+  p = media_put_be(p, frameInfo->m_frmPts, 8);
+  p = media_put_be(p, frameInfo->m_utcPts, 8);
+  return (int)(p - aad);
 }
\ No newline at end of file
@@ -25,7 +25,9 @@ extern "C" {
  * 宏定义                              *
  *----------------------------------------------*/
 
-#define DATA_MAX_MTU_SIZE (1376)
+#define DATA_MAX_MTU_SIZE (1376)    /* 默认切片大小（含切片头），等于 KCP 默认 mss */
+#define DATA_MIN_MTU_SIZE (512)     /* 运行时切片大小下限 */
+#define DATA_MTU_SIZE_LIMIT (1476)  /* 切片大小上限：1500 字节 endpoint 报文上限减去 KCP 头 */
 
 #define FRAME_HEAD_IDENTIFIER 0xABCD
 #define FRAME_TAIL_IDENTIFIER 0xDCBA
@@ -33,6 +35,8 @@ extern "C" {
 #define TAIL_FRAME_HEAD_IDENTIFIER 0xBA98
 #define TAIL_FRAME_TAIL_IDENTIFIER 0x89ab
 
+#define FRAME_AAD_SIZE (32)  /* media_frame_aad 输出长度 */
+
 /*----------------------------------------------*
  * 外部变量说明                 *
  *----------------------------------------------*/
@@ -62,6 +66,16 @@ typedef enum {
   FREAM_TYPE_REPEATER
 } FREAM_TYPE_E;
 
+// 同一个kcp会话内的流号(ikcp_setstreams), 流号越小优先级越高,
+// 控制和音频不会排在大的视频帧后面
+typedef enum {
+  KCP_STREAM_CTRL = 0,  // 控制/心跳
+  KCP_STREAM_AUDIO,
+  KCP_STREAM_VIDEO,
+  KCP_STREAM_FILE,  // 文件/转发
+  KCP_STREAM_NUM
+} KCP_STREAM_E;
+
 typedef enum {
   FRAME_CTRL_TYPE_PUSHPLAY,  // 首次门铃
 
@@ -162,9 +176,18 @@ typedef struct _sliceDataHeader_ {
  *----------------------------------------------*/
 
 extern int media_data_slice_unpack(frameInfo_s* frameInfo, char* srcdata, int srcLen, char** destData, int* destLen);
+// sliceSize 为切片大小（含切片头），取所在 KCP 会话的 mss，每片正好占一个分片；0 用 DATA_MAX_MTU_SIZE。
+// 对端解包按 DATA_MTU_SIZE_LIMIT 校验，各会话、收发两端的切片大小可以不同
 extern int media_data_slice_pack(frameInfo_s* frameInfo, char* srcdata, int srcLen, char** destData, int* destLen,
-                                 int* packetNum);
+                                 int* packetNum, int sliceSize);
+// 按 sliceSize 切 srcLen 字节时第 sliceIndex 片（从 0 开始）的切片头，返回切片总数，参数不对返回 -1。
+// 头后面是 srcdata 里第 sliceIndex * (sliceSize - sizeof(sliceDataHeader_s)) 字节起的 m_packetLen 字节，
+// sliceIndex 越界时不填 headerInfo。发送时每片单独作为一条 KCP 消息，不用先拼整帧
+extern int media_data_slice_head(frameInfo_s* frameInfo, int srcLen, int sliceSize, int sliceIndex,
+                                 sliceDataHeader_s* headerInfo);
 extern const char* kcp_fream_type_to_string(FREAM_TYPE_E type);
+extern int kcp_fream_type_to_stream(FREAM_TYPE_E type);
+extern int media_frame_aad(const frameInfo_s* frameInfo, unsigned char* aad);
 
 #ifdef __cplusplus
 #if __cplusplus
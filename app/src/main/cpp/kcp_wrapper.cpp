@@ -1,29 +1,102 @@
 #include <jni.h>
 #include <string>
 #include <arpa/inet.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <time.h>
 #include <unistd.h>
-#include "ikcp/ikcp.h"
+#include "common/ikcp/ikcp_endpoint.h"
+#include "common/ikcp/ikcp_tune.h"
+#include "common/media_packet/Common_media_slice_packet.h"
 #include "wo_aes.h"
+extern "C" {
+#include "repeater_aes.h"
+}
 #include <android/log.h>
 #define LOG_TAG "KCP_NATIVE"
 #define LOGD(...) __android_log_print(ANDROID_LOG_DEBUG, LOG_TAG, __VA_ARGS__)
 
-static ikcpcb* kcp = nullptr;
-static int udp_fd = -1;
-static struct sockaddr_in remote_addr;
-
 #define AES_KEY_SIZE 16
+#define KCP_LOCAL_PORT 0       // 本地端口，0 由系统分配临时端口，多个会话互不冲突
+// FEC：每 KCP_FEC_DATA 个报文附带 KCP_FEC_PARITY 个 RS 校验包，需对端同样支持，默认关闭
+#define KCP_FEC_DATA 0
+#define KCP_FEC_PARITY 2
+// 大消息模式：整帧 I 帧（最大 512KB）作为一条 KCP 消息收发，需对端同样开启，默认关闭
+#define KCP_LARGE_MSG_BYTES 0
+// 按帧类型分流：sendFrame 的控制/音频/视频/文件各走一条 KCP 流（KCP_STREAM_E），排队的大 I 帧
+// 不再挡住控制消息和对讲音频，需对端同样开启，默认关闭
+#define KCP_STREAMS 0
+// 媒体帧 AES-GCM：sendFrame 整帧加密后再切片，aad 为 media_frame_aad，key/iv 取客户端四元组。
+// 加密后的帧为 8 字节大端 GCM 序号 + 密文 + 16 字节 tag，需对端同样开启，默认关闭
+#define KCP_FRAME_GCM 0
+#define KCP_GCM_SEQ_SIZE 8
+// GCM nonce 的 channel，标明本端发送方向，和对端发来的帧区分开。nonce 的计数部分用
+// repeater_aes_gcm_next_seq，不用 Java 传下来的 frameIndex（各帧类型共用、会话重建后会重来）
+#define KCP_GCM_CHANNEL_SEND 0x100
+// 路径MTU探测：从 KCP_MTUD_MIN 起二分探测到 KCP_MTUD_MAX（UDP 负载字节），需对端同样支持，默认关闭
+// 对端发起的探测无论是否开启都会应答
+#define KCP_MTUD_MIN 0
+#define KCP_MTUD_MAX 1472
+// 自适应调参：按丢包率/RTT/发送积压在 [MIN, MAX] 间调整发送窗口，并调整 interval 与快速重传，MAX 为 0 关闭
+#define KCP_TUNE_MIN_SND_WND 32
+#define KCP_TUNE_MAX_SND_WND 256
+// ACK 策略：ACK 最多等 KCP_ACK_DELAY_MS 或攒够 KCP_ACK_MAX 个再发，乱序/补洞/重复包立即确认；
+// 等待时间要小于对端最小 RTO（nodelay 下 30ms），否则会引起误重传
+// KCP_ACK_RANGE 为 1 时用区间 ACK 合并连续序号，需对端同样支持，默认关闭
+#define KCP_ACK_DELAY_MS 5
+#define KCP_ACK_MAX 32
+#define KCP_ACK_RANGE 0
+// native 事件循环：接收缓冲初始大小（按消息大小自动增长），最长等待时间
+#define KCP_LOOP_BUFFER_SIZE (64 * 1024)
+#define KCP_LOOP_MAX_WAIT_MS 1000
+
+// native 事件循环：epoll 等待 socket 可读、timerfd 到期（ikcp_check 给出的时间）
+// 和 eventfd 唤醒；收到的完整消息拼进复用的 direct ByteBuffer，回调 Java 一次
+struct KcpLoop {
+    pthread_t thread;
+    volatile bool running;
+    int epfd;
+    int timerfd;
+    int wakefd;
+    JavaVM *vm;
+    JNIEnv *env;          // 循环线程的 env
+    jobject callback;     // KcpClient 全局引用
+    jmethodID onMessage;  // void onNativeMessage(ByteBuffer, int)
+    jobject buffer;       // 包着 data 的 direct ByteBuffer 全局引用
+    char *data;
+    int capacity;
+};
+
+// 一路相机/码流一个会话，Java 侧以 jlong 句柄持有。每个会话独占一个 endpoint（临时端口的
+// UDP socket）、一把锁和一个事件循环，多路码流之间没有共享状态，可以分散到多个核上
+struct KcpSession {
+    ikcp_endpoint *endpoint;
+    int handle;            // endpoint 内的会话句柄
+    ikcp_tune tune;
+    // endpoint 同时被事件循环线程和 Java 线程（发送/轮询）访问，所有 endpoint 调用都在锁内
+    pthread_mutex_t lock;
+    KcpLoop loop;
+};
 
+static KcpSession *toSession(jlong handle) {
+    return reinterpret_cast<KcpSession *>(handle);
+}
 
+// AES key/iv 来自 TCP 绑定流程，与 KCP 会话无关，全进程一份
 static aes_128_cbc_encrypo_t g_last_enc;
 static bool g_has_aes_data = false;
+static pthread_mutex_t g_aes_lock = PTHREAD_MUTEX_INITIALIZER;
 
 // ✅ 提供给 repeater.c 调用
 extern "C" void set_aes_key_iv(const unsigned char *key, const unsigned char *iv) {
+    pthread_mutex_lock(&g_aes_lock);
     memcpy(g_last_enc.key, key, AES_KEY_SIZE);
     memcpy(g_last_enc.iv, iv, AES_KEY_SIZE);
     g_has_aes_data = true;
+    pthread_mutex_unlock(&g_aes_lock);
 //    LOGD("AES key/iv updated from repeater.c key=%s iv=%s", key, iv);
     LOGD("AES key/iv updated from repeater.c key=%.*s iv=%.*s",
          AES_KEY_SIZE, key,
@@ -31,140 +104,530 @@ extern "C" void set_aes_key_iv(const unsigned char *key, const unsigned char *iv
 
 }
 
-// 输出回调函数（KCP 内部调用）
-int udp_output(const char *buf, int len, ikcpcb *kcp, void *user)
-{
-    LOGD("udp_output send len=%d", len);
-    if (udp_fd < 0) return -1;
-    LOGD("udp_output send 2222222 ");
-    if (udp_fd < 0) return -1;
-    int ret = sendto(udp_fd, buf, len, 0, (struct sockaddr*)&remote_addr, sizeof(remote_addr));
-    if (ret < 0) {
-        LOGD("sendto failed: %d", ret);
-    }
-    return 0;
-}
-
-extern "C" JNIEXPORT void JNICALL
+// 创建会话，返回句柄，失败返回 0
+extern "C" JNIEXPORT jlong JNICALL
 Java_com_switchbot_doorbell_KcpClient_initKcp(JNIEnv *env, jobject thiz, jstring remote_ip, jint remote_port, jint conv)
 {
     const char *ip = env->GetStringUTFChars(remote_ip, 0);
 
     LOGD("initKcp: remote_ip=%s port=%d conv=%d", ip, remote_port, conv);
 
-    // 创建 UDP socket
-    udp_fd = socket(AF_INET, SOCK_DGRAM, 0);
-    if (udp_fd < 0) {
-        LOGD("socket create failed errno=%d (%s)", errno, strerror(errno));
-        env->ReleaseStringUTFChars(remote_ip, ip);
-        return;
-    }
-
-    // 绑定本地端口
-    struct sockaddr_in local_addr;
-    memset(&local_addr, 0, sizeof(local_addr));
-    local_addr.sin_family = AF_INET;
-    local_addr.sin_port = htons(43210);  // 本地监听端口，可调整
-    local_addr.sin_addr.s_addr = INADDR_ANY;
-    if (bind(udp_fd, (struct sockaddr*)&local_addr, sizeof(local_addr)) < 0) {
-        LOGD("bind failed errno=%d (%s)", errno, strerror(errno));
-    } else {
-        LOGD("bind success on port 8888");
-    }
-
     // 设置远程地址
+    struct sockaddr_in remote_addr;
     memset(&remote_addr, 0, sizeof(remote_addr));
     remote_addr.sin_family = AF_INET;
     remote_addr.sin_port = htons(remote_port);
-    inet_pton(AF_INET, ip, &remote_addr.sin_addr);
+    int valid = inet_pton(AF_INET, ip, &remote_addr.sin_addr);
+    env->ReleaseStringUTFChars(remote_ip, ip);
+    if (valid != 1) {
+        LOGD("invalid remote ip");
+        return 0;
+    }
 
-    // 初始化 KCP
-    kcp = ikcp_create(conv, NULL);
-    kcp->output = udp_output;
+    KcpSession *session = (KcpSession *)calloc(1, sizeof(KcpSession));
+    if (!session) return 0;
+
+    // 创建绑定临时端口的 endpoint，只承载这一个会话
+    session->endpoint = ikcp_endpoint_create(KCP_LOCAL_PORT, 1);
+    if (!session->endpoint) {
+        LOGD("endpoint create failed errno=%d (%s)", errno, strerror(errno));
+        free(session);
+        return 0;
+    }
+    LOGD("bind success on port %d", ikcp_endpoint_port(session->endpoint));
 
+    // 初始化 KCP 会话
+    session->handle = ikcp_endpoint_open(session->endpoint, (IUINT32)conv, &remote_addr, nullptr);
+    if (session->handle < 0) {
+        LOGD("session open failed ret=%d", session->handle);
+        ikcp_endpoint_release(session->endpoint);
+        free(session);
+        return 0;
+    }
+    ikcpcb *kcp = ikcp_endpoint_kcp(session->endpoint, session->handle);
     ikcp_nodelay(kcp, 1, 10, 2, 1);
+    // nc=1 完全关闭拥塞控制会在弱 Wi-Fi 上灌满队列，改用基于带宽/最小 RTT 的拥塞控制
+    ikcp_setcc(kcp, &ikcp_cc_bbr);
+    // 节拍发送：报文按拥塞控制估计的速率均匀发出，避免整窗突发在家用路由器上尾部丢包
+    ikcp_setpacing(kcp, 0, 0);
     ikcp_wndsize(kcp, 128, 128);
+    ikcp_wndindex(kcp, 1);
+    ikcp_setack(kcp, KCP_ACK_DELAY_MS, KCP_ACK_MAX, KCP_ACK_RANGE);
+    if (KCP_LARGE_MSG_BYTES > 0) ikcp_setlarge(kcp, KCP_LARGE_MSG_BYTES);
+    if (KCP_STREAMS) {
+        int ret = ikcp_setstreams(kcp, KCP_STREAM_NUM);
+        LOGD("streams %d ret=%d", KCP_STREAM_NUM, ret);
+    }
+    if (KCP_FEC_DATA > 0) {
+        int ret = ikcp_endpoint_setfec(session->endpoint, session->handle, IKCP_FEC_RS, KCP_FEC_DATA, KCP_FEC_PARITY);
+        LOGD("fec rs(%d,%d) ret=%d", KCP_FEC_DATA, KCP_FEC_PARITY, ret);
+    }
+    if (KCP_MTUD_MIN > 0) {
+        int ret = ikcp_endpoint_setmtud(session->endpoint, session->handle, KCP_MTUD_MIN, KCP_MTUD_MAX);
+        LOGD("mtud %d-%d ret=%d", KCP_MTUD_MIN, KCP_MTUD_MAX, ret);
+    }
+    ikcp_tune_init(&session->tune, kcp, KCP_TUNE_MIN_SND_WND, KCP_TUNE_MAX_SND_WND);
+    pthread_mutex_init(&session->lock, nullptr);
 
-    env->ReleaseStringUTFChars(remote_ip, ip);
     LOGD("initKcp done.");
+    return reinterpret_cast<jlong>(session);
 }
 
+// 驱动到期的会话并调参，调用方持有 session->lock
+static void kcp_update_locked(KcpSession *session, IUINT32 current)
+{
+    ikcp_endpoint_update(session->endpoint, current);
+
+    ikcpcb *kcp = ikcp_endpoint_kcp(session->endpoint, session->handle);
+    if (kcp && KCP_TUNE_MAX_SND_WND > 0 && ikcp_tune_update(&session->tune, kcp, current)) {
+        LOGD("tune snd_wnd=%d interval=%d resend=%d", session->tune.snd_wnd, session->tune.interval,
+             session->tune.resend);
+    }
+}
+
+// 轮询模式：Java 线程定时调用；启动事件循环后不要再调用，两者时钟不同
 extern "C" JNIEXPORT void JNICALL
-Java_com_switchbot_doorbell_KcpClient_updateKcp(JNIEnv *env, jobject thiz, jlong current)
+Java_com_switchbot_doorbell_KcpClient_updateKcp(JNIEnv *env, jobject thiz, jlong handle, jlong current)
+{
+    KcpSession *session = toSession(handle);
+    if (!session) return;
+    pthread_mutex_lock(&session->lock);
+    kcp_update_locked(session, (IUINT32)current);
+    pthread_mutex_unlock(&session->lock);
+}
+
+extern "C" JNIEXPORT jint JNICALL
+Java_com_switchbot_doorbell_KcpClient_sendData(JNIEnv *env, jobject thiz, jlong handle, jbyteArray data)
 {
-    if (kcp) ikcp_update(kcp, (IUINT32)current);
+    KcpSession *session = toSession(handle);
+    if (!session) return -1;
+    jbyte *buf = env->GetByteArrayElements(data, nullptr);
+    jsize len = env->GetArrayLength(data);
+    pthread_mutex_lock(&session->lock);
+    int ret = ikcp_endpoint_send(session->endpoint, session->handle, (const char *)buf, len);
+    pthread_mutex_unlock(&session->lock);
+    // 只读，不必拷回
+    env->ReleaseByteArrayElements(data, buf, JNI_ABORT);
+    return ret;
 }
 
+// 直接发送 direct ByteBuffer 中 [offset, offset + len) 的数据，不经过 Java 数组拷贝
 extern "C" JNIEXPORT jint JNICALL
-Java_com_switchbot_doorbell_KcpClient_sendData(JNIEnv *env, jobject thiz, jbyteArray data)
+Java_com_switchbot_doorbell_KcpClient_sendDirect(JNIEnv *env, jobject thiz, jlong handle, jobject buffer, jint offset,
+                                                 jint len)
+{
+    KcpSession *session = toSession(handle);
+    if (!session) return -1;
+    char *data = (char *)env->GetDirectBufferAddress(buffer);
+    jlong capacity = env->GetDirectBufferCapacity(buffer);
+    if (!data || offset < 0 || len < 0 || (jlong)offset + len > capacity) return -1;
+
+    pthread_mutex_lock(&session->lock);
+    int ret = ikcp_endpoint_send(session->endpoint, session->handle, data + offset, len);
+    pthread_mutex_unlock(&session->lock);
+    return ret;
+}
+
+// 切片大小取会话当前的 mss，每片正好占一个 KCP 分片；mss 随 FEC、路径MTU探测变化，
+// 每次发送时重新读取。调用方持有 session->lock
+static int kcp_slice_size(KcpSession *session)
+{
+    ikcpcb *kcp = ikcp_endpoint_kcp(session->endpoint, session->handle);
+    if (!kcp || (int)kcp->mss < DATA_MIN_MTU_SIZE) return 0;
+    return (int)kcp->mss < DATA_MTU_SIZE_LIMIT ? (int)kcp->mss : DATA_MTU_SIZE_LIMIT;
+}
+
+// 整帧 GCM 加密，返回 malloc 出来的序号 + 密文（含 tag），没有 key 或失败返回 nullptr
+static unsigned char *kcp_seal_frame(const frameInfo_s *info, const jbyte *in, int len, int *outLen)
 {
-    if (!kcp) return -1;
+    unsigned char aad[FRAME_AAD_SIZE];
+    aes_128_gcm_t *gcm = repeater_client_aes_gcm_get();
+    if (!gcm) {
+        LOGD("no gcm key for frame");
+        return nullptr;
+    }
+    unsigned char *out = (unsigned char *)malloc(KCP_GCM_SEQ_SIZE + len + AES_GCM_TAG_SIZE);
+    int ret = -1;
+    if (out && media_frame_aad(info, aad) == FRAME_AAD_SIZE) {
+        uint64_t seq = repeater_aes_gcm_next_seq(gcm);
+        for (int i = 0; i < KCP_GCM_SEQ_SIZE; i++) out[i] = (unsigned char)(seq >> (56 - 8 * i));
+        ret = aes_gcm_encrypt_frame(gcm, KCP_GCM_CHANNEL_SEND, seq, aad, FRAME_AAD_SIZE, (const unsigned char *)in,
+                                    len, out + KCP_GCM_SEQ_SIZE);
+    }
+    repeater_aes_gcm_deinit(gcm);
+    if (ret < 0) {
+        free(out);
+        return nullptr;
+    }
+    *outLen = KCP_GCM_SEQ_SIZE + ret;
+    return out;
+}
+
+// 按帧发送：每个切片（切片头 + 负载）单独作为一条 KCP 消息发出，切片大小取 mss，一片正好一个分片，
+// 不受 KCP 单条消息的分片数上限限制；切片头和负载直接从 Java 数组聚合发送，不拼整帧。
+// frameType/encodeType 见 FREAM_TYPE_E / FREAM_ENCODE_TYPE_E
+extern "C" JNIEXPORT jint JNICALL
+Java_com_switchbot_doorbell_KcpClient_sendFrame(JNIEnv *env, jobject thiz, jlong handle, jint frameType,
+                                                jint encodeType, jlong frameIndex, jlong pts, jbyteArray data)
+{
+    KcpSession *session = toSession(handle);
+    if (!session) return -1;
+
+    frameInfo_s info;
+    memset(&info, 0, sizeof(info));
+    info.m_frameType = (unsigned short)frameType;
+    info.m_EncodeType = (unsigned short)encodeType;
+    info.m_frameIndex = (unsigned long long)frameIndex;
+    info.m_frmPts = (unsigned long long)pts;
+
+    // 加密不持锁，大帧不会挡住事件循环
     jbyte *buf = env->GetByteArrayElements(data, nullptr);
     jsize len = env->GetArrayLength(data);
-    int ret = ikcp_send(kcp, (const char *)buf, len);
-    env->ReleaseByteArrayElements(data, buf, 0);
+    char *payload = (char *)buf;
+    int payloadLen = len;
+    unsigned char *sealed = nullptr;
+    if (KCP_FRAME_GCM) {
+        sealed = kcp_seal_frame(&info, buf, len, &payloadLen);
+        payload = (char *)sealed;
+    }
+    if (!payload) {
+        env->ReleaseByteArrayElements(data, buf, JNI_ABORT);
+        return -1;
+    }
+
+    // 一帧的切片在同一次持锁内入队，不会和其它线程的帧交错
+    int stream = kcp_fream_type_to_stream((FREAM_TYPE_E)frameType);
+    sliceDataHeader_s header;
+    struct iovec iov[2];
+    int ret = 0;
+    pthread_mutex_lock(&session->lock);
+    int sliceSize = kcp_slice_size(session);
+    if (sliceSize == 0) sliceSize = DATA_MAX_MTU_SIZE;
+    int slices = media_data_slice_head(&info, payloadLen, sliceSize, -1, &header);
+    int sliceLen = sliceSize - (int)sizeof(sliceDataHeader_s);
+    if (slices < 0) ret = -1;
+    for (int i = 0; i < slices && ret >= 0; i++) {
+        media_data_slice_head(&info, payloadLen, sliceSize, i, &header);
+        iov[0].iov_base = &header;
+        iov[0].iov_len = sizeof(header);
+        iov[1].iov_base = payload + i * sliceLen;
+        iov[1].iov_len = header.m_packetLen;
+        int sent;
+        if (KCP_STREAMS) {
+            sent = ikcp_endpoint_sendv_stream(session->endpoint, session->handle, stream, iov, 2, 0,
+                                              IKCP_DROP_NEVER);
+        } else {
+            sent = ikcp_endpoint_sendv(session->endpoint, session->handle, iov, 2);
+        }
+        ret = sent < 0 ? sent : ret + sent;
+    }
+    pthread_mutex_unlock(&session->lock);
+    env->ReleaseByteArrayElements(data, buf, JNI_ABORT);
+    free(sealed);
     return ret;
 }
 
+// 按消息大小直接分配 jbyteArray，KCP 分片直接拼进数组，省去中间缓冲。
+// 回调在 session->lock 内，不能进 JNI critical 区（会挡住 GC，持锁期间其它线程也在等），
+// 用 GetByteArrayElements，解锁后再 Release 写回
+struct KcpRecvTarget {
+    JNIEnv *env;
+    jbyteArray array;
+    jbyte *data;
+};
+
+static char *kcp_recv_to_array(const char *head, int headlen, int size, void *user)
+{
+    KcpRecvTarget *target = (KcpRecvTarget *)user;
+    target->array = target->env->NewByteArray(size);
+    if (!target->array) return nullptr;
+    target->data = target->env->GetByteArrayElements(target->array, nullptr);
+    return (char *)target->data;
+}
+
 extern "C" JNIEXPORT jbyteArray JNICALL
-Java_com_switchbot_doorbell_KcpClient_receiveData(JNIEnv *env, jobject thiz)
+Java_com_switchbot_doorbell_KcpClient_receiveData(JNIEnv *env, jobject thiz, jlong handle)
+{
+    KcpSession *session = toSession(handle);
+    if (!session) return nullptr;
+
+    KcpRecvTarget target = {env, nullptr, nullptr};
+    pthread_mutex_lock(&session->lock);
+    ikcp_endpoint_input(session->endpoint);
+    int recv_len = ikcp_endpoint_recv_direct(session->endpoint, session->handle, kcp_recv_to_array, &target);
+    pthread_mutex_unlock(&session->lock);
+    if (target.data) env->ReleaseByteArrayElements(target.array, target.data, 0);
+    if (recv_len > 0) return target.array;
+    if (target.array) env->DeleteLocalRef(target.array);
+    return nullptr;
+}
+
+struct KcpRecvSpan {
+    char *data;
+    jlong capacity;
+};
+
+static char *kcp_recv_to_span(const char *head, int headlen, int size, void *user)
+{
+    KcpRecvSpan *span = (KcpRecvSpan *)user;
+    return size <= span->capacity ? span->data : nullptr;
+}
+
+// 轮询模式下把下一条完整消息直接拼进调用方的 direct ByteBuffer（从 0 开始），
+// 返回消息长度；-1 无消息，-3 缓冲不够大（消息保留，换更大的缓冲重试）
+extern "C" JNIEXPORT jint JNICALL
+Java_com_switchbot_doorbell_KcpClient_receiveInto(JNIEnv *env, jobject thiz, jlong handle, jobject buffer)
 {
-    if (!kcp || udp_fd < 0) return nullptr;
+    KcpSession *session = toSession(handle);
+    if (!session) return -1;
+    KcpRecvSpan span = {(char *)env->GetDirectBufferAddress(buffer), env->GetDirectBufferCapacity(buffer)};
+    if (!span.data || span.capacity <= 0) return -1;
 
-    char buffer[1500];
-    struct sockaddr_in from;
-    socklen_t fromlen = sizeof(from);
+    pthread_mutex_lock(&session->lock);
+    ikcp_endpoint_input(session->endpoint);
+    int ret = ikcp_endpoint_recv_direct(session->endpoint, session->handle, kcp_recv_to_span, &span);
+    pthread_mutex_unlock(&session->lock);
+    if (ret == -4) return -3;
+    return ret < 0 ? -1 : ret;
+}
 
-    int n = recvfrom(udp_fd, buffer, sizeof(buffer), MSG_DONTWAIT, (struct sockaddr*)&from, &fromlen);
-    if (n > 0) {
-        ikcp_input(kcp, buffer, n);
+static IUINT32 kcp_loop_now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (IUINT32)(ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000);
+}
+
+// 消息比缓冲大时换一块更大的，ByteBuffer 随之重建
+static char *kcp_loop_request(const char *head, int headlen, int size, void *user)
+{
+    KcpLoop *loop = (KcpLoop *)user;
+    if (size <= loop->capacity) return loop->data;
+
+    int capacity = loop->capacity;
+    while (capacity < size) capacity *= 2;
+    char *data = (char *)malloc(capacity);
+    if (!data) return nullptr;
+    jobject local = loop->env->NewDirectByteBuffer(data, capacity);
+    if (!local) {
+        free(data);
+        return nullptr;
     }
+    loop->env->DeleteGlobalRef(loop->buffer);
+    free(loop->data);
+    loop->buffer = loop->env->NewGlobalRef(local);
+    loop->env->DeleteLocalRef(local);
+    loop->data = data;
+    loop->capacity = capacity;
+    return data;
+}
+
+// 读空 socket，逐条取出完整消息交给 Java；回调时不持锁，Java 可在回调里发送
+static void kcp_loop_receive(KcpSession *session)
+{
+    KcpLoop *loop = &session->loop;
+    pthread_mutex_lock(&session->lock);
+    ikcp_endpoint_input(session->endpoint);
+    pthread_mutex_unlock(&session->lock);
 
-    char kcp_buf[1500];
-    int recv_len = ikcp_recv(kcp, kcp_buf, sizeof(kcp_buf));
-    if (recv_len > 0) {
-        jbyteArray result = env->NewByteArray(recv_len);
-        env->SetByteArrayRegion(result, 0, recv_len, (jbyte*)kcp_buf);
-        return result;
+    while (loop->running) {
+        pthread_mutex_lock(&session->lock);
+        int len = ikcp_endpoint_recv_direct(session->endpoint, session->handle, kcp_loop_request, loop);
+        pthread_mutex_unlock(&session->lock);
+        if (len <= 0) break;
+        loop->env->CallVoidMethod(loop->callback, loop->onMessage, loop->buffer, (jint)len);
+        if (loop->env->ExceptionCheck()) {
+            loop->env->ExceptionClear();
+            LOGD("onNativeMessage threw, message dropped");
+        }
+    }
+}
+
+// timerfd 的 it_value 为 0 会解除定时，0ms 的等待由 epoll_wait 直接返回
+static void kcp_loop_arm(KcpLoop *loop, IUINT32 wait)
+{
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec = wait / 1000;
+    its.it_value.tv_nsec = (long)(wait % 1000) * 1000000;
+    timerfd_settime(loop->timerfd, 0, &its, nullptr);
+}
+
+static void *kcp_loop_run(void *arg)
+{
+    KcpSession *session = (KcpSession *)arg;
+    KcpLoop *loop = &session->loop;
+    if (loop->vm->AttachCurrentThread(&loop->env, nullptr) != JNI_OK) {
+        LOGD("loop attach failed");
+        return nullptr;
     }
+
+    while (loop->running) {
+        struct epoll_event events[3];
+        uint64_t value;
+
+        pthread_mutex_lock(&session->lock);
+        IUINT32 now = kcp_loop_now();
+        kcp_update_locked(session, now);
+        IUINT32 wait = ikcp_endpoint_timeout(session->endpoint, now, KCP_LOOP_MAX_WAIT_MS);
+        pthread_mutex_unlock(&session->lock);
+
+        if (wait > 0) kcp_loop_arm(loop, wait);
+        int n = epoll_wait(loop->epfd, events, 3, wait > 0 ? -1 : 0);
+        for (int i = 0; i < n; i++) {
+            int fd = events[i].data.fd;
+            if (fd == loop->timerfd || fd == loop->wakefd) {
+                read(fd, &value, sizeof(value));
+            } else {
+                kcp_loop_receive(session);
+            }
+        }
+    }
+
+    loop->vm->DetachCurrentThread();
     return nullptr;
 }
 
+static void kcp_loop_stop(JNIEnv *env, KcpSession *session)
+{
+    KcpLoop *loop = &session->loop;
+    if (!loop->running) return;
+    uint64_t one = 1;
+    loop->running = false;
+    write(loop->wakefd, &one, sizeof(one));
+    pthread_join(loop->thread, nullptr);
+    close(loop->epfd);
+    close(loop->timerfd);
+    close(loop->wakefd);
+    env->DeleteGlobalRef(loop->buffer);
+    env->DeleteGlobalRef(loop->callback);
+    free(loop->data);
+    memset(loop, 0, sizeof(*loop));
+    LOGD("loop stopped");
+}
+
+// 启动会话的事件循环，之后由 native 线程负责 update 与接收，Java 只需实现 onNativeMessage。
+// 回调里的 ByteBuffer 在返回后会被复用，需要保留的数据须在回调内拷走
+extern "C" JNIEXPORT jint JNICALL
+Java_com_switchbot_doorbell_KcpClient_startLoop(JNIEnv *env, jobject thiz, jlong handle)
+{
+    KcpSession *session = toSession(handle);
+    if (!session) return -1;
+    KcpLoop *loop = &session->loop;
+    if (loop->running) return 0;
+
+    jclass clazz = env->GetObjectClass(thiz);
+    loop->onMessage = env->GetMethodID(clazz, "onNativeMessage", "(Ljava/nio/ByteBuffer;I)V");
+    env->DeleteLocalRef(clazz);
+    if (!loop->onMessage) return -1;
+    if (env->GetJavaVM(&loop->vm) != JNI_OK) return -1;
+
+    loop->data = (char *)malloc(KCP_LOOP_BUFFER_SIZE);
+    if (!loop->data) return -1;
+    loop->capacity = KCP_LOOP_BUFFER_SIZE;
+    jobject local = env->NewDirectByteBuffer(loop->data, loop->capacity);
+    if (!local) {
+        free(loop->data);
+        memset(loop, 0, sizeof(*loop));
+        return -1;
+    }
+    loop->buffer = env->NewGlobalRef(local);
+    env->DeleteLocalRef(local);
+    loop->callback = env->NewGlobalRef(thiz);
+
+    loop->epfd = epoll_create1(EPOLL_CLOEXEC);
+    loop->timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    loop->wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    int fds[3] = {ikcp_endpoint_fd(session->endpoint), loop->timerfd, loop->wakefd};
+    bool ok = loop->epfd >= 0 && loop->timerfd >= 0 && loop->wakefd >= 0;
+    for (int i = 0; ok && i < 3; i++) {
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.fd = fds[i];
+        ok = epoll_ctl(loop->epfd, EPOLL_CTL_ADD, fds[i], &ev) == 0;
+    }
+
+    loop->running = true;
+    if (!ok || pthread_create(&loop->thread, nullptr, kcp_loop_run, session) != 0) {
+        LOGD("loop start failed errno=%d (%s)", errno, strerror(errno));
+        if (loop->epfd >= 0) close(loop->epfd);
+        if (loop->timerfd >= 0) close(loop->timerfd);
+        if (loop->wakefd >= 0) close(loop->wakefd);
+        env->DeleteGlobalRef(loop->buffer);
+        env->DeleteGlobalRef(loop->callback);
+        free(loop->data);
+        memset(loop, 0, sizeof(*loop));
+        return -1;
+    }
+    LOGD("loop started");
+    return 0;
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_switchbot_doorbell_KcpClient_stopLoop(JNIEnv *env, jobject thiz, jlong handle)
+{
+    KcpSession *session = toSession(handle);
+    if (session) kcp_loop_stop(env, session);
+}
+
+// 会话绑定的本地端口，对端需要知道时可上报
+extern "C" JNIEXPORT jint JNICALL
+Java_com_switchbot_doorbell_KcpClient_localPort(JNIEnv *env, jobject thiz, jlong handle)
+{
+    KcpSession *session = toSession(handle);
+    return session ? ikcp_endpoint_port(session->endpoint) : -1;
+}
+
 extern "C" JNIEXPORT jbyteArray JNICALL
 Java_com_switchbot_doorbell_TcpClient_getLastAesKey(JNIEnv *env, jobject thiz)
 {
-    if (!g_has_aes_data) {
+    unsigned char key[AES_KEY_SIZE];
+    pthread_mutex_lock(&g_aes_lock);
+    bool has = g_has_aes_data;
+    memcpy(key, g_last_enc.key, AES_KEY_SIZE);
+    pthread_mutex_unlock(&g_aes_lock);
+    if (!has) {
         LOGD("No AES key available.");
         return nullptr;
     }
     jbyteArray keyArray = env->NewByteArray(AES_KEY_SIZE);
-    env->SetByteArrayRegion(keyArray, 0, AES_KEY_SIZE, (jbyte*)g_last_enc.key);
+    env->SetByteArrayRegion(keyArray, 0, AES_KEY_SIZE, (jbyte*)key);
     return keyArray;
 }
 
 extern "C" JNIEXPORT jbyteArray JNICALL
 Java_com_switchbot_doorbell_TcpClient_getLastAesIv(JNIEnv *env, jobject thiz)
 {
-    if (!g_has_aes_data) {
+    unsigned char iv[AES_KEY_SIZE];
+    pthread_mutex_lock(&g_aes_lock);
+    bool has = g_has_aes_data;
+    memcpy(iv, g_last_enc.iv, AES_KEY_SIZE);
+    pthread_mutex_unlock(&g_aes_lock);
+    if (!has) {
         LOGD("No AES iv available.");
         return nullptr;
     }
     jbyteArray ivArray = env->NewByteArray(AES_KEY_SIZE);
-    env->SetByteArrayRegion(ivArray, 0, AES_KEY_SIZE, (jbyte*)g_last_enc.iv);
+    env->SetByteArrayRegion(ivArray, 0, AES_KEY_SIZE, (jbyte*)iv);
     return ivArray;
 }
 
 
 
+// 停止事件循环并释放会话，之后句柄失效
 extern "C" JNIEXPORT void JNICALL
-Java_com_switchbot_doorbell_KcpClient_releaseKcp(JNIEnv *env, jobject thiz)
+Java_com_switchbot_doorbell_KcpClient_releaseKcp(JNIEnv *env, jobject thiz, jlong handle)
 {
-    if (kcp) {
-        ikcp_release(kcp);
-        kcp = nullptr;
-    }
-    if (udp_fd >= 0) {
-        close(udp_fd);
-        udp_fd = -1;
-    }
+    KcpSession *session = toSession(handle);
+    if (!session) return;
+    kcp_loop_stop(env, session);
+    // 分片池由 ikcp_endpoint_open 开启，命中率低说明 slab 配小了
+    IUINT32 hits = 0, misses = 0;
+    ikcpcb *kcp = ikcp_endpoint_kcp(session->endpoint, session->handle);
+    if (kcp) ikcp_pool_stat(kcp, &hits, &misses);
+    LOGD("segment pool hits=%u misses=%u", hits, misses);
+    ikcp_endpoint_release(session->endpoint);
+    pthread_mutex_destroy(&session->lock);
+    free(session);
 }
@@ -1,10 +1,14 @@
 #include "repeater_aes.h"
 
+#include <fcntl.h>
 #include <pthread.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
 #include <malloc.h>
 
 #include "RepeaterApp_log.h"
@@ -16,12 +20,27 @@
 // #define AES_KEY_LOG_D(fmt, ...) REPEATERLOG_D("AES_KEY] [" fmt, ##__VA_ARGS__)
 #define AES_KEY_LOG_D(fmt, ...)
 
+// 四元组预展开的加解密器，key/iv 变化时才重建。
+// 四元组自身持有一个引用，每次借出再加一，归还到 0 时释放，
+// 所以重建不用等正在加解密的线程
+typedef struct repeater_aes_cipher_t {
+  int refs;
+  aes_128_cbc_encrypo_t enc;
+  aes_128_cbc_decrypo_t dec;
+  aes_128_gcm_t gcm;
+  uint64_t gcm_seq;  // 下一个 GCM 发送序号，见 repeater_aes_gcm_next_seq
+} RepeaterAesCipher;
+
+#define REPEATER_CIPHER_OF(ptr, member) ((RepeaterAesCipher *)((char *)(ptr)-offsetof(RepeaterAesCipher, member)))
+
 typedef struct repeater_aes_context {
   uint8_t client_count;
   pthread_mutex_t mutex;
   uint8_t default_key[AES_KEY_SIZE];
   Quadruples repeater_quadruples[MAX_AES_KEY_NUM];
+  RepeaterAesCipher *repeater_ciphers[MAX_AES_KEY_NUM];  // 与 repeater_quadruples 一一对应，NULL 表示还没建
   Quadruples client_quadruples;
+  RepeaterAesCipher *client_cipher;
   uint8_t master_mac[6];
 } RepeaterAesContext;
 
@@ -109,6 +128,72 @@ static const char *key2str(const char *key, char *buff, size_t buff_size) {
   return buff;
 }
 
+// GCM 发送序号的起点：高 32 位随机，低 32 位从 0 计数。key 会存盘，进程重启后
+// 同一个 key 重新建加解密器，随机起点让这次的序号不会和上次的撞上
+static uint64_t repeater_gcm_seq_seed(void) {
+  uint32_t high = 0;
+  int fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+  if (fd < 0 || read(fd, &high, sizeof(high)) != sizeof(high)) {
+    AES_KEY_LOG_W("Failed to read /dev/urandom, seed GCM sequence with time");
+    high = (uint32_t)time(NULL);
+  }
+  if (fd >= 0) close(fd);
+  return (uint64_t)high << 32;
+}
+
+static RepeaterAesCipher *repeater_cipher_new(PQuadruples quadruples) {
+  RepeaterAesCipher *cipher = calloc(1, sizeof(RepeaterAesCipher));
+  if (!cipher) {
+    AES_KEY_LOG_E("Failed to allocate memory for AES cipher");
+    return NULL;
+  }
+
+  AES_KEY_LOG_I("[ENC] quadruples->key: %.*s", AES_KEY_SIZE, quadruples->key);
+  AES_KEY_LOG_I("[ENC] quadruples->iv: %.*s", AES_KEY_SIZE, quadruples->iv);
+
+  // ✅ 把 key/iv 传回 cpp 层保存
+  set_aes_key_iv((const unsigned char *)quadruples->key, (const unsigned char *)quadruples->iv);
+
+  if (aes_encrypo_opt(&cipher->enc, quadruples->key, quadruples->iv, AES_OPT_TYPE_ENC_INIT)) {
+    AES_KEY_LOG_E("Failed to initialize AES encrypter with key and IV");
+    free(cipher);
+    return NULL;
+  }
+  if (aes_decrypo_opt(&cipher->dec, quadruples->key, quadruples->iv, AES_OPT_TYPE_DEC_INIT)) {
+    AES_KEY_LOG_E("Failed to initialize AES decrypter with key and IV");
+    aes_encrypo_opt(&cipher->enc, NULL, NULL, AES_OPT_TYPE_ENC_DEINIT);
+    free(cipher);
+    return NULL;
+  }
+  if (aes_gcm_opt(&cipher->gcm, quadruples->key, quadruples->iv, AES_OPT_TYPE_GCM_INIT)) {
+    AES_KEY_LOG_E("Failed to initialize AES-GCM with key and IV");
+    aes_encrypo_opt(&cipher->enc, NULL, NULL, AES_OPT_TYPE_ENC_DEINIT);
+    aes_decrypo_opt(&cipher->dec, NULL, NULL, AES_OPT_TYPE_DEC_DEINIT);
+    free(cipher);
+    return NULL;
+  }
+  cipher->gcm_seq = repeater_gcm_seq_seed();
+  cipher->refs = 1;
+  return cipher;
+}
+
+// 以下两个调用时持有 ctx.mutex
+static void repeater_cipher_put(RepeaterAesCipher *cipher) {
+  if (--cipher->refs > 0) return;
+  aes_encrypo_opt(&cipher->enc, NULL, NULL, AES_OPT_TYPE_ENC_DEINIT);
+  aes_decrypo_opt(&cipher->dec, NULL, NULL, AES_OPT_TYPE_DEC_DEINIT);
+  aes_gcm_opt(&cipher->gcm, NULL, NULL, AES_OPT_TYPE_GCM_DEINIT);
+  free(cipher);
+}
+
+// 四元组的 key/iv 变了或者被删除，下次借出时重建
+static void repeater_cipher_drop(RepeaterAesCipher **slot) {
+  if (*slot) {
+    repeater_cipher_put(*slot);
+    *slot = NULL;
+  }
+}
+
 void repeater_set_master_mac(const uint8_t *mac) {
   pthread_mutex_lock(&ctx.mutex);
   memcpy(ctx.master_mac, mac, 6);
@@ -131,11 +216,14 @@ int repeater_del_quadruples(const uint8_t *mac) {
   for (int i = 0; i < ctx.client_count; i++) {
     if (memcmp(ctx.repeater_quadruples[i].mac, mac, 6) == 0) {
       found = 1;
+      repeater_cipher_drop(&ctx.repeater_ciphers[i]);
       // Shift remaining entries left
       for (int j = i; j < ctx.client_count - 1; j++) {
         ctx.repeater_quadruples[j] = ctx.repeater_quadruples[j + 1];
+        ctx.repeater_ciphers[j] = ctx.repeater_ciphers[j + 1];
       }
       memset(&ctx.repeater_quadruples[ctx.client_count - 1], 0, sizeof(Quadruples));
+      ctx.repeater_ciphers[ctx.client_count - 1] = NULL;
       ctx.client_count--;
       char mac_str[18] = {0};
       AES_KEY_LOG_I("Deleted quadruples for MAC:%s", mat2str(mac, mac_str, sizeof(mac_str)));
@@ -154,6 +242,9 @@ int repeater_del_quadruples(const uint8_t *mac) {
 // 删除内机的所有四元组信息
 int repeater_del_all_quadruples(void) {
     pthread_mutex_lock(&ctx.mutex);
+    for (int i = 0; i < ctx.client_count; i++) {
+      repeater_cipher_drop(&ctx.repeater_ciphers[i]);
+    }
     ctx.client_count = 0;
     memset(ctx.repeater_quadruples, 0, sizeof(ctx.repeater_quadruples));
 //  COMM_FileUnlink(REPEATER_QUADRUPLES_CONFIG_FILE);
@@ -200,10 +291,13 @@ int repeater_sync_quadruples(char **mac, int mac_count) {
 //      RepeaterApp_send_del_slave(mac_str);
       uint16_t slave_id = (ctx.repeater_quadruples[idx].mac[4] << 8) | ctx.repeater_quadruples[idx].mac[5];
 //      RepeaterApp_master_client_kcp_connect_state_sync(-1, slave_id, mac_str);
+      repeater_cipher_drop(&ctx.repeater_ciphers[idx]);
       for (int k = idx; k < ctx.client_count - 1; k++) {
         ctx.repeater_quadruples[k] = ctx.repeater_quadruples[k + 1];
+        ctx.repeater_ciphers[k] = ctx.repeater_ciphers[k + 1];
       }
       memset(&ctx.repeater_quadruples[ctx.client_count - 1], 0, sizeof(Quadruples));
+      ctx.repeater_ciphers[ctx.client_count - 1] = NULL;
       ctx.client_count--;
       if (!need_save_file) need_save_file = 1;
       continue;
@@ -286,53 +380,38 @@ Quadruples *repeater_get_quadruples(const uint8_t *mac) {
   return NULL;
 }
 
-static aes_128_cbc_encrypo_t *_repeater_aes_enc_get(PQuadruples quadruples) {
-  if (!quadruples) {
-    AES_KEY_LOG_E("Invalid quadruples for getting AES encrypter");
-    return NULL;
-  }
-
-  aes_128_cbc_encrypo_t *enc = calloc(1, sizeof(aes_128_cbc_encrypo_t));
-  if (!enc) {
-    AES_KEY_LOG_E("Failed to allocate memory for AES encrypter");
-    return NULL;
-  }
-
-  AES_KEY_LOG_I("[ENC] quadruples->key: %.*s", AES_KEY_SIZE, quadruples->key);
-  AES_KEY_LOG_I("[ENC] quadruples->iv: %.*s", AES_KEY_SIZE, quadruples->iv);
-
-    // ✅ 把 key/iv 传回 cpp 层保存
-    set_aes_key_iv((const unsigned char*)quadruples->key, (const unsigned char*)quadruples->iv);
-
-  if (aes_encrypo_opt(enc, quadruples->key, quadruples->iv, AES_OPT_TYPE_ENC_INIT)) {
-    AES_KEY_LOG_E("Failed to initialize AES encrypter with key and IV");
-    free(enc);
-    return NULL;
+// 借出四元组的加解密器，没建过就先建，调用时持有 ctx.mutex
+static RepeaterAesCipher *repeater_cipher_borrow(RepeaterAesCipher **slot, PQuadruples quadruples) {
+  if (!*slot) {
+    *slot = repeater_cipher_new(quadruples);
+    if (!*slot) return NULL;
   }
-  return enc;
+  (*slot)->refs++;
+  return *slot;
 }
 
-static aes_128_cbc_decrypo_t *_repeater_aes_dec_get(PQuadruples quadruples) {
-  if (!quadruples) {
-    AES_KEY_LOG_E("Invalid quadruples for getting AES decrypter");
-    return NULL;
+static int repeater_find_quadruples(const uint8_t *mac) {
+  for (int i = 0; i < ctx.client_count; i++) {
+    if (memcmp(ctx.repeater_quadruples[i].mac, mac, sizeof(ctx.repeater_quadruples[i].mac)) == 0) {
+      return i;
+    }
   }
+  return -1;
+}
 
-  aes_128_cbc_decrypo_t *dec = calloc(1, sizeof(aes_128_cbc_decrypo_t));
-  if (!dec) {
-    AES_KEY_LOG_E("Failed to allocate memory for AES decrypter");
-    return NULL;
+static RepeaterAesCipher *repeater_cipher_borrow_mac(const uint8_t *mac) {
+  RepeaterAesCipher *cipher = NULL;
+  pthread_mutex_lock(&ctx.mutex);
+  int i = repeater_find_quadruples(mac);
+  if (i >= 0) {
+    cipher = repeater_cipher_borrow(&ctx.repeater_ciphers[i], &ctx.repeater_quadruples[i]);
   }
-
-  AES_KEY_LOG_I("[DEC] quadruples->key: %.*s", AES_KEY_SIZE, quadruples->key);
-  AES_KEY_LOG_I("[DEC] quadruples->iv: %.*s", AES_KEY_SIZE, quadruples->iv);
-
-  if (aes_decrypo_opt(dec, quadruples->key, quadruples->iv, AES_OPT_TYPE_DEC_INIT)) {
-    AES_KEY_LOG_E("Failed to initialize AES decrypter with key and IV");
-    free(dec);
-    return NULL;
+  pthread_mutex_unlock(&ctx.mutex);
+  if (i < 0) {
+    char mac_str[18] = {0};
+    AES_KEY_LOG_W("Quadruples not found for MAC:%s", mat2str(mac, mac_str, sizeof(mac_str)));
   }
-  return dec;
+  return cipher;
 }
 
 aes_128_cbc_encrypo_t *repeater_aes_enc_get(const uint8_t *mac) {
@@ -340,13 +419,8 @@ aes_128_cbc_encrypo_t *repeater_aes_enc_get(const uint8_t *mac) {
     AES_KEY_LOG_E("Invalid MAC address for getting AES encrypter");
     return NULL;
   }
-
-  Quadruples *quadruples = repeater_get_quadruples(mac);
-  if (!quadruples) {
-    AES_KEY_LOG_W("Quadruples not found for MAC:%.*s", 6, mac);
-    return NULL;
-  }
-  return _repeater_aes_enc_get(quadruples);
+  RepeaterAesCipher *cipher = repeater_cipher_borrow_mac(mac);
+  return cipher ? &cipher->enc : NULL;
 }
 
 aes_128_cbc_decrypo_t *repeater_aes_dec_get(const uint8_t *mac) {
@@ -354,32 +428,52 @@ aes_128_cbc_decrypo_t *repeater_aes_dec_get(const uint8_t *mac) {
     AES_KEY_LOG_E("Invalid MAC address for getting AES decrypter");
     return NULL;
   }
+  RepeaterAesCipher *cipher = repeater_cipher_borrow_mac(mac);
+  return cipher ? &cipher->dec : NULL;
+}
 
-  Quadruples *quadruples = repeater_get_quadruples(mac);
-  if (!quadruples) {
-    AES_KEY_LOG_W("Quadruples not found for MAC:%.*s", 6, mac);
+aes_128_cbc_encrypo_t *repeater_client_aes_enc_get(void) {
+  pthread_mutex_lock(&ctx.mutex);
+  RepeaterAesCipher *cipher = repeater_cipher_borrow(&ctx.client_cipher, &ctx.client_quadruples);
+  pthread_mutex_unlock(&ctx.mutex);
+  return cipher ? &cipher->enc : NULL;
+}
+aes_128_cbc_decrypo_t *repeater_client_aes_dec_get(void) {
+  pthread_mutex_lock(&ctx.mutex);
+  RepeaterAesCipher *cipher = repeater_cipher_borrow(&ctx.client_cipher, &ctx.client_quadruples);
+  pthread_mutex_unlock(&ctx.mutex);
+  return cipher ? &cipher->dec : NULL;
+}
+
+aes_128_gcm_t *repeater_aes_gcm_get(const uint8_t *mac) {
+  if (!mac) {
+    AES_KEY_LOG_E("Invalid MAC address for getting AES-GCM");
     return NULL;
   }
-  return _repeater_aes_dec_get(quadruples);
+  RepeaterAesCipher *cipher = repeater_cipher_borrow_mac(mac);
+  return cipher ? &cipher->gcm : NULL;
 }
 
-aes_128_cbc_encrypo_t *repeater_client_aes_enc_get(void) {
+aes_128_gcm_t *repeater_client_aes_gcm_get(void) {
   pthread_mutex_lock(&ctx.mutex);
-  aes_128_cbc_encrypo_t *enc = _repeater_aes_enc_get(&(ctx.client_quadruples));
+  RepeaterAesCipher *cipher = repeater_cipher_borrow(&ctx.client_cipher, &ctx.client_quadruples);
   pthread_mutex_unlock(&ctx.mutex);
-  return enc;
+  return cipher ? &cipher->gcm : NULL;
 }
-aes_128_cbc_decrypo_t *repeater_client_aes_dec_get(void) {
+
+uint64_t repeater_aes_gcm_next_seq(aes_128_gcm_t *gcm) {
   pthread_mutex_lock(&ctx.mutex);
-  aes_128_cbc_decrypo_t *dec = _repeater_aes_dec_get(&(ctx.client_quadruples));
+  uint64_t seq = REPEATER_CIPHER_OF(gcm, gcm)->gcm_seq++;
   pthread_mutex_unlock(&ctx.mutex);
-  return dec;
+  return seq;
 }
 
+// 归还 *_get 借出的加解密器，四元组已经更新或删除时在这里释放旧的
 void repeater_aes_enc_deinit(aes_128_cbc_encrypo_t *enc) {
   if (enc) {
-    aes_encrypo_opt(enc, NULL, NULL, AES_OPT_TYPE_ENC_DEINIT);
-    free(enc);
+    pthread_mutex_lock(&ctx.mutex);
+    repeater_cipher_put(REPEATER_CIPHER_OF(enc, enc));
+    pthread_mutex_unlock(&ctx.mutex);
   } else {
     AES_KEY_LOG_E("Attempted to deinitialize a NULL AES encrypter");
   }
@@ -387,13 +481,24 @@ void repeater_aes_enc_deinit(aes_128_cbc_encrypo_t *enc) {
 
 void repeater_aes_dec_deinit(aes_128_cbc_decrypo_t *dec) {
   if (dec) {
-    aes_decrypo_opt(dec, NULL, NULL, AES_OPT_TYPE_DEC_DEINIT);
-    free(dec);
+    pthread_mutex_lock(&ctx.mutex);
+    repeater_cipher_put(REPEATER_CIPHER_OF(dec, dec));
+    pthread_mutex_unlock(&ctx.mutex);
   } else {
     AES_KEY_LOG_E("Attempted to deinitialize a NULL AES decrypter");
   }
 }
 
+void repeater_aes_gcm_deinit(aes_128_gcm_t *gcm) {
+  if (gcm) {
+    pthread_mutex_lock(&ctx.mutex);
+    repeater_cipher_put(REPEATER_CIPHER_OF(gcm, gcm));
+    pthread_mutex_unlock(&ctx.mutex);
+  } else {
+    AES_KEY_LOG_E("Attempted to deinitialize a NULL AES-GCM");
+  }
+}
+
 int repeater_add_quadruples(PQuadruples quadruples) {
   if (!quadruples) {
     AES_KEY_LOG_E("Invalid quadruples for adding");
@@ -407,8 +512,9 @@ int repeater_add_quadruples(PQuadruples quadruples) {
     return -1;
   }
 
-  Quadruples *quad = &(ctx.repeater_quadruples[ctx.client_count++]);
+  Quadruples *quad = &(ctx.repeater_quadruples[ctx.client_count]);
   memcpy(quad, quadruples, sizeof(Quadruples));
+  repeater_cipher_drop(&ctx.repeater_ciphers[ctx.client_count++]);
   pthread_mutex_unlock(&ctx.mutex);
   char mac_buff[18] = {0};
   AES_KEY_LOG_I("Added quadruple %d: MAC[%s]", ctx.client_count - 1, mat2str(quad->mac, mac_buff, sizeof(mac_buff)));
@@ -427,11 +533,15 @@ int repeater_update_quadruples(PQuadruples quadruples) {
       if (quadruples->ip.s_addr != 0) {
         ctx.repeater_quadruples[i].ip = quadruples->ip;
       }
-      if (quadruples->key[0] != 0) {
+      if (quadruples->key[0] != 0 &&
+          memcmp(ctx.repeater_quadruples[i].key, quadruples->key, sizeof(ctx.repeater_quadruples[i].key)) != 0) {
         memcpy(ctx.repeater_quadruples[i].key, quadruples->key, sizeof(ctx.repeater_quadruples[i].key));
+        repeater_cipher_drop(&ctx.repeater_ciphers[i]);
       }
-      if (quadruples->iv[0] != 0) {
+      if (quadruples->iv[0] != 0 &&
+          memcmp(ctx.repeater_quadruples[i].iv, quadruples->iv, sizeof(ctx.repeater_quadruples[i].iv)) != 0) {
         memcpy(ctx.repeater_quadruples[i].iv, quadruples->iv, sizeof(ctx.repeater_quadruples[i].iv));
+        repeater_cipher_drop(&ctx.repeater_ciphers[i]);
       }
       pthread_mutex_unlock(&ctx.mutex);
       char buff[18] = {0};
@@ -454,6 +564,10 @@ void repeater_init_client_quadruples(PQuadruples quadruples) {
     return;
   }
   pthread_mutex_lock(&ctx.mutex);
+  if (memcmp(ctx.client_quadruples.key, quadruples->key, AES_KEY_SIZE) != 0 ||
+      memcmp(ctx.client_quadruples.iv, quadruples->iv, AES_KEY_SIZE) != 0) {
+    repeater_cipher_drop(&ctx.client_cipher);
+  }
   memcpy(&ctx.client_quadruples, quadruples, sizeof(Quadruples));
   pthread_mutex_unlock(&ctx.mutex);
     AES_KEY_LOG_E("repeater_init_client_quadruples quadruples for initializing client success");
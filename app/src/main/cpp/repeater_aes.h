@@ -26,6 +26,12 @@ aes_128_cbc_encrypo_t *repeater_aes_enc_get(const uint8_t *mac);
 aes_128_cbc_decrypo_t *repeater_aes_dec_get(const uint8_t *mac);
 aes_128_cbc_encrypo_t *repeater_client_aes_enc_get(void);
 aes_128_cbc_decrypo_t *repeater_client_aes_dec_get(void);
+// 媒体帧用的 AES-GCM，nonce 和 aad 见 aes_gcm_encrypt_frame / media_frame_aad
+aes_128_gcm_t *repeater_aes_gcm_get(const uint8_t *mac);
+aes_128_gcm_t *repeater_client_aes_gcm_get(void);
+// 给借出的 gcm 取一个发送序号，作为 aes_gcm_encrypt_frame 的 frame_index。
+// 同一个 key 下单调递增、不会重复，和调用方自己的帧序号无关，要随密文一起发给对端
+uint64_t repeater_aes_gcm_next_seq(aes_128_gcm_t *gcm);
 
 int repeater_update_quadruples(PQuadruples quadruples);
 int repeater_del_quadruples(const uint8_t *mac);
@@ -39,6 +45,7 @@ void repeater_get_default_key(uint8_t *key);
 
 void repeater_aes_enc_deinit(aes_128_cbc_encrypo_t *enc);
 void repeater_aes_dec_deinit(aes_128_cbc_decrypo_t *dec);
+void repeater_aes_gcm_deinit(aes_128_gcm_t *gcm);
 
 void repeater_save_quadruples(void);
 void repeater_load_quadruples(void);
@@ -68,6 +68,34 @@ Java_com_switchbot_doorbell_TcpClient_recvData(JNIEnv *env, jobject thiz, jlong
     return ret;
 }
 
+// 直接发送 direct ByteBuffer 中 [offset, offset + len) 的数据，不经过 Java 数组拷贝
+JNIEXPORT jint JNICALL
+Java_com_switchbot_doorbell_TcpClient_sendDirect(JNIEnv *env, jobject thiz, jlong handle, jobject buffer, jint offset,
+                                                 jint len) {
+    PTcpClient client = toClient(handle);
+    if (!client) return -1;
+
+    char *data = static_cast<char *>(env->GetDirectBufferAddress(buffer));
+    jlong capacity = env->GetDirectBufferCapacity(buffer);
+    if (!data || offset < 0 || len < 0 || (jlong)offset + len > capacity) return -1;
+
+    return tcp_client_send_data(client, data + offset, len);
+}
+
+// 直接读满 len 字节到 direct ByteBuffer 的 offset 处
+JNIEXPORT jint JNICALL
+Java_com_switchbot_doorbell_TcpClient_recvInto(JNIEnv *env, jobject thiz, jlong handle, jobject buffer, jint offset,
+                                               jint len) {
+    PTcpClient client = toClient(handle);
+    if (!client) return -1;
+
+    char *data = static_cast<char *>(env->GetDirectBufferAddress(buffer));
+    jlong capacity = env->GetDirectBufferCapacity(buffer);
+    if (!data || offset < 0 || len <= 0 || (jlong)offset + len > capacity) return -1;
+
+    return tcp_client_recv_data(client, data + offset, len, len);
+}
+
 // 释放客户端资源
 JNIEXPORT void JNICALL
 Java_com_switchbot_doorbell_TcpClient_release(JNIEnv *env, jobject thiz, jlong handle) {
@@ -1,4 +1,5 @@
 #include "wo_aes.h"
+#include "aes_pool.h"
 
 #include <stdint.h>
 #include <stdio.h>
@@ -59,6 +60,77 @@ static int aes_padding_pkcs7_get(unsigned char *data, int data_len) {
   return (len * (bad == 0));
 }
 
+// 整块 CBC 加解密，iv 更新为最后一块密文，有硬件加速时走 aes_accel
+static void aes_cbc_enc_blocks(const aes_128_cbc_encrypo_t *enc, unsigned char *iv, const unsigned char *in,
+                               unsigned char *out, int len) {
+  if (!enc->accel || aes_accel_cbc_encrypt(&enc->rk, iv, in, out, len) != 0) {
+#if USE_MBEDTLS
+    mbedtls_aes_crypt_cbc((mbedtls_aes_context *)&enc->aes, MBEDTLS_AES_ENCRYPT, len, iv, in, out);
+#elif USE_OPENSSL
+    AES_cbc_encrypt(in, out, len, &enc->aes_key_enc, iv, AES_ENCRYPT);
+#endif
+  }
+}
+
+static void aes_cbc_dec_serial(const aes_128_cbc_decrypo_t *dec, unsigned char *iv, const unsigned char *in,
+                               unsigned char *out, int len) {
+  if (!dec->accel || aes_accel_cbc_decrypt(&dec->rk, iv, in, out, len) != 0) {
+#if USE_MBEDTLS
+    mbedtls_aes_crypt_cbc((mbedtls_aes_context *)&dec->aes, MBEDTLS_AES_DECRYPT, len, iv, in, out);
+#elif USE_OPENSSL
+    AES_cbc_encrypt(in, out, len, &dec->aes_key_dec, iv, AES_DECRYPT);
+#endif
+  }
+}
+
+// CBC 解密每块只依赖自己和前一块密文，可以切成几段分给 aes_pool 并行，
+// 每段的 iv 是前一段最后一块密文。硬件加速已经 4 块交织，单线程也很快，
+// 线程唤醒的开销要摊到更大的数据上，所以两种后端的起点不一样，
+// 都取单线程大约 200us 的数据量（硬件 ~1GB/s，没有 CE 的手机上软件实现几十 MB/s）
+#define AES_CBC_PAR_MIN_ACCEL (256 * 1024)
+#define AES_CBC_PAR_MIN_SOFT (16 * 1024)
+#define AES_CBC_PAR_MAX_CHUNKS (AES_POOL_MAX_WORKERS + 1)
+
+typedef struct aes_cbc_par_t {
+  const aes_128_cbc_decrypo_t *dec;
+  const unsigned char *in;
+  unsigned char *out;
+  int len;
+  int chunk;
+  unsigned char iv[AES_CBC_PAR_MAX_CHUNKS][AES_BLOCK_SIZE];
+} aes_cbc_par_t;
+
+static void aes_cbc_par_chunk(void *arg, int idx) {
+  aes_cbc_par_t *par = (aes_cbc_par_t *)arg;
+  int off = idx * par->chunk;
+  int len = par->len - off < par->chunk ? par->len - off : par->chunk;
+  aes_cbc_dec_serial(par->dec, par->iv[idx], par->in + off, par->out + off, len);
+}
+
+static void aes_cbc_dec_blocks(const aes_128_cbc_decrypo_t *dec, unsigned char *iv, const unsigned char *in,
+                               unsigned char *out, int len) {
+  aes_cbc_par_t par;
+  int blocks = len / AES_BLOCK_SIZE, n;
+
+  if (len < (dec->accel ? AES_CBC_PAR_MIN_ACCEL : AES_CBC_PAR_MIN_SOFT) || (n = aes_pool_threads()) == 1) {
+    aes_cbc_dec_serial(dec, iv, in, out, len);
+    return;
+  }
+  if (n > AES_CBC_PAR_MAX_CHUNKS) n = AES_CBC_PAR_MAX_CHUNKS;
+  par.dec = dec;
+  par.in = in;
+  par.out = out;
+  par.len = len;
+  par.chunk = (blocks + n - 1) / n * AES_BLOCK_SIZE;
+  n = (len + par.chunk - 1) / par.chunk;
+  // 原地解密时前一段会覆盖后一段要用的 iv，开工前先全部取出来
+  memcpy(par.iv[0], iv, AES_BLOCK_SIZE);
+  for (int i = 1; i < n; i++) memcpy(par.iv[i], in + i * par.chunk - AES_BLOCK_SIZE, AES_BLOCK_SIZE);
+  memcpy(iv, in + len - AES_BLOCK_SIZE, AES_BLOCK_SIZE);
+
+  aes_pool_run(aes_cbc_par_chunk, &par, n);
+}
+
 // 3、初始化或者反初始化解密器
 int aes_encrypo_opt(aes_128_cbc_encrypo_t *enc, const unsigned char *key, const unsigned char *iv, AES_OPT_TYPE opt) {
   switch (opt) {
@@ -73,6 +145,7 @@ int aes_encrypo_opt(aes_128_cbc_encrypo_t *enc, const unsigned char *key, const
 #elif USE_OPENSSL
         AES_set_encrypt_key(enc->key, AES_KEY_SIZE * 8, &enc->aes_key_enc);
 #endif
+        enc->accel = aes_accel_setkey_enc(&enc->rk, key) == 0;
 
         enc->is_init = 1;
       }
@@ -84,6 +157,8 @@ int aes_encrypo_opt(aes_128_cbc_encrypo_t *enc, const unsigned char *key, const
 #if USE_MBEDTLS
         mbedtls_aes_free(&enc->aes);
 #endif
+        memset(&enc->rk, 0, sizeof(enc->rk));
+        enc->accel = 0;
         enc->is_init = 0;
       }
       break;
@@ -97,26 +172,20 @@ int aes_encrypo_opt(aes_128_cbc_encrypo_t *enc, const unsigned char *key, const
 // 2、加密数据
 int aes_encrypo_data(aes_128_cbc_encrypo_t *enc, const char *in, int in_len, char *out) {
   if (enc->is_init) {
-    int len = 0, ret = 0;
-    unsigned char iv[AES_KEY_SIZE] = "0";
-    memcpy(out, in, in_len);
-    memcpy(iv, enc->iv, AES_KEY_SIZE);
+    int len = 0;
+    aes_cbc_stream_t st;
 
-    // 1.把输入的数据拷贝到out，然后对out进行pkcs7填充，pkcs7的填充原则是把填充的字节长度作为填充的内容
-    len = aes_padding_pkcs7_set(out, in_len);
-
-#if USE_MBEDTLS
-    ret = mbedtls_aes_crypt_cbc(&enc->aes, MBEDTLS_AES_ENCRYPT, len, iv, out, out);
-#elif USE_OPENSSL
-    AES_cbc_encrypt(out, out, len, &enc->aes_key_enc, iv, AES_ENCRYPT);
-#endif
+    // 1.整块直接从 in 加密到 out，最后不满一块的部分做 pkcs7 填充后再加密
+    aes_encrypo_init(enc, &st);
+    len = aes_encrypo_update(enc, &st, in, in_len, out);
+    len += aes_encrypo_final(enc, &st, out + len);
 
-      // 🔹 打印加密后的数据（16进制）
+      // 🔹 打印加密后的数据（16进制），只打前 32 字节，整帧打印既慢又会写爆 hexBuf
       char hexBuf[1024] = {0};
       char *p = hexBuf;
-      for (int i = 0; i < len; i++) {
+      for (int i = 0; i < len && i < 32; i++) {
           p += sprintf(p, "%02X", (unsigned char)out[i]);
-          if (i < len - 1) *p++ = ':';  // 美观分隔
+          if (i < len - 1 && i < 31) *p++ = ':';  // 美观分隔
       }
       *p = '\0';
       LOGD("AES Encrypt Output (len=%d): %s", len, hexBuf);
@@ -139,6 +208,7 @@ int aes_decrypo_opt(aes_128_cbc_decrypo_t *dec, const unsigned char *key, const
 #elif USE_OPENSSL
         AES_set_decrypt_key(dec->key, AES_KEY_SIZE * 8, &dec->aes_key_dec);
 #endif
+        dec->accel = aes_accel_setkey_dec(&dec->rk, key) == 0;
 
         dec->is_init = 1;
       }
@@ -150,6 +220,8 @@ int aes_decrypo_opt(aes_128_cbc_decrypo_t *dec, const unsigned char *key, const
 #if USE_MBEDTLS
         mbedtls_aes_free(&dec->aes);
 #endif
+        memset(&dec->rk, 0, sizeof(dec->rk));
+        dec->accel = 0;
         dec->is_init = 0;
       }
       break;
@@ -164,36 +236,200 @@ int aes_decrypo_opt(aes_128_cbc_decrypo_t *dec, const unsigned char *key, const
 int aes_decrypo_data(aes_128_cbc_decrypo_t *dec, const char *in, int in_len, char *out) {
   if (!dec || !in || !dec->is_init) return -1;
 
-  int ret = 0;
   int len = in_len;
   unsigned char iv[AES_KEY_SIZE] = "0";
   memcpy(iv, dec->iv, AES_KEY_SIZE);
 
-#if USE_MBEDTLS
-  ret = mbedtls_aes_crypt_cbc(&dec->aes, MBEDTLS_AES_DECRYPT, in_len, iv, in, out);
-#elif USE_OPENSSL
-  AES_cbc_encrypt(in, out, in_len, &dec->aes_key_dec, iv, AES_DECRYPT);
-#endif
+  aes_cbc_dec_blocks(dec, iv, in, out, in_len);
 
   len = aes_padding_pkcs7_get(out, len);
   return len;
 }
 
-// 5、初始化加密器
+// 5、分段加密
+int aes_encrypo_init(const aes_128_cbc_encrypo_t *enc, aes_cbc_stream_t *st) {
+  if (!enc || !st || !enc->is_init) return -1;
+  memcpy(st->iv, enc->iv, AES_BLOCK_SIZE);
+  st->buf_len = 0;
+  return 0;
+}
+
+int aes_encrypo_update(const aes_128_cbc_encrypo_t *enc, aes_cbc_stream_t *st, const char *in, int in_len, char *out) {
+  const unsigned char *src = (const unsigned char *)in;
+  unsigned char *dst = (unsigned char *)out;
+  int written = 0, bulk;
+
+  if (in_len <= 0) return 0;
+  // 先补满上次剩下的那一块
+  if (st->buf_len > 0) {
+    int n = AES_BLOCK_SIZE - st->buf_len;
+    if (n > in_len) n = in_len;
+    memcpy(st->buf + st->buf_len, src, n);
+    st->buf_len += n;
+    src += n;
+    in_len -= n;
+    if (st->buf_len < AES_BLOCK_SIZE) return 0;
+    aes_cbc_enc_blocks(enc, st->iv, st->buf, dst, AES_BLOCK_SIZE);
+    st->buf_len = 0;
+    written = AES_BLOCK_SIZE;
+  }
+  bulk = in_len - in_len % AES_BLOCK_SIZE;
+  if (bulk > 0) {
+    aes_cbc_enc_blocks(enc, st->iv, src, dst + written, bulk);
+    written += bulk;
+  }
+  memcpy(st->buf, src + bulk, in_len - bulk);
+  st->buf_len = in_len - bulk;
+  return written;
+}
+
+int aes_encrypo_final(const aes_128_cbc_encrypo_t *enc, aes_cbc_stream_t *st, char *out) {
+  aes_padding_pkcs7_set(st->buf, st->buf_len);
+  aes_cbc_enc_blocks(enc, st->iv, st->buf, (unsigned char *)out, AES_BLOCK_SIZE);
+  memset(st->buf, 0, sizeof(st->buf));
+  st->buf_len = 0;
+  return AES_BLOCK_SIZE;
+}
+
+// 6、分段解密
+int aes_decrypo_init(const aes_128_cbc_decrypo_t *dec, aes_cbc_stream_t *st) {
+  if (!dec || !st || !dec->is_init) return -1;
+  memcpy(st->iv, dec->iv, AES_BLOCK_SIZE);
+  st->buf_len = 0;
+  return 0;
+}
+
+int aes_decrypo_update(const aes_128_cbc_decrypo_t *dec, aes_cbc_stream_t *st, const char *in, int in_len, char *out) {
+  const unsigned char *src = (const unsigned char *)in;
+  unsigned char *dst = (unsigned char *)out;
+  int written = 0, bulk;
+
+  if (in_len <= 0) return 0;
+  // 最后一块带填充，要等 final 才知道哪块是最后一块，所以总留一块在 buf 里
+  if (st->buf_len + in_len <= AES_BLOCK_SIZE) {
+    memcpy(st->buf + st->buf_len, src, in_len);
+    st->buf_len += in_len;
+    return 0;
+  }
+  if (st->buf_len > 0) {
+    int n = AES_BLOCK_SIZE - st->buf_len;
+    memcpy(st->buf + st->buf_len, src, n);
+    src += n;
+    in_len -= n;
+    aes_cbc_dec_blocks(dec, st->iv, st->buf, dst, AES_BLOCK_SIZE);
+    written = AES_BLOCK_SIZE;
+  }
+  // 剩 1~16 字节留给下次
+  bulk = in_len > 0 ? (in_len - 1) / AES_BLOCK_SIZE * AES_BLOCK_SIZE : 0;
+  if (bulk > 0) {
+    aes_cbc_dec_blocks(dec, st->iv, src, dst + written, bulk);
+    written += bulk;
+  }
+  memcpy(st->buf, src + bulk, in_len - bulk);
+  st->buf_len = in_len - bulk;
+  return written;
+}
+
+int aes_decrypo_final(const aes_128_cbc_decrypo_t *dec, aes_cbc_stream_t *st, char *out) {
+  unsigned char blk[AES_BLOCK_SIZE], pad, bad;
+  int len;
+
+  if (st->buf_len != AES_BLOCK_SIZE) return -1;
+  aes_cbc_dec_blocks(dec, st->iv, st->buf, blk, AES_BLOCK_SIZE);
+  st->buf_len = 0;
+  pad = blk[AES_BLOCK_SIZE - 1];
+  bad = (pad == 0) | (pad > AES_BLOCK_SIZE);
+  for (int i = 0; i < AES_BLOCK_SIZE; i++) {
+    bad |= (blk[i] ^ pad) * (i >= AES_BLOCK_SIZE - pad);
+  }
+  len = bad ? -1 : AES_BLOCK_SIZE - pad;
+  if (len > 0) memcpy(out, blk, len);
+  memset(blk, 0, sizeof(blk));
+  return len;
+}
+
+// 7、按需拉取密文
+int aes_encrypo_source_init(aes_cbc_source_t *src, const aes_128_cbc_encrypo_t *enc, const struct iovec *iov,
+                            int iovcnt) {
+  size_t total = 0;
+  if (!src || aes_encrypo_init(enc, &src->st) != 0 || iovcnt < 0 || (iovcnt > 0 && !iov)) return -1;
+  for (int i = 0; i < iovcnt; i++) total += iov[i].iov_len;
+  if (total > 0x7fffffff - AES_BLOCK_SIZE) return -1;
+  src->enc = enc;
+  src->iov = iov;
+  src->iovcnt = iovcnt;
+  src->off = 0;
+  src->blk_off = 0;
+  src->blk_len = 0;
+  src->done = 0;
+  return get_aes_enc_out_len((int)total);
+}
+
+int aes_encrypo_fill(char *out, int size, void *user) {
+  aes_cbc_source_t *src = (aes_cbc_source_t *)user;
+  int n = 0;
+
+  while (n < size) {
+    int room, k;
+    const char *p;
+    // 上次跨界的那块密文先取完
+    if (src->blk_off < src->blk_len) {
+      k = src->blk_len - src->blk_off;
+      if (k > size - n) k = size - n;
+      memcpy(out + n, src->blk + src->blk_off, k);
+      src->blk_off += k;
+      n += k;
+      continue;
+    }
+    if (src->done) break;
+    while (src->iovcnt > 0 && src->off >= src->iov->iov_len) {
+      src->iov++;
+      src->iovcnt--;
+      src->off = 0;
+    }
+    // 能放下的整块直接加密进 out，放不下的那一块先加密到 blk
+    room = (size - n) / AES_BLOCK_SIZE * AES_BLOCK_SIZE;
+    if (src->iovcnt == 0) {
+      if (room > 0) {
+        n += aes_encrypo_final(src->enc, &src->st, out + n);
+      } else {
+        aes_encrypo_final(src->enc, &src->st, (char *)src->blk);
+        src->blk_off = 0;
+        src->blk_len = AES_BLOCK_SIZE;
+      }
+      src->done = 1;
+      continue;
+    }
+    p = (const char *)src->iov->iov_base + src->off;
+    k = (int)(src->iov->iov_len - src->off);
+    if (room > 0) {
+      if (k > room - src->st.buf_len) k = room - src->st.buf_len;
+      n += aes_encrypo_update(src->enc, &src->st, p, k, out + n);
+    } else {
+      if (k > AES_BLOCK_SIZE - src->st.buf_len) k = AES_BLOCK_SIZE - src->st.buf_len;
+      src->blk_off = 0;
+      src->blk_len = aes_encrypo_update(src->enc, &src->st, p, k, (char *)src->blk);
+    }
+    src->off += k;
+  }
+  return n;
+}
+
+// 8、初始化加密器
 int init_enc_dec(aes_128_cbc_encrypo_t *enc, aes_128_cbc_decrypo_t *dec, char *key, char *iv) {
   aes_encrypo_opt(enc, key, iv, AES_OPT_TYPE_ENC_INIT);
   aes_decrypo_opt(dec, key, iv, AES_OPT_TYPE_DEC_INIT);
   return 0;
 }
 
-// 6、初始化解密器
+// 9、初始化解密器
 int deinit_enc_dec(aes_128_cbc_encrypo_t *enc, aes_128_cbc_decrypo_t *dec) {
   aes_encrypo_opt(enc, NULL, NULL, AES_OPT_TYPE_ENC_DEINIT);
   aes_decrypo_opt(dec, NULL, NULL, AES_OPT_TYPE_DEC_DEINIT);
   return 0;
 }
 
-// 7、先加密再解密数据
+// 10、先加密再解密数据
 int enc_dec_data(aes_128_cbc_encrypo_t *enc, aes_128_cbc_decrypo_t *dec) {
   // unsigned char src_data[] = "The quick brown ";
   unsigned char src_data[] = "Hello AES Data, Hello AES Data, Hello AES Data, Hello AES Data";
@@ -2,6 +2,9 @@
 #define __AES_128_CBC_H__
 
 #include <stdint.h>
+#include <sys/uio.h>
+
+#include "aes_accel.h"
 
 #define USE_OPENSSL 0
 #define USE_MBEDTLS 1
@@ -24,6 +27,9 @@ typedef enum AES_OPT_TYPE {
 
     AES_OPT_TYPE_DEC_INIT,
     AES_OPT_TYPE_DEC_DEINIT,
+
+    AES_OPT_TYPE_GCM_INIT,
+    AES_OPT_TYPE_GCM_DEINIT,
 } AES_OPT_TYPE;
 
 typedef struct aes_128_cbc_encrypo_t {
@@ -35,6 +41,9 @@ typedef struct aes_128_cbc_encrypo_t {
     AES_KEY aes_key_enc;
 #endif
 
+    int32_t accel;  // CPU 支持时走 aes_accel，否则用上面的软件实现
+    aes_accel_key_t rk;
+
     unsigned char key[AES_KEY_SIZE];
     unsigned char iv[AES_KEY_SIZE];
 
@@ -49,11 +58,57 @@ typedef struct aes_128_cbc_decrypo_t {
     AES_KEY aes_key_dec;
 #endif
 
+    int32_t accel;
+    aes_accel_key_t rk;
+
     unsigned char key[AES_KEY_SIZE];
     unsigned char iv[AES_KEY_SIZE];
 
 } aes_128_cbc_decrypo_t;
 
+// 分段 CBC 的状态：链接用的上一块密文和不满一块的残留都在这里，enc/dec
+// 本身只读，同一个 enc/dec 可以同时跑多条流
+typedef struct aes_cbc_stream_t {
+    unsigned char iv[AES_BLOCK_SIZE];
+    unsigned char buf[AES_BLOCK_SIZE];  // 加密：不满一块的明文；解密：留给 final 的最后一块密文
+    int buf_len;
+} aes_cbc_stream_t;
+
+// aes_encrypo_fill 的明文来源和进度，iov 可以直接指向 ring buffer 里的数据
+typedef struct aes_cbc_source_t {
+    const aes_128_cbc_encrypo_t *enc;
+    aes_cbc_stream_t st;
+    const struct iovec *iov;
+    int iovcnt;
+    size_t off;
+    unsigned char blk[AES_BLOCK_SIZE];  // 跨两次 fill 的那一块密文
+    int blk_off;
+    int blk_len;
+    int done;  // 填充块已经加密
+} aes_cbc_source_t;
+
+#define AES_GCM_NONCE_SIZE (12)
+#define AES_GCM_TAG_SIZE (16)
+
+// AES-128-GCM：不填充，密文和明文等长，后面跟 16 字节校验 tag。
+// 加解密时只读这个结构，同一个 gcm 可以被多个线程同时使用
+typedef struct aes_128_gcm_t {
+    int32_t is_init;
+
+#if USE_MBEDTLS
+    mbedtls_aes_context aes;
+#endif
+
+    int32_t accel;
+    aes_accel_key_t rk;
+
+    uint64_t hl[16];  // GHASH 的 4 bit 查表，由 H = E(K, 0) 生成
+    uint64_t hh[16];
+
+    unsigned char key[AES_KEY_SIZE];
+    unsigned char iv[AES_KEY_SIZE];  // 前 12 字节是 nonce 的固定部分
+} aes_128_gcm_t;
+
 static inline int get_aes_enc_out_len(int in_len) { return AES_BLOCK_SIZE - (in_len % AES_BLOCK_SIZE) + in_len; }
 
 int aes_encrypo_opt(aes_128_cbc_encrypo_t *enc, const unsigned char *key, const unsigned char *iv, AES_OPT_TYPE opt);
@@ -62,4 +117,39 @@ int aes_encrypo_data(aes_128_cbc_encrypo_t *enc, const char *in, int in_len, cha
 int aes_decrypo_opt(aes_128_cbc_decrypo_t *dec, const unsigned char *key, const unsigned char *iv, AES_OPT_TYPE opt);
 int aes_decrypo_data(aes_128_cbc_decrypo_t *dec, const char *in, int in_len, char *out);
 
+// 分段加密：update 只输出整块，返回写入 out 的字节数，out 至少要 in_len + 15 字节。
+// final 做 PKCS7 填充，写 16 字节。各段拼起来和 aes_encrypo_data 的输出一样
+int aes_encrypo_init(const aes_128_cbc_encrypo_t *enc, aes_cbc_stream_t *st);
+int aes_encrypo_update(const aes_128_cbc_encrypo_t *enc, aes_cbc_stream_t *st, const char *in, int in_len, char *out);
+int aes_encrypo_final(const aes_128_cbc_encrypo_t *enc, aes_cbc_stream_t *st, char *out);
+
+// 分段解密：update 总留最后一块给 final，out 至少要 in_len + 15 字节。
+// final 去掉填充，返回写入 out 的明文字节数（0~15），密文长度或填充不对返回 -1
+int aes_decrypo_init(const aes_128_cbc_decrypo_t *dec, aes_cbc_stream_t *st);
+int aes_decrypo_update(const aes_128_cbc_decrypo_t *dec, aes_cbc_stream_t *st, const char *in, int in_len, char *out);
+int aes_decrypo_final(const aes_128_cbc_decrypo_t *dec, aes_cbc_stream_t *st, char *out);
+
+// 按需拉取密文：aes_encrypo_source_init 返回密文总长，之后每次 aes_encrypo_fill
+// 往 out 写 size 字节（最后一次可能更少），明文直接从 iov 读，不另外拷一份。
+// aes_encrypo_fill 的形式和 ikcp_send_fill_t 一样，可以把密文直接写进 kcp 的分片：
+//   ikcp_send_fill(kcp, aes_encrypo_source_init(&src, enc, iov, 2), aes_encrypo_fill, &src);
+// iov 在 fill 全部完成前要保持有效
+int aes_encrypo_source_init(aes_cbc_source_t *src, const aes_128_cbc_encrypo_t *enc, const struct iovec *iov,
+                            int iovcnt);
+int aes_encrypo_fill(char *out, int size, void *src);
+
+// nonce = iv[0..11] 异或 (channel 大端 4 字节 | frame_index 大端 8 字节)。
+// 同一个 key 下 (channel, frame_index) 不能重复，所以各自计数的帧
+// （收发两个方向、音视频各一路）要用不同的 channel
+int aes_gcm_opt(aes_128_gcm_t *gcm, const unsigned char *key, const unsigned char *iv, AES_OPT_TYPE opt);
+
+// 加密 in_len 字节到 out，out 需要 in_len + AES_GCM_TAG_SIZE 字节，in 和 out 可以相同。
+// 返回写入 out 的长度，失败返回 -1
+int aes_gcm_encrypt_frame(const aes_128_gcm_t *gcm, uint32_t channel, uint64_t frame_index, const unsigned char *aad,
+                          int aad_len, const unsigned char *in, int in_len, unsigned char *out);
+
+// in_len 含 tag，返回明文长度。tag 不对（数据或 aad 被篡改、key 不对）返回 -1，out 清零
+int aes_gcm_decrypt_frame(const aes_128_gcm_t *gcm, uint32_t channel, uint64_t frame_index, const unsigned char *aad,
+                          int aad_len, const unsigned char *in, int in_len, unsigned char *out);
+
 #endif
\ No newline at end of file
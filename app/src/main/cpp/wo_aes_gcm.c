@@ -0,0 +1,231 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "wo_aes.h"
+
+// 一次处理的 CTR 块数，计数器块成批交给 aes_accel_ecb_encrypt 并行加密
+#define GCM_CTR_BATCH (16)
+
+// 4 bit 查表乘法的约减常数（NIST SP 800-38D 的 R = 0xe1 || 0^120）
+static const uint64_t gcm_last4[16] = {0x0000, 0x1c20, 0x3840, 0x2460, 0x7080, 0x6ca0, 0x48c0, 0x54e0,
+                                       0xe100, 0xfd20, 0xd940, 0xc560, 0x9180, 0x8da0, 0xa9c0, 0xb5e0};
+
+static uint64_t gcm_get_be64(const unsigned char *p) {
+  uint64_t v = 0;
+  for (int i = 0; i < 8; i++) v = (v << 8) | p[i];
+  return v;
+}
+
+static void gcm_put_be64(unsigned char *p, uint64_t v) {
+  for (int i = 7; i >= 0; i--, v >>= 8) p[i] = (unsigned char)v;
+}
+
+// len 为 16 的倍数，gcm 只用加密方向
+static void gcm_ecb(const aes_128_gcm_t *gcm, const unsigned char *in, unsigned char *out, size_t len) {
+  if (gcm->accel && aes_accel_ecb_encrypt(&gcm->rk, in, out, len) == 0) return;
+#if USE_MBEDTLS
+  for (size_t off = 0; off < len; off += AES_BLOCK_SIZE) {
+    mbedtls_aes_crypt_ecb((mbedtls_aes_context *)&gcm->aes, MBEDTLS_AES_ENCRYPT, in + off, out + off);
+  }
+#endif
+}
+
+static void gcm_gen_table(aes_128_gcm_t *gcm) {
+  unsigned char h[AES_BLOCK_SIZE] = {0};
+  uint64_t vh, vl;
+
+  gcm_ecb(gcm, h, h, AES_BLOCK_SIZE);
+  vh = gcm_get_be64(h);
+  vl = gcm_get_be64(h + 8);
+  memset(h, 0, sizeof(h));
+
+  gcm->hl[8] = vl;
+  gcm->hh[8] = vh;
+  gcm->hl[0] = 0;
+  gcm->hh[0] = 0;
+  for (int i = 4; i > 0; i >>= 1) {
+    uint32_t t = (uint32_t)(vl & 1) * 0xe1000000U;
+    vl = (vh << 63) | (vl >> 1);
+    vh = (vh >> 1) ^ ((uint64_t)t << 32);
+    gcm->hl[i] = vl;
+    gcm->hh[i] = vh;
+  }
+  for (int i = 2; i <= 8; i *= 2) {
+    for (int j = 1; j < i; j++) {
+      gcm->hh[i + j] = gcm->hh[i] ^ gcm->hh[j];
+      gcm->hl[i + j] = gcm->hl[i] ^ gcm->hl[j];
+    }
+  }
+}
+
+// x = x * H
+static void gcm_mult(const aes_128_gcm_t *gcm, unsigned char x[AES_BLOCK_SIZE]) {
+  unsigned char lo = x[15] & 0xf, hi, rem;
+  uint64_t zh = gcm->hh[lo], zl = gcm->hl[lo];
+
+  for (int i = 15; i >= 0; i--) {
+    lo = x[i] & 0xf;
+    hi = (x[i] >> 4) & 0xf;
+    if (i != 15) {
+      rem = (unsigned char)(zl & 0xf);
+      zl = (zh << 60) | (zl >> 4);
+      zh = (zh >> 4) ^ (gcm_last4[rem] << 48);
+      zh ^= gcm->hh[lo];
+      zl ^= gcm->hl[lo];
+    }
+    rem = (unsigned char)(zl & 0xf);
+    zl = (zh << 60) | (zl >> 4);
+    zh = (zh >> 4) ^ (gcm_last4[rem] << 48);
+    zh ^= gcm->hh[hi];
+    zl ^= gcm->hl[hi];
+  }
+  gcm_put_be64(x, zh);
+  gcm_put_be64(x + 8, zl);
+}
+
+// 把 data 并入 GHASH 累加值 y，不足一块的尾部补 0
+static void gcm_ghash(const aes_128_gcm_t *gcm, unsigned char y[AES_BLOCK_SIZE], const unsigned char *data, size_t len) {
+  while (len > 0) {
+    size_t n = len < AES_BLOCK_SIZE ? len : AES_BLOCK_SIZE;
+    for (size_t i = 0; i < n; i++) y[i] ^= data[i];
+    gcm_mult(gcm, y);
+    data += n;
+    len -= n;
+  }
+}
+
+static void gcm_inc32(unsigned char ctr[AES_BLOCK_SIZE]) {
+  for (int i = AES_BLOCK_SIZE - 1; i >= AES_BLOCK_SIZE - 4; i--) {
+    if (++ctr[i] != 0) break;
+  }
+}
+
+// CTR 加解密，ghash_in 为 1 时在异或前把输入（密文）并入 GHASH，否则异或后并入输出（密文）
+static void gcm_ctr(const aes_128_gcm_t *gcm, unsigned char ctr[AES_BLOCK_SIZE], unsigned char y[AES_BLOCK_SIZE],
+                    int ghash_in, const unsigned char *in, unsigned char *out, size_t len) {
+  unsigned char ks[GCM_CTR_BATCH * AES_BLOCK_SIZE];
+
+  while (len > 0) {
+    size_t n = len < sizeof(ks) ? len : sizeof(ks);
+    size_t blocks = (n + AES_BLOCK_SIZE - 1) / AES_BLOCK_SIZE;
+    for (size_t b = 0; b < blocks; b++) {
+      gcm_inc32(ctr);
+      memcpy(ks + b * AES_BLOCK_SIZE, ctr, AES_BLOCK_SIZE);
+    }
+    gcm_ecb(gcm, ks, ks, blocks * AES_BLOCK_SIZE);
+    if (ghash_in) gcm_ghash(gcm, y, in, n);
+    for (size_t i = 0; i < n; i++) out[i] = in[i] ^ ks[i];
+    if (!ghash_in) gcm_ghash(gcm, y, out, n);
+    in += n;
+    out += n;
+    len -= n;
+  }
+  memset(ks, 0, sizeof(ks));
+}
+
+static void gcm_nonce(const aes_128_gcm_t *gcm, uint32_t channel, uint64_t frame_index,
+                      unsigned char j0[AES_BLOCK_SIZE]) {
+  unsigned char seq[AES_GCM_NONCE_SIZE];
+  seq[0] = (unsigned char)(channel >> 24);
+  seq[1] = (unsigned char)(channel >> 16);
+  seq[2] = (unsigned char)(channel >> 8);
+  seq[3] = (unsigned char)channel;
+  gcm_put_be64(seq + 4, frame_index);
+  for (int i = 0; i < AES_GCM_NONCE_SIZE; i++) j0[i] = gcm->iv[i] ^ seq[i];
+  j0[12] = 0;
+  j0[13] = 0;
+  j0[14] = 0;
+  j0[15] = 1;
+}
+
+static void gcm_tag(const aes_128_gcm_t *gcm, const unsigned char j0[AES_BLOCK_SIZE], unsigned char y[AES_BLOCK_SIZE],
+                    int aad_len, int len, unsigned char tag[AES_GCM_TAG_SIZE]) {
+  unsigned char lens[AES_BLOCK_SIZE];
+  gcm_put_be64(lens, (uint64_t)aad_len * 8);
+  gcm_put_be64(lens + 8, (uint64_t)len * 8);
+  gcm_ghash(gcm, y, lens, sizeof(lens));
+  gcm_ecb(gcm, j0, tag, AES_BLOCK_SIZE);
+  for (int i = 0; i < AES_GCM_TAG_SIZE; i++) tag[i] ^= y[i];
+}
+
+// 1、初始化或者反初始化 gcm
+int aes_gcm_opt(aes_128_gcm_t *gcm, const unsigned char *key, const unsigned char *iv, AES_OPT_TYPE opt) {
+  switch (opt) {
+    case AES_OPT_TYPE_GCM_INIT: {
+      if (gcm->is_init == 0) {
+        memcpy(gcm->key, key, AES_KEY_SIZE);
+        memcpy(gcm->iv, iv, AES_KEY_SIZE);
+
+#if USE_MBEDTLS
+        mbedtls_aes_init(&gcm->aes);
+        mbedtls_aes_setkey_enc(&gcm->aes, key, AES_KEY_SIZE * 8);
+#endif
+        gcm->accel = aes_accel_setkey_enc(&gcm->rk, key) == 0;
+        gcm_gen_table(gcm);
+
+        gcm->is_init = 1;
+      }
+      break;
+    }
+
+    case AES_OPT_TYPE_GCM_DEINIT:
+      if (gcm->is_init) {
+#if USE_MBEDTLS
+        mbedtls_aes_free(&gcm->aes);
+#endif
+        memset(&gcm->rk, 0, sizeof(gcm->rk));
+        memset(gcm->hl, 0, sizeof(gcm->hl));
+        memset(gcm->hh, 0, sizeof(gcm->hh));
+        gcm->accel = 0;
+        gcm->is_init = 0;
+      }
+      break;
+
+    default:
+      break;
+  }
+  return gcm->is_init ? 0 : -1;
+}
+
+// 2、加密一帧，aad 只参与校验不加密，一般是帧头
+int aes_gcm_encrypt_frame(const aes_128_gcm_t *gcm, uint32_t channel, uint64_t frame_index, const unsigned char *aad,
+                          int aad_len, const unsigned char *in, int in_len, unsigned char *out) {
+  unsigned char j0[AES_BLOCK_SIZE], ctr[AES_BLOCK_SIZE], y[AES_BLOCK_SIZE] = {0};
+
+  if (!gcm || !gcm->is_init || in_len < 0 || aad_len < 0 || (in_len > 0 && (!in || !out)) || (aad_len > 0 && !aad)) {
+    return -1;
+  }
+  gcm_nonce(gcm, channel, frame_index, j0);
+  memcpy(ctr, j0, sizeof(ctr));
+  gcm_ghash(gcm, y, aad, aad_len);
+  gcm_ctr(gcm, ctr, y, 0, in, out, in_len);
+  gcm_tag(gcm, j0, y, aad_len, in_len, out + in_len);
+  return in_len + AES_GCM_TAG_SIZE;
+}
+
+// 3、校验并解密一帧
+int aes_gcm_decrypt_frame(const aes_128_gcm_t *gcm, uint32_t channel, uint64_t frame_index, const unsigned char *aad,
+                          int aad_len, const unsigned char *in, int in_len, unsigned char *out) {
+  unsigned char j0[AES_BLOCK_SIZE], ctr[AES_BLOCK_SIZE], y[AES_BLOCK_SIZE] = {0};
+  unsigned char tag[AES_GCM_TAG_SIZE], in_tag[AES_GCM_TAG_SIZE];
+  unsigned char diff = 0;
+  int len = in_len - AES_GCM_TAG_SIZE;
+
+  if (!gcm || !gcm->is_init || !in || len < 0 || aad_len < 0 || (len > 0 && !out) || (aad_len > 0 && !aad)) {
+    return -1;
+  }
+  // in 和 out 相同时解密会覆盖 tag 前面的数据，tag 先拷出来
+  memcpy(in_tag, in + len, AES_GCM_TAG_SIZE);
+  gcm_nonce(gcm, channel, frame_index, j0);
+  memcpy(ctr, j0, sizeof(ctr));
+  gcm_ghash(gcm, y, aad, aad_len);
+  gcm_ctr(gcm, ctr, y, 1, in, out, len);
+  gcm_tag(gcm, j0, y, aad_len, len, tag);
+
+  for (int i = 0; i < AES_GCM_TAG_SIZE; i++) diff |= tag[i] ^ in_tag[i];
+  if (diff != 0) {
+    if (len > 0) memset(out, 0, len);
+    return -1;
+  }
+  return len;
+}
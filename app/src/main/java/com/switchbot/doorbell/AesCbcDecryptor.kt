@@ -17,6 +17,14 @@ object AesCbcDecryptor {
      * @return     解密后的字符串，默认 UTF-8 编码
      */
     fun decrypt(data: ByteArray, key: ByteArray, iv: ByteArray, charset: Charset = Charsets.UTF_8): String {
+        return decrypt(data, 0, data.size, key, iv, charset)
+    }
+
+    /**
+     * 解密 data 中 [offset, offset + len) 的片段，省去调用方先拷出一份
+     */
+    fun decrypt(data: ByteArray, offset: Int, len: Int, key: ByteArray, iv: ByteArray,
+                charset: Charset = Charsets.UTF_8): String {
         require(key.size == 16) { "AES key must be 16 bytes" }
         require(iv.size == 16) { "AES IV must be 16 bytes" }
 
@@ -26,7 +34,7 @@ object AesCbcDecryptor {
         val cipher = Cipher.getInstance("AES/CBC/PKCS5Padding")
         cipher.init(Cipher.DECRYPT_MODE, secretKey, ivSpec)
 
-        val decryptedBytes = cipher.doFinal(data)
+        val decryptedBytes = cipher.doFinal(data, offset, len)
         return String(decryptedBytes, charset)
     }
 
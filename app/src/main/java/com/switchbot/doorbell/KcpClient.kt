@@ -1,40 +1,82 @@
 package com.switchbot.doorbell
 
 import android.util.Log
+import java.nio.ByteBuffer
 import java.nio.charset.StandardCharsets
+import java.util.concurrent.locks.ReentrantReadWriteLock
+import kotlin.concurrent.read
+import kotlin.concurrent.write
 
-object KcpClient {
+// 每个实例对应一路相机/码流的 KCP 会话，native 侧以句柄区分，可同时创建多个
+class KcpClient {
 
-init {
-    System.loadLibrary("kcpwrapper")
-}
+companion object {
+    init {
+        System.loadLibrary("kcpwrapper")
+    }
 
-private const val TAG = "KcpClient"
+    private const val TAG = "KcpClient"
+    private const val FULL_AES_PACKAGE_SIZE = 56 * 4 // 224 字节完整 AES 包
+    private val AES_KEY = "VQikblIrZXQ42Hng".toByteArray(Charsets.UTF_8)
+    private val AES_IV = "2FfVKcscXpylGLGT".toByteArray(Charsets.UTF_8)
+}
 
 // ---- native 方法声明 ----
-private external fun initKcp(remoteIp: String, remotePort: Int, conv: Int)
-private external fun updateKcp(currentMs: Long)
-private external fun sendData(data: ByteArray): Int
-private external fun receiveData(): ByteArray?
-private external fun releaseKcp()
+private external fun initKcp(remoteIp: String, remotePort: Int, conv: Int): Long
+private external fun updateKcp(nativePtr: Long, currentMs: Long)
+private external fun sendData(nativePtr: Long, data: ByteArray): Int
+private external fun receiveData(nativePtr: Long): ByteArray?
+private external fun sendDirect(nativePtr: Long, buffer: ByteBuffer, offset: Int, len: Int): Int
+private external fun sendFrame(nativePtr: Long, frameType: Int, encodeType: Int, frameIndex: Long, pts: Long,
+                               data: ByteArray): Int
+private external fun receiveInto(nativePtr: Long, buffer: ByteBuffer): Int
+private external fun releaseKcp(nativePtr: Long)
+private external fun startLoop(nativePtr: Long): Int
+private external fun stopLoop(nativePtr: Long)
+private external fun localPort(nativePtr: Long): Int
 
 // ---- KCP 运行状态 ----
 @Volatile
 private var running = false
 private var recvThread: Thread? = null
+// native 会话句柄。native 调用都在 nativeLock 读锁内进行，stop() 在写锁内把句柄换成 0 后才释放，
+// 不会有调用用到已释放的会话
+@Volatile
+private var nativePtr: Long = 0
+private val nativeLock = ReentrantReadWriteLock()
+
+// 读锁内取句柄调用 native，已停止时返回 fallback
+private inline fun <T> withSession(fallback: T, block: (Long) -> T): T = nativeLock.read {
+    val ptr = nativePtr
+    if (ptr == 0L) fallback else block(ptr)
+}
+
+// 本地 UDP 端口（系统分配），未启动时为 -1
+val port: Int
+    get() = withSession(-1) { localPort(it) }
 
 // ---- 初始化（启动 KCP） ----
 fun start(remoteIp: String, remotePort: Int, conv: Int) {
     if (running) return
             Log.d(TAG, "start: initKcp")
-    initKcp(remoteIp, remotePort, conv)
+    val ptr = initKcp(remoteIp, remotePort, conv)
+    if (ptr == 0L) {
+        Log.e(TAG, "initKcp failed")
+        return
+    }
+    nativeLock.write { nativePtr = ptr }
     running = true
 
+    // 优先使用 native 事件循环（epoll + timerfd），失败时退回 Java 轮询线程
+    if (startLoop(ptr) == 0) return
+
     recvThread = Thread {
         while (running) {
             try {
-                updateKcp(System.currentTimeMillis())
-                val recv = receiveData()
+                val recv = withSession(null) {
+                    updateKcp(it, System.currentTimeMillis())
+                    receiveData(it)
+                }
                 if (recv != null && recv.isNotEmpty()) {
                     onReceive(recv)
                 }
@@ -47,13 +89,23 @@ fun start(remoteIp: String, remotePort: Int, conv: Int) {
 }
 
 // ---- 停止（释放资源） ----
+// 写锁等正在进行的 native 调用返回，句柄换成 0 后新的调用直接返回；
+// 轮询线程要等它真正退出才能释放，不能带超时
 fun stop() {
-    running = false
+    val ptr = nativeLock.write {
+        val old = nativePtr
+        running = false
+        nativePtr = 0
+        old
+    }
+    if (ptr == 0L) return
+    stopLoop(ptr)
     recvThread?.let {
-        try { it.join(100) } catch (_: InterruptedException) {}
+        it.interrupt()
+        try { it.join() } catch (_: InterruptedException) { Thread.currentThread().interrupt() }
         recvThread = null
     }
-    releaseKcp()
+    releaseKcp(ptr)
 }
 
 // ---- 发送数据 ----
@@ -63,33 +115,82 @@ fun send(data: ByteArray) {
         return
     }
     Log.d(TAG, "send: data $data")
-    sendData(data)
+    withSession(Unit) { sendData(it, data) }
+}
+
+// 零拷贝发送：buffer 必须是 ByteBuffer.allocateDirect 分配的，发送 [offset, offset + len)
+fun send(buffer: ByteBuffer, offset: Int, len: Int): Int {
+    if (!running) {
+        Log.w(TAG, "KCP not started yet.")
+        return -1
+    }
+    return withSession(-1) { sendDirect(it, buffer, offset, len) }
+}
+
+// 按帧发送：native 按会话当前 mss 切片，每片作为一条消息发出，
+// frameType/encodeType 取值见 Common_media_slice_packet.h 的 FREAM_TYPE_E / FREAM_ENCODE_TYPE_E
+fun sendFrame(frameType: Int, encodeType: Int, frameIndex: Long, pts: Long, data: ByteArray): Int {
+    if (!running) {
+        Log.w(TAG, "KCP not started yet.")
+        return -1
+    }
+    return withSession(-1) { sendFrame(it, frameType, encodeType, frameIndex, pts, data) }
+}
+
+// 零拷贝接收（轮询模式）：下一条消息写入 direct buffer 开头，返回长度；
+// -1 无消息，-3 buffer 不够大（消息保留，换更大的 buffer 再取）
+fun receive(buffer: ByteBuffer): Int {
+    if (!running) return -1
+    return withSession(-1) { receiveInto(it, buffer) }
 }
 
 // ---- 接收回调 ----
-private val recvBuffer = mutableListOf<Byte>()
-    private val FULL_AES_PACKAGE_SIZE = 56 * 4 // 224 字节完整 AES 包
+// 收到的字节拼进复用的数组，[0, recvLen) 为未凑够整包的数据；放不下时才扩容
+private var recvBuffer = ByteArray(FULL_AES_PACKAGE_SIZE * 16)
+private var recvLen = 0
+
+    // native 事件循环线程回调：buffer 复用，返回后内容即失效，只读取前 len 字节
+    @Suppress("unused")
+    private fun onNativeMessage(buffer: ByteBuffer, len: Int) {
+        reserveRecv(len)
+        buffer.position(0)
+        buffer.get(recvBuffer, recvLen, len)
+        recvLen += len
+        drainAesPackages()
+    }
 
     fun onReceive(data: ByteArray) {
         // 添加到缓冲区
-        recvBuffer.addAll(data.toList())
-        Log.d(TAG, "Buffer size=${recvBuffer.size}")
+        reserveRecv(data.size)
+        System.arraycopy(data, 0, recvBuffer, recvLen, data.size)
+        recvLen += data.size
+        drainAesPackages()
+    }
 
-        // 只有当缓冲区达到完整包长度才解密
-        while (recvBuffer.size >= FULL_AES_PACKAGE_SIZE) {
-            val chunk = recvBuffer.take(FULL_AES_PACKAGE_SIZE).toByteArray()
-            recvBuffer.subList(0, FULL_AES_PACKAGE_SIZE).clear() // 清除已处理数据
+    private fun reserveRecv(len: Int) {
+        if (recvLen + len <= recvBuffer.size) return
+        recvBuffer = recvBuffer.copyOf(maxOf(recvBuffer.size * 2, recvLen + len))
+    }
 
+    private fun drainAesPackages() {
+        Log.d(TAG, "Buffer size=$recvLen")
+
+        // 只有当缓冲区达到完整包长度才解密，直接解数组里的片段，不再逐包拷贝
+        var offset = 0
+        while (recvLen - offset >= FULL_AES_PACKAGE_SIZE) {
             try {
-                val decrypted = AesCbcDecryptor.decrypt(
-                    chunk,
-                    "VQikblIrZXQ42Hng".toByteArray(Charsets.UTF_8),
-                    "2FfVKcscXpylGLGT".toByteArray(Charsets.UTF_8)
-                )
+                val decrypted = AesCbcDecryptor.decrypt(recvBuffer, offset, FULL_AES_PACKAGE_SIZE, AES_KEY, AES_IV)
                 Log.d(TAG, "Decrypted: $decrypted")
             } catch (e: Exception) {
                 Log.e(TAG, "AES decryption error", e)
             }
+            offset += FULL_AES_PACKAGE_SIZE
+        }
+
+        // 剩下不足一包的数据移到开头，一次拷贝
+        if (offset > 0) {
+            System.arraycopy(recvBuffer, offset, recvBuffer, 0, recvLen - offset)
+            recvLen -= offset
         }
     }
 
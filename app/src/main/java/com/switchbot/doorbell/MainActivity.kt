@@ -21,6 +21,7 @@ class MainActivity : ComponentActivity() {
     val TAG: String = "MainActivityA"
 
     var isBind = false
+    val kcp = KcpClient()
     var Handler: Handler? = null
     override fun onCreate(savedInstanceState: Bundle?) {
         super.onCreate(savedInstanceState)
@@ -61,7 +62,6 @@ class MainActivity : ComponentActivity() {
         Log.d(TAG, "onResume: get key=$keyStr iv=$ivStr")
 
         if(isBind){
-                    val kcp = KcpClient
 ////        kcp.start("10.111.92.39", 8888, 1234)
         kcp.start("10.8.41.216", 43210, 1234)
 //// 发送数据
@@ -74,7 +74,7 @@ class MainActivity : ComponentActivity() {
             // 这里放需要定时执行的代码
             // 例如，发送心跳包或检查连接状态
             // 然后再次安排下一次执行
-            KcpClient.send("来自服务器B Message after 500 seconds".toByteArray())
+            kcp.send("来自服务器B Message after 500 seconds".toByteArray())
             Handler?.postDelayed(this, 500) // 每隔1秒执行一次
         }
     }
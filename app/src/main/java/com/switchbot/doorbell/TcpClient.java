@@ -2,6 +2,8 @@ package com.switchbot.doorbell;
 
 import android.util.Log;
 
+import java.nio.ByteBuffer;
+
 public class TcpClient {
     private static final String TAG = "TcpClient";
 
@@ -12,6 +14,8 @@ public class TcpClient {
     public native int connect(long nativePtr);
     public native int sendData(long nativePtr, byte[] data);
     public native int recvData(long nativePtr, byte[] buffer);
+    public native int sendDirect(long nativePtr, ByteBuffer buffer, int offset, int len);
+    public native int recvInto(long nativePtr, ByteBuffer buffer, int offset, int len);
     public native void release(long nativePtr);
     private native int sendHello(String serverIp, byte[] mac, byte[] master, byte[] aesKey);
 
@@ -46,6 +50,16 @@ public class TcpClient {
         return recvData(nativePtr, buffer);
     }
 
+    // 零拷贝版本，buffer 必须是 ByteBuffer.allocateDirect 分配的
+    public int sendData(ByteBuffer buffer, int offset, int len) {
+        return sendDirect(nativePtr, buffer, offset, len);
+    }
+
+    // 读满 len 字节到 buffer 的 offset 处
+    public int recvData(ByteBuffer buffer, int offset, int len) {
+        return recvInto(nativePtr, buffer, offset, len);
+    }
+
     public void release() {
         release(nativePtr);
         nativePtr = 0;